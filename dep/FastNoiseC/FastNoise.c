@@ -100,7 +100,7 @@ FastNoise* fn_new(int seed)
 	fn->cellular_distance_index_0 = 0;
 	fn->cellular_distance_index_1 = 1;
 	fn->cellular_jitter = (FN_DECIMAL)(1);
-	fn->gradient_perturb_amp = (FN_DECIMAL)(1);
+	fn->gradient_perturb_amp = (FN_DECIMAL)(1) / (FN_DECIMAL)(0.45);
 
 	fn_set_seed(fn, seed);
 
@@ -1117,6 +1117,104 @@ FN_DECIMAL fn_simplex4(FastNoise* fn, FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z,
 	return SingleSimplex4(fn, 0, x * fn->frequency, y * fn->frequency, z * fn->frequency, w * fn->frequency);
 }
 
+static void SingleGradientPerturb3(FastNoise* fn, unsigned char offset, FN_DECIMAL warpAmp, FN_DECIMAL frequency,
+	FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z)
+{
+	FN_DECIMAL xf = *x * frequency;
+	FN_DECIMAL yf = *y * frequency;
+	FN_DECIMAL zf = *z * frequency;
+
+	int x0 = FastFloor(xf);
+	int y0 = FastFloor(yf);
+	int z0 = FastFloor(zf);
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+	int z1 = z0 + 1;
+
+	FN_DECIMAL xs, ys, zs;
+	switch (fn->interp)
+	{
+	default:
+	case FN_Linear:
+		xs = xf - (FN_DECIMAL)x0;
+		ys = yf - (FN_DECIMAL)y0;
+		zs = zf - (FN_DECIMAL)z0;
+		break;
+	case FN_Hermite:
+		xs = InterpHermiteFunc(xf - (FN_DECIMAL)x0);
+		ys = InterpHermiteFunc(yf - (FN_DECIMAL)y0);
+		zs = InterpHermiteFunc(zf - (FN_DECIMAL)z0);
+		break;
+	case FN_Quintic:
+		xs = InterpQuinticFunc(xf - (FN_DECIMAL)x0);
+		ys = InterpQuinticFunc(yf - (FN_DECIMAL)y0);
+		zs = InterpQuinticFunc(zf - (FN_DECIMAL)z0);
+		break;
+	}
+
+	int lutPos0 = Index3D_256(fn, offset, x0, y0, z0);
+	int lutPos1 = Index3D_256(fn, offset, x1, y0, z0);
+
+	FN_DECIMAL lx0x = Lerp(CELL_3D_X[lutPos0], CELL_3D_X[lutPos1], xs);
+	FN_DECIMAL ly0x = Lerp(CELL_3D_Y[lutPos0], CELL_3D_Y[lutPos1], xs);
+	FN_DECIMAL lz0x = Lerp(CELL_3D_Z[lutPos0], CELL_3D_Z[lutPos1], xs);
+
+	lutPos0 = Index3D_256(fn, offset, x0, y1, z0);
+	lutPos1 = Index3D_256(fn, offset, x1, y1, z0);
+
+	FN_DECIMAL lx1x = Lerp(CELL_3D_X[lutPos0], CELL_3D_X[lutPos1], xs);
+	FN_DECIMAL ly1x = Lerp(CELL_3D_Y[lutPos0], CELL_3D_Y[lutPos1], xs);
+	FN_DECIMAL lz1x = Lerp(CELL_3D_Z[lutPos0], CELL_3D_Z[lutPos1], xs);
+
+	FN_DECIMAL lx0y = Lerp(lx0x, lx1x, ys);
+	FN_DECIMAL ly0y = Lerp(ly0x, ly1x, ys);
+	FN_DECIMAL lz0y = Lerp(lz0x, lz1x, ys);
+
+	lutPos0 = Index3D_256(fn, offset, x0, y0, z1);
+	lutPos1 = Index3D_256(fn, offset, x1, y0, z1);
+
+	lx0x = Lerp(CELL_3D_X[lutPos0], CELL_3D_X[lutPos1], xs);
+	ly0x = Lerp(CELL_3D_Y[lutPos0], CELL_3D_Y[lutPos1], xs);
+	lz0x = Lerp(CELL_3D_Z[lutPos0], CELL_3D_Z[lutPos1], xs);
+
+	lutPos0 = Index3D_256(fn, offset, x0, y1, z1);
+	lutPos1 = Index3D_256(fn, offset, x1, y1, z1);
+
+	lx1x = Lerp(CELL_3D_X[lutPos0], CELL_3D_X[lutPos1], xs);
+	ly1x = Lerp(CELL_3D_Y[lutPos0], CELL_3D_Y[lutPos1], xs);
+	lz1x = Lerp(CELL_3D_Z[lutPos0], CELL_3D_Z[lutPos1], xs);
+
+	*x += Lerp(lx0y, Lerp(lx0x, lx1x, ys), zs) * warpAmp;
+	*y += Lerp(ly0y, Lerp(ly0x, ly1x, ys), zs) * warpAmp;
+	*z += Lerp(lz0y, Lerp(lz0x, lz1x, ys), zs) * warpAmp;
+}
+
+void fn_gradient_perturb3(FastNoise* fn, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z)
+{
+	SingleGradientPerturb3(fn, 0, fn->gradient_perturb_amp, fn->frequency, x, y, z);
+}
+
+void fn_gradient_perturb_fractal3(FastNoise* fn, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z)
+{
+	FN_DECIMAL amp = fn->gradient_perturb_amp * fn->fractal_bounding;
+	FN_DECIMAL freq = fn->frequency;
+	int i = 0;
+
+	SingleGradientPerturb3(fn, fn->perm[0], amp, fn->frequency, x, y, z);
+
+	while (++i < fn->octaves)
+	{
+		freq *= fn->lacunarity;
+		amp *= fn->gain;
+		SingleGradientPerturb3(fn, fn->perm[i], amp, freq, x, y, z);
+	}
+}
+
+void fn_set_gradient_perturb_amp(FastNoise* fn, FN_DECIMAL amp)
+{
+	fn->gradient_perturb_amp = amp / (FN_DECIMAL)(0.45);
+}
+
 void fn_set_crater_chance(FastNoise* fn, FN_DECIMAL chance)
 {
 	fn->crater_chance = chance;
@@ -1292,3 +1390,73 @@ FN_DECIMAL fn_crater3_get_rad(FastNoise* fn)
 	return fn->crater_rad;
 }
 
+
+// Batch functions
+
+#define FN_ARRAY_FUNC3(func) \
+void func##_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z, \
+	FN_DECIMAL amp, int add, FN_DECIMAL* out) \
+{ \
+	if (add) \
+	{ \
+		for (int i = 0; i < count; i++) { out[i] += func(fn, x[i], y[i], z[i]) * amp; } \
+	} \
+	else \
+	{ \
+		for (int i = 0; i < count; i++) { out[i] = func(fn, x[i], y[i], z[i]) * amp; } \
+	} \
+}
+
+FN_ARRAY_FUNC3(fn_value3)
+FN_ARRAY_FUNC3(fn_value_fractal3)
+FN_ARRAY_FUNC3(fn_perlin3)
+FN_ARRAY_FUNC3(fn_perlin_fractal3)
+FN_ARRAY_FUNC3(fn_simplex3)
+FN_ARRAY_FUNC3(fn_simplex_fractal3)
+
+void fn_gradient_perturb3_array(FastNoise* fn, int count, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z)
+{
+	for (int i = 0; i < count; i++)
+	{
+		fn_gradient_perturb3(fn, &x[i], &y[i], &z[i]);
+	}
+}
+
+void fn_gradient_perturb_fractal3_array(FastNoise* fn, int count, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z)
+{
+	for (int i = 0; i < count; i++)
+	{
+		fn_gradient_perturb_fractal3(fn, &x[i], &y[i], &z[i]);
+	}
+}
+
+#define FN_WARPED_ARRAY_FUNC3(func) \
+void fn_warped_##func##_array(FastNoise* fn, FastNoise* warp, int count, \
+	const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z, FN_DECIMAL amp, int add, FN_DECIMAL* out) \
+{ \
+	for (int i = 0; i < count; i++) \
+	{ \
+		FN_DECIMAL wx = x[i], wy = y[i], wz = z[i]; \
+		fn_gradient_perturb_fractal3(warp, &wx, &wy, &wz); \
+		FN_DECIMAL v = fn_##func(fn, wx, wy, wz) * amp; \
+		out[i] = add ? out[i] + v : v; \
+	} \
+}
+
+FN_WARPED_ARRAY_FUNC3(perlin_fractal3)
+FN_WARPED_ARRAY_FUNC3(simplex_fractal3)
+
+void fn_crater3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out, FN_DECIMAL* out_rad)
+{
+	int do_rad = out_rad != NULL;
+	for (int i = 0; i < count; i++)
+	{
+		FN_DECIMAL v = fn_crater3(fn, do_rad, x[i], y[i], z[i]) * amp;
+		out[i] = add ? out[i] + v : v;
+		if (do_rad)
+		{
+			out_rad[i] = fn->crater_rad;
+		}
+	}
+}
@@ -103,6 +103,9 @@ NO_IGNORE void fn_gradient_perturb_fractal3(FastNoise* fn, FN_DECIMAL* x, FN_DEC
 
 NO_IGNORE FN_DECIMAL fn_simplex4(FastNoise* fn, FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z, FN_DECIMAL w);
 
+// Amplitude of the gradient perturb functions (default is 1)
+NO_IGNORE void fn_set_gradient_perturb_amp(FastNoise* fn, FN_DECIMAL amp);
+
 // CRATER NOISE
 // (Custom method designed by Tatjam and not included in original FastNoise)
 // An implementation of "crater" noise, returns "distance" and radial pos respect to a set of points
@@ -135,6 +138,40 @@ NO_IGNORE FN_DECIMAL fn_crater3(FastNoise* fn, int calculate_rad, FN_DECIMAL x,
 // Call after fn_crater3 to obtain the radial component (if it was calculated)
 NO_IGNORE FN_DECIMAL fn_crater3_get_rad(FastNoise* fn);
 
+// BATCH FUNCTIONS
+// (Not included in original FastNoise)
+// Evaluate count points in a single call, so scripts calling through FFI don't pay
+// the call overhead per point and octave. Coordinates are given as separate arrays.
+// The result is multiplied by amp, and if add is not 0, added to out instead of
+// overwriting it, so layers can be accumulated without extra passes
+NO_IGNORE void fn_value3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_value_fractal3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_perlin3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_perlin_fractal3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_simplex3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_simplex_fractal3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out);
+
+// Perturbs the coordinates in place
+NO_IGNORE void fn_gradient_perturb3_array(FastNoise* fn, int count, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z);
+NO_IGNORE void fn_gradient_perturb_fractal3_array(FastNoise* fn, int count, FN_DECIMAL* x, FN_DECIMAL* y, FN_DECIMAL* z);
+
+// Fused perturb and fractal: every point is perturbed using warp (fractal perturb) and then
+// sampled with fn. The coordinate arrays are not modified
+NO_IGNORE void fn_warped_perlin_fractal3_array(FastNoise* fn, FastNoise* warp, int count,
+	const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z, FN_DECIMAL amp, int add, FN_DECIMAL* out);
+NO_IGNORE void fn_warped_simplex_fractal3_array(FastNoise* fn, FastNoise* warp, int count,
+	const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z, FN_DECIMAL amp, int add, FN_DECIMAL* out);
+
+// Same as fn_crater3, radial components are written to out_rad (without amp) if it's not NULL
+NO_IGNORE void fn_crater3_array(FastNoise* fn, int count, const FN_DECIMAL* x, const FN_DECIMAL* y, const FN_DECIMAL* z,
+	FN_DECIMAL amp, int add, FN_DECIMAL* out, FN_DECIMAL* out_rad);
+
 #ifdef __cplusplus
 };
 #endif
@@ -275,5 +275,131 @@ function noise.crater3_get_rad(fn) end
 ---@param seed integer
 function noise.new(seed) end
 
+---@param fn fast_noise
+---@param amp number
+function noise.set_gradient_perturb_amp(fn, amp) end
+
+---@class noise.array
+---Zero-initialized array of doubles for the batch functions, indices start at 0!
+---@param n integer
+---@return noise.array
+function noise.new_array(n) end
+
+-- Batch functions: evaluate count points at once, out[i] = noise(x[i], y[i], z[i]) * amp,
+-- or out[i] += noise(...) * amp if add is 1 (must be a number, not a boolean)
+-- All arrays must come from noise.new_array and hold at least count elements, otherwise
+-- an error is raised
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.value3_array(fn, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.value_fractal3_array(fn, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.perlin3_array(fn, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.perlin_fractal3_array(fn, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.simplex3_array(fn, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.simplex_fractal3_array(fn, count, x, y, z, amp, add, out) end
+
+---Perturbs the coordinates in place
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+function noise.gradient_perturb3_array(fn, count, x, y, z) end
+
+---Perturbs the coordinates in place
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+function noise.gradient_perturb_fractal3_array(fn, count, x, y, z) end
+
+---Perturbs each point with warp (fractal) and samples fn there, coordinates are not modified
+---@param fn fast_noise
+---@param warp fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.warped_perlin_fractal3_array(fn, warp, count, x, y, z, amp, add, out) end
+
+---Perturbs each point with warp (fractal) and samples fn there, coordinates are not modified
+---@param fn fast_noise
+---@param warp fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+function noise.warped_simplex_fractal3_array(fn, warp, count, x, y, z, amp, add, out) end
+
+---@param fn fast_noise
+---@param count integer
+---@param x noise.array
+---@param y noise.array
+---@param z noise.array
+---@param amp number
+---@param add integer
+---@param out noise.array
+---@param out_rad noise.array|nil Radial components, not scaled by amp
+function noise.crater3_array(fn, count, x, y, z, amp, add, out, out_rad) end
+
 
 return noise
@@ -76,10 +76,17 @@ function unpacked_vehicle:get_center_of_mass(renderer) end
 ---@field welded boolean
 ---@field attached_to vehicle.piece
 ---@field collider_offset glm.mat4
+---@field mass number Read only, use set_mass
 local piece = {}
 
 ---@param update_now boolean
 function piece:set_dirty(update_now) end
+--- Physics pick up the new mass incrementally, no need to set_dirty
+---@param mass number
+function piece:set_mass(mass) end
+---@return number
+---@nodiscard
+function piece:get_dry_mass() end
 ---@return bullet.transform
 ---@nodiscard
 function piece:get_global_transform() end
@@ -182,12 +189,18 @@ function part:get_machine(id) end
 ---@field init_toml toml.table
 ---@field plumbing vehicle.plumbing_machine
 ---@field in_part vehicle.part
+---@field assigned_piece string
 local machine = {}
 
 ---@param iname string Name of the interface
 ---@return table
 function machine:load_interface(iname) end
 
+--- The piece the machine lives in ("piece" in its toml, p_root by default)
+---@return vehicle.piece|nil nil if the piece is missing
+---@nodiscard
+function machine:get_piece() end
+
 
 -- This is a bit of a workaround around sol limitations using LuaJIT...
 ---@class vehicle.machine_array
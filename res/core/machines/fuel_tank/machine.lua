@@ -42,10 +42,22 @@ function draw_imgui()
     imgui.bullet_text("Liquid-Gas Mixing: " .. rnts(plumbing.fluid_container.ullage_distribution * 100.0) .. "%")
 end
 
+-- The piece carries the contents, its mass is updated as they drain
+local function update_piece_mass()
+    local piece = machine:get_piece()
+    if piece == nil then return end
+
+    local contents = plumbing.fluid_container.contents
+    local tmass = contents:get_total_liquid_mass() + contents:get_total_gas_mass()
+    piece:set_mass(piece:get_dry_mass() + tmass)
+end
+
 function update(dt)
 
     if not debug_pause then
         plumbing.update(dt, not pause_reaction)
     end
 
+    update_piece_mass()
+
 end
\ No newline at end of file
@@ -1,14 +1,14 @@
 #version 430 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aColor;
-layout (location = 3) in vec3 aGlobalTex;
+// Quantized, see PlanetTileVertex
+layout (location = 0) in vec3 aPosQ;
+layout (location = 1) in vec2 aNormalQ;
+layout (location = 2) in vec4 aColor;
+layout (location = 3) in vec2 aGlobalTex;
+
+#include "tile_draw.vsi"
 
-uniform mat4 tform;
-uniform mat4 m_tform;
 uniform mat4 normal_tform;
-uniform mat4 rotm_tform;
 
 uniform float f_coef;
 
@@ -25,22 +25,27 @@ out vec3 vPosScaled;
 
 out float flogz;
 
-uniform vec3 tile;
+flat out int vDoDetail;
 
 void main()
 {
-    gl_Position = tform * vec4(aPos, 1.0f);
+	TileDraw draw = draws[aDrawID];
+	vec3 aPos = decode_position(draw, aPosQ);
+	vec3 aNormal = decode_normal(aNormalQ);
+	vDoDetail = draw.info.y;
+
+    gl_Position = draw.tform * vec4(aPos, 1.0f);
 	gl_Position.z = log2(max(1e-6, 1.0 + gl_Position.w)) * f_coef - 1.0;
 	flogz = 1.0 + gl_Position.w;
 
-	vColor = aColor;
+	vColor = aColor.rgb;
 	vNormal = vec3(normal_tform * vec4(aNormal, 1.0));
-	vPosNrm = vec3(rotm_tform * vec4(aPos, 1.0));
+	vPosNrm = vec3(draw.rotm_tform * vec4(aPos, 1.0));
 
-	vGlobalUV = aGlobalTex.xy;
-    vTexture = aGlobalTex.z;
+	vGlobalUV = aGlobalTex;
+    vTexture = 0.0;
 
-	vPos = (m_tform * vec4(aPos, 1.0)).xyz;
-	vPosScaled = (rotm_tform * vec4(aPos, 1.0)).xyz;
+	vPos = (draw.m_tform * vec4(aPos, 1.0)).xyz;
+	vPosScaled = (draw.rotm_tform * vec4(aPos, 1.0)).xyz;
 	vNormalScaled = (vec4(aNormal, 1.0)).xyz;
 }
\ No newline at end of file
@@ -1,16 +1,14 @@
 #version 430 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+// Quantized, see PlanetTileWaterVertex
+layout (location = 0) in vec3 aPosQ;
+layout (location = 1) in vec2 aNormalQ;
 layout (location = 2) in float aDepth;
-layout (location = 3) in vec2 aTexture;
 
-uniform mat4 tform;
-uniform mat4 deferred_tform;
+#include "tile_draw.vsi"
+
 uniform mat4 normal_tform;
-uniform mat4 rotm_tform;
 
-uniform int clockwise;
 uniform float f_coef;
 
 out vec3 vNormal;
@@ -20,22 +18,25 @@ out vec2 vTexture;
 out float flogz;
 out float vDepth;
 
-uniform vec3 tile;
-
 uniform float time;
 
-vec2 get_real_uv()
+vec2 get_real_uv(TileDraw draw)
 {
-	return (aTexture / pow(2, tile.z) + tile.xy * 1000.0) * 0.001;
+	vec2 uv = vec2(get_grid_pos(draw)) / float(tile_size) * 1000.0;
+	return (uv / pow(2, draw.tile.z) + draw.tile.xy * 1000.0) * 0.001;
 }
 
 void main()
 {
-	vTexture = get_real_uv();
+	TileDraw draw = draws[aDrawID];
+	vec3 aPos = decode_position(draw, aPosQ);
+	vec3 aNormal = decode_normal(aNormalQ);
+
+	vTexture = get_real_uv(draw);
 
-	vec4 wPos = deferred_tform * vec4(aPos, 1.0);
+	vec4 wPos = draw.m_tform * vec4(aPos, 1.0);
 
-    gl_Position = tform * vec4(aPos, 1.0);
+    gl_Position = draw.tform * vec4(aPos, 1.0);
 	gl_Position.z = log2(max(1e-6, 1.0 + gl_Position.w)) * f_coef - 1.0;
 
 	flogz = 1.0 + gl_Position.w;
@@ -43,7 +44,7 @@ void main()
 	vPos = wPos.xyz;
 
 	vNormal = vec3(normal_tform * vec4(aNormal, 1.0));
-	vPosNrm = vec3(rotm_tform * vec4(aPos, 1.0));
+	vPosNrm = vec3(draw.rotm_tform * vec4(aPos, 1.0));
 	vDepth = aDepth;
 
 }
\ No newline at end of file
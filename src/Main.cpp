@@ -12,9 +12,21 @@
 #include <assets/AudioClip.h>
 #include <audio/AudioSource.h>
 #include <audio/AudioEngine.h>
+#include <planet_mesher/mesher/PlanetTileBench.h>
 
 int main(int argc, char** argv)
 {
+	// Benchmarks run instead of the game, without any of its subsystems
+	argh::parser args(argc, argv);
+	size_t bench_tiles;
+	if (args("bench_mesher") >> bench_tiles)
+	{
+		create_global_logger();
+		int ret = run_mesher_benchmark(bench_tiles);
+		destroy_global_logger();
+		return ret;
+	}
+
 	osp = new OSP();
 	osp->init(argc, argv);
 
@@ -8,6 +8,12 @@
 #include <lua/LuaCore.h>
 #include <game/GameState.h>
 #include <game/database/GameDatabase.h>
+#include <planet_mesher/mesher/PlanetTileWorkerPool.h>
+#include <planet_mesher/mesher/PlanetTileUploader.h>
+#include <planet_mesher/mesher/PlanetTileRetainer.h>
+#include <planet_mesher/mesher/PlanetHeightCache.h>
+#include <physics/ColliderCache.h>
+#include <planet_mesher/mesher/PlanetTileArena.h>
 
 InputUtil* input;
 
@@ -46,6 +52,7 @@ static void help_menu()
 	menu_item("res_path", "path/to/res/folder/", "./res/", "Path to the resource folder you want to use. End it with a \"/\"");
 	menu_item("udata_path", "path/to/udata/", "./udata/", "Path to the user data folder, ended with a \"/\"");
 	menu_item("load_state", "id_of_save", "(empty)", "ID of the save to load, skipping the main menu");
+	menu_item("bench_mesher", "tile_count", "(empty)", "Measures planet tiles generated per second and core, instead of starting the game");
 	std::cout << rang::fgB::gray << "You can override any of the settings in the loaded settings file using this syntax: " << std::endl;
 	std::cout << rang::fgB::gray << "-" << rang::fgB::blue << "toml.path" << rang::fg::reset <<
 		   	"=" << rang::fgB::blue << "toml-value" << rang::fg::reset << std::endl;
@@ -173,6 +180,7 @@ void OSP::init(int argc, char** argv)
 		auto locale_toml = config->get_qualified_as<std::string>("locale.language");
 		current_locale = locale_toml ? *locale_toml : "en";
 
+		create_global_collider_cache();
 		assets = new AssetManager(res_path, udata_path);
 		renderer = new Renderer(*config);
 		audio_engine = new AudioEngine(*config);
@@ -181,6 +189,11 @@ void OSP::init(int argc, char** argv)
 		create_global_text_drawer();
 		create_global_lua_core();
 		create_global_profiler();
+		create_global_planet_tile_pool();
+		create_global_planet_tile_uploader();
+		create_global_planet_tile_arenas();
+		create_global_planet_tile_retainer();
+		create_global_planet_height_cache();
 
 
 		game_database = new GameDatabase();
@@ -197,6 +210,11 @@ void OSP::finish()
 	logger->info("Closing OSP");
 	delete game_state;
 	delete input;
+	destroy_global_planet_tile_pool();
+	destroy_global_planet_tile_uploader();
+	destroy_global_planet_tile_retainer();
+	destroy_global_planet_height_cache();
+	destroy_global_planet_tile_arenas();
 	destroy_global_lua_core();
 	destroy_global_text_drawer();
 	destroy_global_texture_drawer();
@@ -204,6 +222,7 @@ void OSP::finish()
 	delete renderer;
 	delete audio_engine;
 	delete assets;
+	destroy_global_collider_cache();
 	destroy_global_logger();
 }
 
@@ -225,6 +244,8 @@ void OSP::start_frame()
 		float w = (float)renderer->get_width();
 		float h = (float)renderer->get_height();
 		nvgBeginFrame(renderer->vg, w, h, w / h);
+
+		planet_tile_uploader->new_frame();
 	}
 }
 
@@ -35,10 +35,17 @@ BuildingPrototype::BuildingPrototype(std::shared_ptr<cpptoml::table> table, ASSE
 				logger->fatal("Buildings can only have one collider!");
 			}
 
-			ModelColliderExtractor::load_collider(&collider, child);
-			collider->setMargin(0.005);
+			ModelColliderExtractor::load_collider(&collider, child, glm::dvec3(1.0), 0.005);
 		}
 	}
 
 
 }
+
+BuildingPrototype::~BuildingPrototype()
+{
+	if (collider != nullptr)
+	{
+		ModelColliderExtractor::free_collider(collider);
+	}
+}
@@ -13,6 +13,7 @@ public:
 	btCollisionShape* collider;
 
 	BuildingPrototype(std::shared_ptr<cpptoml::table> table, ASSET_INFO);
+	~BuildingPrototype();
 };
 
 
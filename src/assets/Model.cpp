@@ -1,4 +1,5 @@
 #include "Model.h"
+#include <physics/ColliderCache.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -937,7 +938,39 @@ void Node::draw_shadow(const ShadowCamera& sh_cam, glm::dmat4 model, bool ignore
 }
 
 
-void ModelColliderExtractor::load_collider(btCollisionShape** target, Node* n)
+// Everything that makes the shape of a node what it is, for the ColliderCache
+static std::string get_collider_key(const std::string& type, Node* n, glm::dvec3 scale, double margin)
+{
+	std::string key = fmt::format("{}|{:.9g},{:.9g},{:.9g}|{:.9g}", type, scale.x, scale.y, scale.z, margin);
+
+	if (n->meshes.empty())
+	{
+		return key;
+	}
+
+	if (type == "convex" || type == "concave")
+	{
+		// FNV-1a over the vertices, identical meshes from different models are shared too
+		std::vector<glm::vec3> verts = n->meshes[0].get_verts();
+		uint64_t hash = 14695981039346656037ULL;
+		const uint8_t* data = (const uint8_t*)verts.data();
+		for (size_t i = 0; i < verts.size() * sizeof(glm::vec3); i++)
+		{
+			hash = (hash ^ data[i]) * 1099511628211ULL;
+		}
+
+		key += fmt::format("|{}|{:016x}", verts.size(), hash);
+	}
+	else
+	{
+		auto[min, max] = ModelColliderExtractor::obtain_bounds(&n->meshes[0]);
+		key += fmt::format("|{:.9g},{:.9g},{:.9g}|{:.9g},{:.9g},{:.9g}", min.x, min.y, min.z, max.x, max.y, max.z);
+	}
+
+	return key;
+}
+
+void ModelColliderExtractor::load_collider(btCollisionShape** target, Node* n, glm::dvec3 scale, double margin)
 {
 
 	auto collider_prop = n->properties.find("collider");
@@ -947,52 +980,79 @@ void ModelColliderExtractor::load_collider(btCollisionShape** target, Node* n)
 
 	std::string collider_prop_s = collider_prop->second;
 
+	auto margin_prop = n->properties.find("margin");
 
-
-	if (collider_prop_s == "compound")
-	{
-		load_collider_compound(target, n);
-	}
-	else if (collider_prop_s == "box")
-	{
-		load_collider_box(target, n);
-	}
-	else if (collider_prop_s == "sphere")
-	{
-		load_collider_sphere(target, n);
-	}
-	else if (collider_prop_s == "cylinder")
-	{
-		load_collider_cylinder(target, n);
-	}
-	else if (collider_prop_s == "cone")
-	{
-		load_collider_cone(target, n);
-	}
-	else if (collider_prop_s == "capsule")
+	if (margin_prop != n->properties.end())
 	{
-		load_collider_capsule(target, n);
+
 	}
-	else if (collider_prop_s == "concave")
+
+	if (collider_prop_s == "compound")
 	{
-		load_collider_concave(target, n);
+		// Not shared itself, but its children are
+		load_collider_compound(target, n, scale);
+		(*target)->setMargin(margin);
+		return;
 	}
-	else if (collider_prop_s == "convex")
+
+	std::string key = get_collider_key(collider_prop_s, n, scale, margin);
+	*target = collider_cache->acquire(key, [&collider_prop_s, n, scale, margin]()
 	{
-		load_collider_convex(target, n);
-	}
+		btCollisionShape* shape = nullptr;
 
-	double margin = 0.02;
+		if (collider_prop_s == "box")
+		{
+			load_collider_box(&shape, n);
+		}
+		else if (collider_prop_s == "sphere")
+		{
+			load_collider_sphere(&shape, n);
+		}
+		else if (collider_prop_s == "cylinder")
+		{
+			load_collider_cylinder(&shape, n);
+		}
+		else if (collider_prop_s == "cone")
+		{
+			load_collider_cone(&shape, n);
+		}
+		else if (collider_prop_s == "capsule")
+		{
+			load_collider_capsule(&shape, n);
+		}
+		else if (collider_prop_s == "concave")
+		{
+			load_collider_concave(&shape, n);
+		}
+		else if (collider_prop_s == "convex")
+		{
+			load_collider_convex(&shape, n);
+		}
 
-	auto margin_prop = n->properties.find("margin");
+		shape->setLocalScaling(to_btVector3(scale));
+		shape->setMargin(margin);
 
-	if (margin_prop != n->properties.end())
-	{
+		return shape;
+	});
 
-	}
+}
 
-	(*target)->setMargin(margin);
+void ModelColliderExtractor::free_collider(btCollisionShape* shape)
+{
+	if (shape->isCompound())
+	{
+		btCompoundShape* compound = (btCompoundShape*)shape;
+		for (int i = 0; i < compound->getNumChildShapes(); i++)
+		{
+			free_collider(compound->getChildShape(i));
+		}
 
+		delete compound;
+	}
+	else
+	{
+		collider_cache->release(shape);
+	}
 }
 
 
@@ -1013,7 +1073,7 @@ std::pair<glm::vec3, glm::vec3> ModelColliderExtractor::obtain_bounds(Mesh* m)
 	return std::make_pair(m->min_bound, m->max_bound);
 }
 
-void ModelColliderExtractor::load_collider_compound(btCollisionShape** target, Node* n)
+void ModelColliderExtractor::load_collider_compound(btCollisionShape** target, Node* n, glm::dvec3 scale)
 {
 
 	*target = new btCompoundShape();
@@ -1022,19 +1082,20 @@ void ModelColliderExtractor::load_collider_compound(btCollisionShape** target, N
 	// All children are loaded as colliders
 	for (Node* child : n->children)
 	{
-		btCollisionShape* n_shape;
-		load_collider(&n_shape, child);
-
 		btTransform tform;
-		glm::dvec3 scale, translate, skew;
+		glm::dvec3 child_scale, translate, skew;
 		glm::dquat orient;
 		glm::dvec4 persp;
 
-		glm::decompose(child->sub_transform, scale, orient, translate, skew, persp);
+		glm::decompose(child->sub_transform, child_scale, orient, translate, skew, persp);
 
-		tform.setOrigin(to_btVector3(translate));
+		// Same as scaling the compound afterwards (see btCompoundShape::setLocalScaling),
+		// which we can't do as it would change the shared children
+		tform.setOrigin(to_btVector3(translate * scale));
 		tform.setRotation(to_btQuaternion(orient));
-		n_shape->setLocalScaling(to_btVector3(scale));
+
+		btCollisionShape* n_shape;
+		load_collider(&n_shape, child, child_scale * scale);
 
 		target_c->addChildShape(tform, n_shape);
 	}
@@ -288,7 +288,7 @@ public:
 	//        min        max
 	static std::pair<glm::vec3, glm::vec3> obtain_bounds(Mesh* m);
 
-	static void load_collider_compound(btCollisionShape** target, Node* n);
+	static void load_collider_compound(btCollisionShape** target, Node* n, glm::dvec3 scale);
 	static void load_collider_box(btCollisionShape** target, Node* n);
 	static void load_collider_sphere(btCollisionShape** target, Node* n);
 	static void load_collider_cylinder(btCollisionShape** target, Node* n);
@@ -297,5 +297,10 @@ public:
 	static void load_collider_concave(btCollisionShape** target, Node* n);
 	static void load_collider_convex(btCollisionShape** target, Node* n);
 
-	static void load_collider(btCollisionShape** target, Node* n);
+	// Shapes are shared through the global ColliderCache, so they must not be changed
+	// afterwards: scale and margin are given here. Free them with free_collider
+	static void load_collider(btCollisionShape** target, Node* n,
+		glm::dvec3 scale = glm::dvec3(1.0), double margin = 0.02);
+	// Releases every shared shape in it
+	static void free_collider(btCollisionShape* shape);
 };
@@ -48,9 +48,21 @@ void PartPrototype::load_piece(const cpptoml::table& toml, GPUModelNodePointer&&
 				}
 
 				proto.render_offset = child->sub_transform;
-				ModelColliderExtractor::load_collider(&proto.collider, child);
 
-				proto.collider->setMargin(0.005);
+				btTransform tform;
+				glm::dvec3 scale, translate, skew;
+				glm::dquat orient;
+				glm::dvec4 persp;
+
+				glm::decompose(child->sub_transform * n->sub_transform, scale, orient, translate, skew, persp);
+
+				tform.setOrigin(to_btVector3(translate));
+				tform.setRotation(to_btQuaternion(orient));
+
+				// Pieces of every part using the same shape share it
+				ModelColliderExtractor::load_collider(&proto.collider, child, scale, 0.005);
+
+				proto.collider_offset = tform;
 
 				auto mass_toml = node_toml->get_as<double>("mass");
 
@@ -66,20 +78,6 @@ void PartPrototype::load_piece(const cpptoml::table& toml, GPUModelNodePointer&&
 
 				proto.allows_radial = node_toml->get_as<bool>("allows_radial").value_or(true);
 
-				btTransform tform;
-				glm::dvec3 scale, translate, skew;
-				glm::dquat orient;
-				glm::dvec4 persp;
-
-				glm::decompose(child->sub_transform * n->sub_transform, scale, orient, translate, skew, persp);
-
-
-				tform.setOrigin(to_btVector3(translate));
-				tform.setRotation(to_btQuaternion(orient));
-				proto.collider->setLocalScaling(to_btVector3(scale));
-
-				proto.collider_offset = tform;
-
 				if(n->name != ROOT_NAME)
 				{
 					// A link MUST be present
@@ -195,7 +193,7 @@ PartPrototype::~PartPrototype()
 	{
 		if (it->second.collider)
 		{
-			delete it->second.collider;
+			ModelColliderExtractor::free_collider(it->second.collider);
 		}
 	}
 }
@@ -43,6 +43,14 @@ int LoadFileRequire(lua_State* L)
 
 	if (id != LuaCore::LibraryID::UNKNOWN)
 	{
+		sol::object blocked = sview["__blocked_libs"];
+		if (blocked.is<sol::table>() && blocked.as<sol::table>()[(int)id].get_or(false))
+		{
+			logger->error("Library '{}' is blocked in this lua state", path);
+			sol::stack::push(L, "ERROR");
+			return 1;
+		}
+
 		was_module = true;
 		lua_core->load_library(module_table, id);
 	}
@@ -162,6 +170,16 @@ void LuaCore::load_library(sol::table& table, LibraryID id)
 	libraries[id]->load_to(table);
 }
 
+void LuaCore::block_library(sol::state& to, LibraryID id)
+{
+	if (!to["__blocked_libs"].valid())
+	{
+		to.create_named_table("__blocked_libs");
+	}
+
+	to["__blocked_libs"][(int)id] = true;
+}
+
 void LuaCore::load(sol::state& to, const std::string& pkg)
 {
 	to.open_libraries(
@@ -62,6 +62,10 @@ public:
 
 	void load_library(sol::table& to, LibraryID id);
 
+	// Makes require fail for the library on the given state, must be
+	// called after load
+	void block_library(sol::state& to, LibraryID id);
+
 	// pkg is the package the lua file is in, this is used by the 
 	// package loader internally ("_pkg" value)
 	void load(sol::state& to, const std::string& pkg);
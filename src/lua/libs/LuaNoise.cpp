@@ -49,6 +49,18 @@ void LuaNoise::load_to(sol::table& table)
     "void fn_set_crater_layers(struct FastNoise* fn, int layers);"
  	"double fn_crater3(struct FastNoise* fn, int do_rad, double x, double y, double z);"
   	"double fn_crater3_get_rad(struct FastNoise* fn);"
+	"void fn_set_gradient_perturb_amp(struct FastNoise* fn, double amp);"
+	"void fn_value3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_value_fractal3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_perlin3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_perlin_fractal3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_simplex3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_simplex_fractal3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_gradient_perturb3_array(struct FastNoise* fn, int count, double* x, double* y, double* z);"
+	"void fn_gradient_perturb_fractal3_array(struct FastNoise* fn, int count, double* x, double* y, double* z);"
+	"void fn_warped_perlin_fractal3_array(struct FastNoise* fn, struct FastNoise* warp, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_warped_simplex_fractal3_array(struct FastNoise* fn, struct FastNoise* warp, int count, const double* x, const double* y, const double* z, double amp, int add, double* out);"
+	"void fn_crater3_array(struct FastNoise* fn, int count, const double* x, const double* y, const double* z, double amp, int add, double* out, double* out_rad);"
 	"struct FastNoise* fn_new(int seed);]]", "internal: LuaNoise");
 	// Little macro to shorten a bit the code
 #define EXPORT_FFI(ffi_name, table_name) table[table_name] = sview["ffi"]["C"][ffi_name]
@@ -83,8 +95,9 @@ void LuaNoise::load_to(sol::table& table)
 	//EXPORT_FFI("fn_cellular3", "cellular3");
 	//EXPORT_FFI("fn_cubic3", "cubic3");
 	//EXPORT_FFI("fn_cubic_fractal3", "cubic_fractal3");
-	//EXPORT_FFI("fn_gradient_perturb3", "gradient_perturb3");
-	//EXPORT_FFI("fn_gradient_perturb_fractal3", "gradient_perturb_fractal3");
+	EXPORT_FFI("fn_gradient_perturb3", "gradient_perturb3");
+	EXPORT_FFI("fn_gradient_perturb_fractal3", "gradient_perturb_fractal3");
+	EXPORT_FFI("fn_set_gradient_perturb_amp", "set_gradient_perturb_amp");
 	EXPORT_FFI("fn_set_crater_chance", "set_crater_chance");
 	EXPORT_FFI("fn_set_crater_layers", "set_crater_layers");
 	EXPORT_FFI("fn_crater3_get_rad", "crater3_get_rad");
@@ -92,6 +105,87 @@ void LuaNoise::load_to(sol::table& table)
 	EXPORT_FFI("fn_simplex4", "simplex4");
 	EXPORT_FFI("fn_new", "new");
 
+	// Batch functions, a whole tile can be generated in a few calls. The raw FFI functions
+	// would happily read or write past the end of the arrays, so scripts only get checked
+	// wrappers which know the length of every array (they must come from new_array)
+	// (zero-initialized, indices start at 0!)
+	sol::table batch = sview.script(R"lua(
+		local ffi = ffi
+		local C = ffi.C
+		local error, select, type = error, select, type
+		local sizes = setmetatable({}, {__mode = "k"})
+
+		local function check(count, ...)
+			if type(count) ~= "number" or count < 0 then
+				error("count must be a non negative number", 3)
+			end
+
+			for i = 1, select("#", ...) do
+				local n = sizes[select(i, ...)]
+				if n == nil then
+					error("noise arrays must be created with noise.new_array", 3)
+				elseif count > n then
+					error("count (" .. count .. ") is larger than an array (" .. n .. ")", 3)
+				end
+			end
+		end
+
+		local function wrap_values(f)
+			return function(fn, count, x, y, z, amp, add, out)
+				check(count, x, y, z, out)
+				f(fn, count, x, y, z, amp, add, out)
+			end
+		end
+
+		local function wrap_perturb(f)
+			return function(fn, count, x, y, z)
+				check(count, x, y, z)
+				f(fn, count, x, y, z)
+			end
+		end
+
+		local function wrap_warped(f)
+			return function(fn, warp, count, x, y, z, amp, add, out)
+				check(count, x, y, z, out)
+				f(fn, warp, count, x, y, z, amp, add, out)
+			end
+		end
+
+		return {
+			new_array = function(n)
+				if type(n) ~= "number" or n < 0 then
+					error("array size must be a non negative number", 2)
+				end
+
+				local arr = ffi.new("double[?]", n)
+				sizes[arr] = ffi.sizeof(arr) / ffi.sizeof("double")
+				return arr
+			end,
+			value3_array = wrap_values(C.fn_value3_array),
+			value_fractal3_array = wrap_values(C.fn_value_fractal3_array),
+			perlin3_array = wrap_values(C.fn_perlin3_array),
+			perlin_fractal3_array = wrap_values(C.fn_perlin_fractal3_array),
+			simplex3_array = wrap_values(C.fn_simplex3_array),
+			simplex_fractal3_array = wrap_values(C.fn_simplex_fractal3_array),
+			gradient_perturb3_array = wrap_perturb(C.fn_gradient_perturb3_array),
+			gradient_perturb_fractal3_array = wrap_perturb(C.fn_gradient_perturb_fractal3_array),
+			warped_perlin_fractal3_array = wrap_warped(C.fn_warped_perlin_fractal3_array),
+			warped_simplex_fractal3_array = wrap_warped(C.fn_warped_simplex_fractal3_array),
+			crater3_array = function(fn, count, x, y, z, amp, add, out, out_rad)
+				if out_rad == nil then
+					check(count, x, y, z, out)
+				else
+					check(count, x, y, z, out, out_rad)
+				end
+				C.fn_crater3_array(fn, count, x, y, z, amp, add, out, out_rad)
+			end
+		})lua", "internal: LuaNoise");
+
+	for (auto& pair : batch)
+	{
+		table[pair.first] = pair.second;
+	}
+
 	// Unload ffi to avoid security risks 
 	sview["ffi"] = sol::nil;
 
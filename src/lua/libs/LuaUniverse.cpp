@@ -75,7 +75,51 @@ void LuaUniverse::load_to(sol::table& table)
 		 }
 	);
 
-	table.new_usertype<PlanetarySystem>("planetary_system", sol::base_classes, sol::bases<Drawable>());
+	table.new_usertype<PlanetTileRaycaster::Ray>("terrain_ray",
+		sol::constructors<PlanetTileRaycaster::Ray(),
+			PlanetTileRaycaster::Ray(glm::dvec3, glm::dvec3, double),
+			PlanetTileRaycaster::Ray(glm::dvec3, glm::dvec3, double, double)>(),
+		"origin", &PlanetTileRaycaster::Ray::origin,
+		"dir", &PlanetTileRaycaster::Ray::dir,
+		"length", &PlanetTileRaycaster::Ray::length,
+		"radius", &PlanetTileRaycaster::Ray::radius);
+
+	table.new_usertype<PlanetTileRaycaster::Hit>("terrain_hit",
+		"hit", &PlanetTileRaycaster::Hit::hit,
+		"t", &PlanetTileRaycaster::Hit::t,
+		"pos", &PlanetTileRaycaster::Hit::pos,
+		"nrm", &PlanetTileRaycaster::Hit::nrm,
+		"depth", &PlanetTileRaycaster::Hit::depth);
+
+	table.new_usertype<PlanetarySystem>("planetary_system", sol::base_classes, sol::bases<Drawable>(),
+		// Takes an array of terrain_ray (in world coordinates) and returns an array of terrain_hit
+		"raycast_terrain", [](PlanetarySystem* self, const std::string& body, sol::table rays)
+		{
+			std::vector<PlanetTileRaycaster::Ray> rays_v;
+			rays_v.reserve(rays.size());
+			for (size_t i = 1; i <= rays.size(); i++)
+			{
+				rays_v.push_back(rays.get<PlanetTileRaycaster::Ray>(i));
+			}
+
+			std::vector<PlanetTileRaycaster::Hit> hits;
+			self->raycast_terrain(self->get_element_index_from_name(body), rays_v, hits);
+			return sol::as_table(hits);
+		},
+		// Takes an array of world positions, returns an array of heights over sea level
+		"get_terrain_heights", [](PlanetarySystem* self, const std::string& body, sol::table pos)
+		{
+			std::vector<glm::dvec3> pos_v;
+			pos_v.reserve(pos.size());
+			for (size_t i = 1; i <= pos.size(); i++)
+			{
+				pos_v.push_back(pos.get<glm::dvec3>(i));
+			}
+
+			std::vector<double> heights;
+			self->get_terrain_heights(self->get_element_index_from_name(body), pos_v, heights);
+			return sol::as_table(heights);
+		});
 	table.new_usertype<Entity>("entity", sol::no_constructor, sol::base_classes, sol::bases<Drawable>(),
 	        "enable_bullet", &Entity::enable_bullet,
 	        "disable_bullet", &Entity::disable_bullet,
@@ -59,6 +59,12 @@ void LuaVehicle::load_to(sol::table& table)
 		"welded", &Piece::welded,
 		"attached_to", &Piece::attached_to,
 		"set_dirty", &Piece::set_dirty, 
+		"mass", sol::readonly(&Piece::mass),
+		"set_mass", &Piece::set_mass,
+		"get_dry_mass", [](Piece& self)
+		{
+			return self.piece_prototype->mass;
+		},
 		"get_global_transform", [](Piece& self)
 		{
 			return BulletTransform(self.get_global_transform());
@@ -131,6 +137,8 @@ void LuaVehicle::load_to(sol::table& table)
 		"init_toml", &Machine::init_toml,
 		"plumbing", &Machine::plumbing,
 		"in_part", &Machine::in_part,
+		"assigned_piece", sol::readonly(&Machine::assigned_piece),
+		"get_piece", &Machine::get_piece,
 		"load_interface", [](Machine* self, const std::string& iname, sol::this_state tst, sol::this_environment tenv)
 		{
 			sol::environment old_env = tenv;
@@ -0,0 +1,58 @@
+#include "ColliderCache.h"
+#include <util/Logger.h>
+
+ColliderCache* collider_cache;
+
+btCollisionShape* ColliderCache::acquire(const std::string& key, const std::function<btCollisionShape*()>& make)
+{
+	auto it = shapes.find(key);
+	if (it != shapes.end())
+	{
+		it->second.refs++;
+		return it->second.shape;
+	}
+
+	btCollisionShape* shape = make();
+	shapes[key] = Entry{shape, 1};
+	keys[shape] = key;
+
+	return shape;
+}
+
+void ColliderCache::release(btCollisionShape* shape)
+{
+	auto key_it = keys.find(shape);
+	logger->check(key_it != keys.end(), "Released a collider not made by the collider cache");
+
+	auto it = shapes.find(key_it->second);
+	it->second.refs--;
+	if (it->second.refs == 0)
+	{
+		delete shape;
+		shapes.erase(it);
+		keys.erase(key_it);
+	}
+}
+
+ColliderCache::~ColliderCache()
+{
+	if (!shapes.empty())
+	{
+		logger->warn("{} colliders were never released", shapes.size());
+	}
+
+	for (auto& pair : shapes)
+	{
+		delete pair.second.shape;
+	}
+}
+
+void create_global_collider_cache()
+{
+	collider_cache = new ColliderCache();
+}
+
+void destroy_global_collider_cache()
+{
+	delete collider_cache;
+}
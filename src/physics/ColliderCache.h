@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#pragma warning(push, 0)
+#include <BulletCollision/CollisionShapes/btCollisionShape.h>
+#pragma warning(pop)
+
+// Collision shapes never change once made, so identical ones (same kind, size,
+// scale and margin, or the same hull) are made only once and shared by every
+// prototype and compound shape using them. They are reference counted and
+// deleted once the last user releases them.
+// Pieces simply point to the shape of their prototype, which keeps it alive.
+// Main thread only, like asset loading
+class ColliderCache
+{
+private:
+
+	struct Entry
+	{
+		btCollisionShape* shape;
+		size_t refs;
+	};
+
+	std::unordered_map<std::string, Entry> shapes;
+	std::unordered_map<btCollisionShape*, std::string> keys;
+
+public:
+
+	// Returns the shape made for key, calling make if there's none yet
+	btCollisionShape* acquire(const std::string& key, const std::function<btCollisionShape*()>& make);
+	void release(btCollisionShape* shape);
+
+	~ColliderCache();
+};
+
+extern ColliderCache* collider_cache;
+
+void create_global_collider_cache();
+void destroy_global_collider_cache();
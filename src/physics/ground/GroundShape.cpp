@@ -25,10 +25,10 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 		// We draw all loaded tiles
 		for (auto it = server->cache.begin(); it != server->cache.end(); it++)
 		{
-			btVector3* verts = it->second->verts;
+			std::vector<btVector3>& verts = it->second->verts;
 
 			// Return the triangles
-			for (size_t i = 0; i < PlanetTile::PHYSICS_INDEX_COUNT; i += 3)
+			for (size_t i = 0; i < verts.size(); i += 3)
 			{
 				callback->processTriangle(&verts[i], (int)0, (int)(i / 3));
 			}
@@ -58,13 +58,14 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 		aabb_box[6] = aabb0 + glm::dvec3(0.0, daabb.y, daabb.z);
 		aabb_box[7] = aabb1;
 
-		// We create a new quad tree every time, perfomance is not that bad
-		QuadTreePlanet quad_tree = QuadTreePlanet();
+		// We start from a flat quad tree every time, perfomance is not that bad
+		// as the nodes come from its pool
+		quad_tree.flatten();
 
 
 		glm::dvec3 normalized[8];
 
-		size_t wanted_depth = body->config.surface.max_depth + PlanetTile::PHYSICS_GRAPHICS_RELATION - 1;
+		size_t wanted_depth = PlanetTile::get_physics_depth(body->config.surface.max_depth);
 
 		glm::dvec3 rel = glm::normalize(aabb_box[0]);
 
@@ -102,9 +103,9 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 		
 		for (QuadTreeNode* leaf : leafs)
 		{
-			btVector3* verts = server->query(leaf, 1.0);
+			std::vector<btVector3>& verts = server->query(leaf, 1.0);
 			// Return the triangles
-			for (size_t i = 0; i < PlanetTile::PHYSICS_INDEX_COUNT; i+=3)
+			for (size_t i = 0; i < verts.size(); i+=3)
 			{
 				callback->processTriangle(&verts[i], (int)0, (int)(i / 3));
 			}
@@ -8,6 +8,7 @@
 #include "../glm/BulletGlmCompat.h"
 #include <util/DebugDrawer.h>
 #include "GroundShapeServer.h"
+#include <planet_mesher/quadtree/QuadTreePlanet.h>
 
 class GroundShape : public btConcaveShape
 {
@@ -17,6 +18,10 @@ private:
 	SystemElement* body;
 	GroundShapeServer* server;
 
+	// Flattened and subdivided again on every query, kept around
+	// so its nodes are reused
+	mutable QuadTreePlanet quad_tree;
+
 
 public:
 	
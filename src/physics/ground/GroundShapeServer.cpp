@@ -1,15 +1,17 @@
 #include "GroundShapeServer.h"
+#include <planet_mesher/mesher/PlanetTileServer.h>
+#include <planet_mesher/mesher/PlanetHeightCache.h>
 
 
 
 
-btVector3* GroundShapeServer::query(QuadTreeNode* node, double time)
+std::vector<btVector3>& GroundShapeServer::query(QuadTreeNode* node, double time)
 {
-	PlanetTilePath path = PlanetTilePath(node->get_path(), node->planetside);
+	PlanetTilePath path = node->get_path();
 
 	if (cache.find(path) != cache.end())
 	{
-		return &cache[path]->verts[0];
+		return cache[path]->verts;
 	}
 	else
 	{
@@ -17,27 +19,54 @@ btVector3* GroundShapeServer::query(QuadTreeNode* node, double time)
 		TileAndTriangles* n_tile = new TileAndTriangles(path, time, this);
 		cache[path] = n_tile;
 
-		return &n_tile->verts[0];
+		return n_tile->verts;
 	}
 }
 
+const std::vector<uint16_t>& GroundShapeServer::get_indices(int size)
+{
+	auto it = indices.find(size);
+	if (it == indices.end())
+	{
+		it = indices.emplace(size, std::vector<uint16_t>()).first;
+		PlanetTile::generate_physics_index_array(it->second, size);
+	}
+
+	return it->second;
+}
+
 GroundShapeServer::GroundShapeServer(SystemElement* body)
 {
 	this->body = body;
 
 	bool wrote_error = false;
 
-	std::string script = AssetManager::load_string_raw(body->config.surface.script_path);
+	graph = nullptr;
+	if (!body->config.surface.graph_path.empty())
+	{
+		graph = PlanetNoiseGraph::load(body->config.surface.graph_path);
+	}
 
+	std::string script;
 	PlanetTile::prepare_lua(lua);
-	LuaUtil::safe_lua(lua, script, wrote_error, body->config.surface.script_path);
+	if (!body->config.surface.script_path.empty())
+	{
+		script = AssetManager::load_string_raw(body->config.surface.script_path);
+		LuaUtil::safe_lua(lua, script, wrote_error, body->config.surface.script_path);
+	}
+
+	generator_key = PlanetTileServer::get_generator_key(script, body->config, graph);
 
-	PlanetTile::generate_physics_index_array(indices);
+	const SurfaceConfig& surface = body->config.surface;
+	settings.max_size = surface.physics_max_size > 0 ? surface.physics_max_size : PlanetTile::PHYSICS_MAX_SIZE;
+	settings.min_size = surface.physics_min_size > 0 ? surface.physics_min_size : settings.max_size;
+	settings.max_error = surface.physics_max_error;
 }
 
 
 GroundShapeServer::~GroundShapeServer()
 {
+	delete graph;
 }
 
 GroundShapeServer::TileAndTriangles::TileAndTriangles(PlanetTilePath npath, double time, GroundShapeServer* server) 
@@ -47,15 +76,32 @@ GroundShapeServer::TileAndTriangles::TileAndTriangles(PlanetTilePath npath, doub
 	double growth = -2.5; // A little excessive so vehicles "sink" a little and dont float
 	double planet_radius = server->body->config.radius + growth;
 
-	PlanetTile::generate_physics(npath, server->body->config.radius, server->lua, &server->work_array);
+	double radius = server->body->config.radius;
+	int max_size = PlanetTile::sanitize_physics_size(server->settings.max_size);
+	if (planet_height_cache->load(server->generator_key, npath, server->gen_out))
+	{
+		PlanetTile::get_physics_heights(server->gen_out, max_size, server->heights);
+	}
+	else
+	{
+		// Render tiles need the whole grid and colors, so we don't store anything and
+		// only generate the heights we need
+		PlanetTile::generate_physics_heights(npath, radius, server->lua, server->graph, max_size,
+			server->gen_info, server->gen_out, server->heights);
+	}
+
+	PlanetTile::generate_physics(npath, radius, server->heights, server->settings, server->work_array, size);
 
 	glm::dmat4 model = glm::dmat4(1.0);
 	model = glm::scale(model, glm::dvec3(planet_radius));
 	model = model * path.get_model_spheric_matrix();
 
-	for (size_t i = 0; i < server->indices.size(); i++)
+	const std::vector<uint16_t>& indices = server->get_indices(size);
+	verts.resize(indices.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
 	{
-		glm::dvec3 v = server->work_array[server->indices[i]].pos;
+		glm::dvec3 v = server->work_array[indices[i]].pos;
 		// Transform to real position relative to planet
 		v = model * glm::dvec4(v, 1.0);
 
@@ -2,6 +2,7 @@
 #include <planet_mesher/quadtree/QuadTreeDefines.h>
 #include <planet_mesher/quadtree/QuadTreeNode.h>
 #include <planet_mesher/mesher/PlanetTile.h>
+#include <planet_mesher/mesher/PlanetNoiseGraph.h>
 #include <universe/element/SystemElement.h>
 #include "../glm/BulletGlmCompat.h"
 #include <glm/glm.hpp>
@@ -10,6 +11,9 @@
 // Handles generation of the ground shape triangles,
 // and, most importantly, caching of them using the
 // quadtree coordinates.
+// The heights are shared with the render tiles through the global
+// PlanetHeightCache, so we only run the generator ourselves if they
+// haven't got to the tile yet (and then they reuse our output)
 // We use a time-out based system for "forgetting" about
 // tiles as this may be useful in certain situations
 // such as raycasting. Every request must tell the system
@@ -22,20 +26,22 @@
 
 class GroundShapeServer
 {
-public:
-	static constexpr size_t PHYSICS_VERT_COUNT = PlanetTile::PHYSICS_SIZE * PlanetTile::PHYSICS_SIZE;
-	static constexpr size_t PHYSICS_TRI_COUNT = PHYSICS_VERT_COUNT * 3;
-
 private:
-	
-	std::array<uint16_t, PlanetTile::PHYSICS_INDEX_COUNT> indices;
+
+	// Index arrays are shared by all tiles with the same grid size
+	std::unordered_map<int, std::vector<uint16_t>> indices;
+
+	const std::vector<uint16_t>& get_indices(int size);
 
 	struct TileAndTriangles
 	{
 		PlanetTilePath path;
 		double time_remaining;
 
-		btVector3 verts[PlanetTile::PHYSICS_INDEX_COUNT];
+		// Grid size chosen for the tile
+		int size;
+		// Triangle soup, 3 vertices per triangle
+		std::vector<btVector3> verts;
 
 		TileAndTriangles(PlanetTilePath npath, double time, GroundShapeServer* server);
 	};
@@ -45,9 +51,19 @@ public:
 	
 	std::unordered_map<PlanetTilePath, TileAndTriangles*, PlanetTilePathHasher> cache;
 
-	PlanetTile::SimpleVertexArray<PlanetTile::PHYSICS_SIZE> work_array;
+	std::vector<PlanetTileSimpleVertex> work_array;
+	std::vector<PlanetTile::GeneratorInfo> gen_info;
+	std::vector<PlanetTile::GeneratorOut> gen_out;
+	// Of the max_size physics grid
+	std::vector<double> heights;
+	// See PlanetTileServer::get_generator_key
+	uint64_t generator_key;
+
+	PlanetTile::PhysicsSettings settings;
 
 	sol::state lua;
+	// Used instead of lua if the surface has a noise graph
+	PlanetNoiseGraph* graph;
 
 	SystemElement* body;
 
@@ -56,7 +72,7 @@ public:
 	void update(double pdt);
 
 	
-	btVector3* query(QuadTreeNode* node, double time = 1.0);
+	std::vector<btVector3>& query(QuadTreeNode* node, double time = 1.0);
 
 	GroundShapeServer(SystemElement* body);
 	~GroundShapeServer();
@@ -0,0 +1,71 @@
+#include "PlanetHeightCache.h"
+#include <imgui/imgui.h>
+
+PlanetHeightCache* planet_height_cache;
+
+bool PlanetHeightCache::load(uint64_t generator, const PlanetTilePath& path, std::vector<PlanetTile::GeneratorOut>& out)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	auto it = index.find(Key{generator, path});
+	if (it == index.end())
+	{
+		misses++;
+		return false;
+	}
+
+	// Back to the front
+	lru.splice(lru.begin(), lru, it->second);
+	out = it->second->out;
+	hits++;
+
+	return true;
+}
+
+void PlanetHeightCache::store(uint64_t generator, const PlanetTilePath& path, const std::vector<PlanetTile::GeneratorOut>& out)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	Key key = Key{generator, path};
+	auto it = index.find(key);
+	if (it != index.end())
+	{
+		// Same generator, same output
+		lru.splice(lru.begin(), lru, it->second);
+		return;
+	}
+
+	lru.push_front(Entry{key, out});
+	index[key] = lru.begin();
+
+	while (lru.size() > max_tiles)
+	{
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+}
+
+void PlanetHeightCache::do_imgui()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	ImGui::Text("Shared heights: %i of %i tiles, %i hits, %i misses", (int)lru.size(), (int)max_tiles,
+		(int)hits, (int)misses);
+}
+
+PlanetHeightCache::PlanetHeightCache(size_t max_tiles)
+{
+	this->max_tiles = max_tiles;
+	hits = 0;
+	misses = 0;
+}
+
+void create_global_planet_height_cache()
+{
+	// ~40KB each, plenty for the surroundings of every vehicle
+	planet_height_cache = new PlanetHeightCache(256);
+}
+
+void destroy_global_planet_height_cache()
+{
+	delete planet_height_cache;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "PlanetTilePath.h"
+#include "PlanetTile.h"
+
+// Generator output (heights and colors over the render grid, border included) of
+// recently generated render tiles at the physics depth, so the physics tiles (see
+// GroundShapeServer) simply reuse it. Physics tiles missing here only generate
+// the heights they need, which are not stored as render tiles can't use them.
+// Entries are identified by the generator key (see PlanetTileServer::get_generator_key)
+// so it works no matter which lua state / graph instance made them.
+// Once over the limit the least recently used entries are dropped.
+// Safe to use from many threads
+class PlanetHeightCache
+{
+private:
+
+	struct Key
+	{
+		uint64_t generator;
+		PlanetTilePath path;
+
+		bool operator==(const Key& other) const { return generator == other.generator && path == other.path; }
+	};
+
+	struct KeyHasher
+	{
+		std::size_t operator()(const Key& k) const
+		{
+			return PlanetTilePathHasher()(k.path) ^ (std::size_t)(k.generator * 0x9e3779b97f4a7c15ULL);
+		}
+	};
+
+	struct Entry
+	{
+		Key key;
+		std::vector<PlanetTile::GeneratorOut> out;
+	};
+
+	std::mutex mtx;
+
+	// Most recent first
+	std::list<Entry> lru;
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHasher> index;
+
+	size_t max_tiles;
+
+	size_t hits, misses;
+
+public:
+
+	// Returns false if the tile is not here, out gets GEN_ARRAY_SIZE elements
+	bool load(uint64_t generator, const PlanetTilePath& path, std::vector<PlanetTile::GeneratorOut>& out);
+	// out must have GEN_ARRAY_SIZE elements
+	void store(uint64_t generator, const PlanetTilePath& path, const std::vector<PlanetTile::GeneratorOut>& out);
+
+	void do_imgui();
+
+	explicit PlanetHeightCache(size_t max_tiles);
+};
+
+extern PlanetHeightCache* planet_height_cache;
+
+void create_global_planet_height_cache();
+void destroy_global_planet_height_cache();
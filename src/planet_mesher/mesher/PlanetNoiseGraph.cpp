@@ -0,0 +1,467 @@
+#include "PlanetNoiseGraph.h"
+#include "PlanetTileCache.h"
+#include <OSP.h>
+#include <util/Logger.h>
+#include <util/SerializeUtil.h>
+#include <algorithm>
+
+// Noise functions work on the unit sphere
+template<typename F>
+static void run_noise(FastNoise* fn, double* dst, size_t count,
+	const PlanetTile::GeneratorInfo* info, F func)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		dst[i] = func(fn, info[i].coord_3d.x, info[i].coord_3d.y, info[i].coord_3d.z);
+	}
+}
+
+void PlanetNoiseGraph::run_op(const Op& op, double* buffers, size_t index, size_t count,
+	const PlanetTile::GeneratorInfo* info) const
+{
+	double* dst = buffers + index * count;
+
+	auto in = [buffers, count, &op](size_t i)
+	{
+		return (const double*)(buffers + op.in[i] * count);
+	};
+
+	if (op.type <= NOISE_CRATER)
+	{
+		// Crater noise writes to the FastNoise, so every run gets its own copy
+		FastNoise fn = *op.fn;
+
+		switch (op.type)
+		{
+		case NOISE_VALUE:
+			run_noise(&fn, dst, count, info, fn_value3);
+			break;
+		case NOISE_VALUE_FRACTAL:
+			run_noise(&fn, dst, count, info, fn_value_fractal3);
+			break;
+		case NOISE_PERLIN:
+			run_noise(&fn, dst, count, info, fn_perlin3);
+			break;
+		case NOISE_PERLIN_FRACTAL:
+			run_noise(&fn, dst, count, info, fn_perlin_fractal3);
+			break;
+		case NOISE_SIMPLEX:
+			run_noise(&fn, dst, count, info, fn_simplex3);
+			break;
+		case NOISE_SIMPLEX_FRACTAL:
+			run_noise(&fn, dst, count, info, fn_simplex_fractal3);
+			break;
+		default:
+			run_noise(&fn, dst, count, info, [](FastNoise* fn, double x, double y, double z)
+			{
+				return fn_crater3(fn, 0, x, y, z);
+			});
+			break;
+		}
+
+		return;
+	}
+
+	switch (op.type)
+	{
+	case IMAGE:
+	{
+		Image* img = images[op.image].get_noconst();
+		for (size_t i = 0; i < count; i++)
+		{
+			// Equirectangular, same as the planet uv
+			double u = (info[i].coord_2d.x + glm::pi<double>()) / glm::two_pi<double>();
+			double v = info[i].coord_2d.y / glm::pi<double>();
+			dst[i] = (double)img->sample_bilinear((float)u, (float)v)[op.channel];
+		}
+	}
+	break;
+	case CONSTANT:
+		std::fill(dst, dst + count, op.a);
+		break;
+	case ADD:
+	case MUL:
+	case MIN:
+	case MAX:
+	{
+		std::copy(in(0), in(0) + count, dst);
+		for (size_t j = 1; j < op.in.size(); j++)
+		{
+			const double* src = in(j);
+			if (op.type == ADD)
+			{
+				for (size_t i = 0; i < count; i++) { dst[i] += src[i]; }
+			}
+			else if (op.type == MUL)
+			{
+				for (size_t i = 0; i < count; i++) { dst[i] *= src[i]; }
+			}
+			else if (op.type == MIN)
+			{
+				for (size_t i = 0; i < count; i++) { dst[i] = glm::min(dst[i], src[i]); }
+			}
+			else
+			{
+				for (size_t i = 0; i < count; i++) { dst[i] = glm::max(dst[i], src[i]); }
+			}
+		}
+	}
+	break;
+	case MIX:
+	{
+		const double* a = in(0);
+		const double* b = in(1);
+		const double* t = in(2);
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = a[i] + (b[i] - a[i]) * t[i];
+		}
+	}
+	break;
+	case SELECT:
+	{
+		const double* a = in(0);
+		const double* b = in(1);
+		const double* c = in(2);
+		// a is threshold, b is falloff
+		double falloff = glm::max(op.b, 1e-12);
+		for (size_t i = 0; i < count; i++)
+		{
+			double t = glm::clamp((c[i] - (op.a - falloff)) / (2.0 * falloff), 0.0, 1.0);
+			t = t * t * (3.0 - 2.0 * t);
+			dst[i] = a[i] + (b[i] - a[i]) * t;
+		}
+	}
+	break;
+	case SCALE_BIAS:
+	{
+		const double* a = in(0);
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = a[i] * op.a + op.b;
+		}
+	}
+	break;
+	case CLAMP:
+	{
+		const double* a = in(0);
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = glm::clamp(a[i], op.a, op.b);
+		}
+	}
+	break;
+	case ABS:
+	{
+		const double* a = in(0);
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = glm::abs(a[i]);
+		}
+	}
+	break;
+	default:
+		break;
+	}
+}
+
+glm::dvec3 PlanetNoiseGraph::get_color(double v) const
+{
+	if (v <= stops.front().at)
+	{
+		return stops.front().color;
+	}
+
+	for (size_t i = 1; i < stops.size(); i++)
+	{
+		if (v < stops[i].at)
+		{
+			double t = (v - stops[i - 1].at) / (stops[i].at - stops[i - 1].at);
+			return glm::mix(stops[i - 1].color, stops[i].color, t);
+		}
+	}
+
+	return stops.back().color;
+}
+
+void PlanetNoiseGraph::generate(const std::vector<PlanetTile::GeneratorInfo>& info,
+	std::vector<PlanetTile::GeneratorOut>& out) const
+{
+	size_t count = info.size();
+	out.resize(count);
+
+	bool needs_color = false;
+	for (size_t i = 0; i < count; i++)
+	{
+		needs_color |= info[i].needs_color;
+	}
+
+	std::vector<double> buffers;
+	buffers.resize(ops.size() * count);
+
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		if (ops[i].for_height || (needs_color && has_color))
+		{
+			run_op(ops[i], buffers.data(), i, count, info.data());
+		}
+	}
+
+	const double* heights = &buffers[height_op * count];
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i].height = heights[i];
+		if (info[i].needs_color)
+		{
+			out[i].color = has_color ? get_color(buffers[color_op * count + i]) : glm::dvec3(1.0);
+		}
+	}
+}
+
+size_t PlanetNoiseGraph::compile_node(const std::string& name,
+	const std::unordered_map<std::string, std::shared_ptr<cpptoml::table>>& nodes,
+	std::unordered_map<std::string, size_t>& compiled, std::vector<std::string>& stack)
+{
+	auto done = compiled.find(name);
+	if (done != compiled.end())
+	{
+		return done->second;
+	}
+
+	logger->check(std::find(stack.begin(), stack.end(), name) == stack.end(),
+		"Noise graph has a cycle through node '{}'", name);
+
+	auto node_it = nodes.find(name);
+	logger->check(node_it != nodes.end(), "Noise graph node '{}' does not exist", name);
+	const cpptoml::table& from = *node_it->second;
+
+	static const std::unordered_map<std::string, OpType> types =
+	{
+		{"value", NOISE_VALUE},
+		{"value_fractal", NOISE_VALUE_FRACTAL},
+		{"perlin", NOISE_PERLIN},
+		{"perlin_fractal", NOISE_PERLIN_FRACTAL},
+		{"simplex", NOISE_SIMPLEX},
+		{"simplex_fractal", NOISE_SIMPLEX_FRACTAL},
+		{"crater", NOISE_CRATER},
+		{"image", IMAGE},
+		{"constant", CONSTANT},
+		{"add", ADD},
+		{"mul", MUL},
+		{"min", MIN},
+		{"max", MAX},
+		{"mix", MIX},
+		{"select", SELECT},
+		{"scale_bias", SCALE_BIAS},
+		{"clamp", CLAMP},
+		{"abs", ABS}
+	};
+
+	std::string type_str;
+	SAFE_TOML_GET(type_str, "type", std::string);
+	auto type_it = types.find(type_str);
+	logger->check(type_it != types.end(), "Noise graph node '{}' has unknown type '{}'", name, type_str);
+
+	Op op;
+	op.type = type_it->second;
+	op.fn = nullptr;
+	op.image = 0;
+	op.channel = 0;
+	op.a = 0.0;
+	op.b = 0.0;
+	op.for_height = false;
+
+	// Inputs are compiled first, so they are always before us
+	std::vector<std::string> inputs;
+	auto single = from.get_as<std::string>("input");
+	if (single)
+	{
+		inputs.push_back(*single);
+	}
+	auto multiple = from.get_array_of<std::string>("inputs");
+	if (multiple)
+	{
+		inputs.insert(inputs.end(), multiple->begin(), multiple->end());
+	}
+
+	size_t needed = 0;
+	if (op.type == MIX || op.type == SELECT)
+	{
+		needed = 3;
+	}
+	else if (op.type == SCALE_BIAS || op.type == CLAMP || op.type == ABS)
+	{
+		needed = 1;
+	}
+	else if (op.type >= ADD && op.type <= MAX)
+	{
+		logger->check(!inputs.empty(), "Noise graph node '{}' needs at least one input", name);
+		needed = inputs.size();
+	}
+	logger->check(inputs.size() == needed, "Noise graph node '{}' needs {} inputs, has {}",
+		name, needed, inputs.size());
+
+	stack.push_back(name);
+	for (const std::string& input : inputs)
+	{
+		op.in.push_back(compile_node(input, nodes, compiled, stack));
+	}
+	stack.pop_back();
+
+	if (op.type <= NOISE_CRATER)
+	{
+		int seed, octaves, crater_layers;
+		double frequency, gain, lacunarity, crater_chance;
+		std::string fractal;
+		SAFE_TOML_GET_OR(seed, "seed", int, 0);
+		SAFE_TOML_GET_OR(frequency, "frequency", double, 1.0);
+		SAFE_TOML_GET_OR(octaves, "octaves", int, 3);
+		SAFE_TOML_GET_OR(gain, "gain", double, 0.5);
+		SAFE_TOML_GET_OR(lacunarity, "lacunarity", double, 2.0);
+		SAFE_TOML_GET_OR(fractal, "fractal", std::string, "fbm");
+		SAFE_TOML_GET_OR(crater_chance, "crater_chance", double, 0.5);
+		SAFE_TOML_GET_OR(crater_layers, "crater_layers", int, 1);
+
+		op.fn = fn_new(seed);
+		fn_set_frequency(op.fn, frequency);
+		fn_set_fractal_octaves(op.fn, octaves);
+		fn_set_fractal_gain(op.fn, gain);
+		fn_set_fractal_lacunarity(op.fn, lacunarity);
+		fn_set_crater_chance(op.fn, crater_chance);
+		fn_set_crater_layers(op.fn, crater_layers);
+
+		if (fractal == "billow")
+		{
+			fn_set_fractal_type(op.fn, FN_Billow);
+		}
+		else if (fractal == "rigid_multi")
+		{
+			fn_set_fractal_type(op.fn, FN_RigidMulti);
+		}
+		else
+		{
+			fn_set_fractal_type(op.fn, FN_FBM);
+		}
+	}
+	else if (op.type == IMAGE)
+	{
+		std::string image_path;
+		SAFE_TOML_GET(image_path, "image", std::string);
+		SAFE_TOML_GET_OR(op.channel, "channel", int, 0);
+		logger->check(op.channel >= 0 && op.channel < 4, "Noise graph node '{}' has invalid channel", name);
+
+		op.image = images.size();
+		images.emplace_back(image_path);
+	}
+	else if (op.type == CONSTANT)
+	{
+		SAFE_TOML_GET(op.a, "value", double);
+	}
+	else if (op.type == SELECT)
+	{
+		SAFE_TOML_GET_OR(op.a, "threshold", double, 0.0);
+		SAFE_TOML_GET_OR(op.b, "falloff", double, 0.0);
+	}
+	else if (op.type == SCALE_BIAS)
+	{
+		SAFE_TOML_GET_OR(op.a, "scale", double, 1.0);
+		SAFE_TOML_GET_OR(op.b, "bias", double, 0.0);
+	}
+	else if (op.type == CLAMP)
+	{
+		SAFE_TOML_GET_OR(op.a, "min", double, 0.0);
+		SAFE_TOML_GET_OR(op.b, "max", double, 1.0);
+	}
+
+	ops.push_back(op);
+	compiled[name] = ops.size() - 1;
+
+	return ops.size() - 1;
+}
+
+PlanetNoiseGraph::PlanetNoiseGraph(const cpptoml::table& from)
+{
+	std::unordered_map<std::string, std::shared_ptr<cpptoml::table>> nodes;
+	auto node_array = from.get_table_array("node");
+	logger->check(node_array.operator bool(), "Noise graph has no nodes");
+	for (auto node : *node_array)
+	{
+		auto name = node->get_as<std::string>("name");
+		logger->check(name.operator bool(), "Noise graph node without a name");
+		logger->check(nodes.find(*name) == nodes.end(), "Noise graph node '{}' is duplicated", *name);
+		nodes[*name] = node;
+	}
+
+	std::unordered_map<std::string, size_t> compiled;
+	std::vector<std::string> stack;
+
+	std::string height_name;
+	SAFE_TOML_GET(height_name, "height", std::string);
+	height_op = compile_node(height_name, nodes, compiled, stack);
+
+	has_color = false;
+	color_op = 0;
+	auto color = from.get_table("color");
+	if (color)
+	{
+		auto input = color->get_as<std::string>("input");
+		logger->check(input.operator bool(), "Noise graph color needs an input");
+		auto stops_array = color->get_array("stops");
+		logger->check(stops_array && !stops_array->nested_array().empty(), "Noise graph color needs stops");
+
+		for (auto stop : stops_array->nested_array())
+		{
+			auto values = stop->get_array_of<double>();
+			logger->check(values && values->size() == 4, "Noise graph color stops must be [at, r, g, b]");
+			stops.push_back(ColorStop{(*values)[0], glm::dvec3((*values)[1], (*values)[2], (*values)[3])});
+		}
+
+		std::sort(stops.begin(), stops.end(), [](const ColorStop& a, const ColorStop& b)
+		{
+			return a.at < b.at;
+		});
+
+		color_op = compile_node(*input, nodes, compiled, stack);
+		has_color = true;
+	}
+
+	// Anything the height depends on is always run
+	std::vector<bool> needed = std::vector<bool>(ops.size(), false);
+	needed[height_op] = true;
+	for (size_t i = ops.size(); i-- > 0;)
+	{
+		if (needed[i])
+		{
+			ops[i].for_height = true;
+			for (size_t in : ops[i].in)
+			{
+				needed[in] = true;
+			}
+		}
+	}
+
+	// Images may change (or be overriden by another package) without the graph changing
+	image_key = PlanetTileCache::hash("images");
+	for (const AssetHandle<Image>& img : images)
+	{
+		std::string path = osp->assets->resolve_path(img.pkg + ":" + img.name);
+		image_key = PlanetTileCache::hash(AssetManager::load_string_raw(path), image_key);
+	}
+}
+
+PlanetNoiseGraph::~PlanetNoiseGraph()
+{
+	for (Op& op : ops)
+	{
+		if (op.fn != nullptr)
+		{
+			fn_delete(op.fn);
+		}
+	}
+}
+
+PlanetNoiseGraph* PlanetNoiseGraph::load(const std::string& path)
+{
+	auto toml = SerializeUtil::load_file(path);
+	return new PlanetNoiseGraph(*toml);
+}
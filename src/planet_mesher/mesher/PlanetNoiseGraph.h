@@ -0,0 +1,139 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <cpptoml.h>
+#include <FastNoiseC/FastNoise.h>
+#include <assets/Image.h>
+#include <assets/AssetManager.h>
+#include "PlanetTile.h"
+
+// A terrain definition made of noise nodes, an alternative to the lua generate function.
+// The toml file is compiled once into a flat list of operations, each one running over
+// the whole array of points (a full tile) before the next one, so blend operations are
+// simple loops the compiler can vectorize, and no script is involved at all.
+// Example:
+//
+//	height = "final"
+//
+//	[[node]]
+//	name = "base"
+//	type = "simplex_fractal"
+//	seed = 4
+//	frequency = 2.0
+//	octaves = 6
+//
+//	[[node]]
+//	name = "final"
+//	type = "scale_bias"
+//	input = "base"
+//	scale = 3000.0
+//
+//	[color]
+//	input = "final"
+//	stops = [ [-100.0, 0.1, 0.2, 0.6], [0.0, 0.8, 0.8, 0.5], [3000.0, 1.0, 1.0, 1.0] ]
+//
+// Node types:
+//	Noise (sampled on the unit sphere): value, value_fractal, perlin, perlin_fractal,
+//	simplex, simplex_fractal, crater
+//		seed, frequency, octaves, gain, lacunarity, fractal ("fbm", "billow", "rigid_multi"),
+//		crater_chance, crater_layers
+//	image: samples an equirectangular image (must be in_memory), image, channel
+//	constant: value
+//	add, mul, min, max: inputs (any number of nodes)
+//	mix: inputs = [a, b, t]
+//	select: inputs = [a, b, control], threshold, falloff
+//	scale_bias: input, scale, bias
+//	clamp: input, min, max
+//	abs: input
+class PlanetNoiseGraph
+{
+private:
+
+	enum OpType
+	{
+		NOISE_VALUE,
+		NOISE_VALUE_FRACTAL,
+		NOISE_PERLIN,
+		NOISE_PERLIN_FRACTAL,
+		NOISE_SIMPLEX,
+		NOISE_SIMPLEX_FRACTAL,
+		NOISE_CRATER,
+		IMAGE,
+		CONSTANT,
+		ADD,
+		MUL,
+		MIN,
+		MAX,
+		MIX,
+		SELECT,
+		SCALE_BIAS,
+		CLAMP,
+		ABS
+	};
+
+	struct Op
+	{
+		OpType type;
+		// Indices of the ops whose output we use, they always go before us
+		std::vector<size_t> in;
+
+		// Only for noise ops
+		FastNoise* fn;
+
+		// Only for image ops
+		size_t image;
+		int channel;
+
+		// Meaning depends on the op (scale and bias, min and max, constant...)
+		double a, b;
+
+		// Ops only used for color are skipped when no point needs it
+		bool for_height;
+	};
+
+	struct ColorStop
+	{
+		double at;
+		glm::dvec3 color;
+	};
+
+	// In evaluation order, op i writes to buffer i
+	std::vector<Op> ops;
+	std::vector<AssetHandle<Image>> images;
+	uint64_t image_key;
+
+	size_t height_op;
+
+	bool has_color;
+	size_t color_op;
+	std::vector<ColorStop> stops;
+
+	size_t compile_node(const std::string& name, const std::unordered_map<std::string, std::shared_ptr<cpptoml::table>>& nodes,
+		std::unordered_map<std::string, size_t>& compiled, std::vector<std::string>& stack);
+
+	void run_op(const Op& op, double* buffers, size_t index, size_t count,
+		const PlanetTile::GeneratorInfo* info) const;
+
+	glm::dvec3 get_color(double v) const;
+
+public:
+
+	// Fills height (in meters) and, if requested, color for every point.
+	// Safe to call from many threads at once
+	void generate(const std::vector<PlanetTile::GeneratorInfo>& info,
+		std::vector<PlanetTile::GeneratorOut>& out) const;
+
+	size_t get_op_count() const { return ops.size(); }
+
+	// Hash of the contents of every image used, see PlanetTileServer::get_generator_key
+	uint64_t get_image_key() const { return image_key; }
+
+	// Throws (through logger->check) if the graph is malformed
+	explicit PlanetNoiseGraph(const cpptoml::table& from);
+	~PlanetNoiseGraph();
+
+	// Loads from a toml file given its resolved path
+	static PlanetNoiseGraph* load(const std::string& path);
+};
@@ -1,147 +1,201 @@
 #include "PlanetTile.h"
+#include "PlanetNoiseGraph.h"
+#include "PlanetTileCache.h"
+#include "PlanetHeightCache.h"
+#include "PlanetTileUploader.h"
 #include <util/Logger.h>
 #include <util/LuaUtil.h>
+#include <limits>
+#include <cmath>
 
-template<int S>
-constexpr std::array<uint16_t, (S + 2) * (S + 2) * 6> get_nrm_indices()
+// Points of the grid (border included) on the sphere, for both the generator and
+// the mesher (if given). Only this step is done in double, the mesher works relative to origin
+static void generate_grid(const glm::dmat4& model, glm::dvec3 origin,
+	std::vector<PlanetTile::GeneratorInfo>& info, PlanetTile::MeshArrays* mesh)
 {
-	std::array<uint16_t, (S + 2) * (S + 2) * 6> out = 
-		std::array<uint16_t, (S + 2) * (S + 2) * 6>();
+	constexpr int S = PlanetTile::TILE_SIZE;
 
-	for (int y = -1; y < S; y++)
+	for (int y = -1; y < S + 1; y++)
 	{
-		for (int x = -1; x < S; x++)
+		for (int x = -1; x < S + 1; x++)
 		{
-			uint16_t vi = (uint16_t)((y + 1) * (S + 2) + (x + 1));
-			size_t i = ((y + 1) * (S + 2) + (x + 1)) * 6;
-
-			// Right
-			out[i + 0] = vi + 1;
-			// Center
-			out[i + 1] = vi;
-			// Bottom
-			out[i + 2] = vi + (S + 2);
+			size_t i = (y + 1) * (S + 2) + (x + 1);
 
+			double tx = (double)x / ((double)S - 1.0);
+			double ty = (double)y / ((double)S - 1.0);
 
+			glm::dvec3 world_pos_cubic = model * glm::dvec4(tx, ty, 0.0, 1.0);
+			glm::dvec3 sphere = MathUtil::cube_to_sphere(world_pos_cubic);
 
-			// Bottom Right
-			out[i + 0 + 3] = vi + 1 + (S + 2);
-			// Right
-			out[i + 1 + 3] = vi + 1;
-			// Bottom
-			out[i + 2 + 3] = vi + (S + 2);
+			info[i].coord_3d = sphere;
+			info[i].coord_2d = MathUtil::euclidean_to_spherical_r1(sphere);
 
+			if (mesh != nullptr)
+			{
+				glm::dvec3 up = glm::normalize(sphere);
+				glm::dvec3 rel = sphere - origin;
+				mesh->sph_x[i] = (float)rel.x; mesh->sph_y[i] = (float)rel.y; mesh->sph_z[i] = (float)rel.z;
+				mesh->up_x[i] = (float)up.x; mesh->up_y[i] = (float)up.y; mesh->up_z[i] = (float)up.z;
+			}
 		}
 	}
+}
 
-	return out;
+static void setup_generator(std::vector<PlanetTile::GeneratorInfo>& info, std::vector<PlanetTile::GeneratorOut>& out,
+	size_t depth, double planet_radius)
+{
+	for (size_t i = 0; i < PlanetTile::GEN_ARRAY_SIZE; i++)
+	{
+		info[i].depth = (int)depth;
+		info[i].radius = planet_radius;
+		info[i].needs_color = true;
+
+		// Safe defaults
+		out[i].height = 1.0;
+		out[i].color = glm::vec3(1.0, 0.0, 1.0);
+	}
 }
 
-// Warning: Some template magic ahead, 
-// T must have a pos and nrm member!
+// Water stays at sea level
+template<bool water>
+static void apply_heights(PlanetTile::MeshArrays& mesh, const double* heights)
+{
+	for (size_t i = 0; i < PlanetTile::GEN_ARRAY_SIZE; i++)
+	{
+		float h = water ? 0.0f : (float)heights[i];
+		mesh.pos_x[i] = mesh.sph_x[i] + mesh.up_x[i] * h;
+		mesh.pos_y[i] = mesh.sph_y[i] + mesh.up_y[i] * h;
+		mesh.pos_z[i] = mesh.sph_z[i] + mesh.up_z[i] * h;
+	}
+}
 
-template<int S, typename T >
-void generate_normals(T* verts, size_t verts_size, glm::dmat4 model_spheric, bool clockwise)
+// Normalized cross(b - a, c - a), same as glm::triangleNormal
+static inline void triangle_normal(float ax, float ay, float az, float bx, float by, float bz,
+	float cx, float cy, float cz, float& nx, float& ny, float& nz)
 {
-	auto nrm_indices = get_nrm_indices<S>();
+	float ux = bx - ax, uy = by - ay, uz = bz - az;
+	float vx = cx - ax, vy = cy - ay, vz = cz - az;
 
-	for (size_t i = 0; i < nrm_indices.size(); i += 3)
-	{
-		T* v0 = &verts[nrm_indices[i + 0]];
-		T* v1 = &verts[nrm_indices[i + 1]];
-		T* v2 = &verts[nrm_indices[i + 2]];
+	nx = uy * vz - uz * vy;
+	ny = uz * vx - ux * vz;
+	nz = ux * vy - uy * vx;
 
-		glm::dvec3 p0 = model_spheric * glm::dvec4(v0->pos, 1.0);
-		glm::dvec3 p1 = model_spheric * glm::dvec4(v1->pos, 1.0);
-		glm::dvec3 p2 = model_spheric * glm::dvec4(v2->pos, 1.0);
+	float inv_len = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+	nx *= inv_len; ny *= inv_len; nz *= inv_len;
+}
 
-		glm::vec3 face_normal;
+// Vertex normals are the sum of the normals of the triangles around, but we only
+// need them for the vertices without the border, which are surrounded by quads
+static void generate_normals(PlanetTile::MeshArrays& mesh, bool clockwise)
+{
+	constexpr int S = PlanetTile::TILE_SIZE;
+	// Grid and quad strides
+	constexpr int G = S + 2;
+	constexpr int Q = S + 1;
 
-		if (clockwise)
-		{
-			face_normal = glm::triangleNormal(p1, p0, p2);
-		}
-		else
+	const float* px = mesh.pos_x.data();
+	const float* py = mesh.pos_y.data();
+	const float* pz = mesh.pos_z.data();
+
+	for (int qy = 0; qy < Q; qy++)
+	{
+		for (int qx = 0; qx < Q; qx++)
 		{
-			face_normal = glm::triangleNormal(p0, p1, p2);
+			int c = qy * G + qx;
+			int r = c + 1;
+			int b = c + G;
+			int br = b + 1;
+			int f = qy * Q + qx;
+
+			// (Right, center, bottom) and (bottom right, right, bottom)
+			triangle_normal(px[r], py[r], pz[r], px[c], py[c], pz[c], px[b], py[b], pz[b],
+				mesh.fa_x[f], mesh.fa_y[f], mesh.fa_z[f]);
+			triangle_normal(px[br], py[br], pz[br], px[r], py[r], pz[r], px[b], py[b], pz[b],
+				mesh.fb_x[f], mesh.fb_y[f], mesh.fb_z[f]);
 		}
-
-		v0->nrm += face_normal;
-		v1->nrm += face_normal;
-		v2->nrm += face_normal;
-
 	}
 
+	// Clockwise sides have their triangles flipped
+	float sign = clockwise ? -1.0f : 1.0f;
 
-	for (size_t i = 0; i < verts_size; i++)
+	for (int y = 1; y < S + 1; y++)
 	{
-		T* v = &verts[i];
-		v->nrm = glm::normalize(v->nrm);
+		for (int x = 1; x < S + 1; x++)
+		{
+			// The vertex is the center of quad (x, y), right of (x - 1, y) and bottom of
+			// (x, y - 1) for the first triangles, and bottom right of (x - 1, y - 1),
+			// right of (x - 1, y) and bottom of (x, y - 1) for the second ones
+			int f = y * Q + x;
+			int fl = f - 1;
+			int fu = f - Q;
+			int ful = fu - 1;
+
+			float nx = mesh.fa_x[f] + mesh.fa_x[fl] + mesh.fa_x[fu] + mesh.fb_x[ful] + mesh.fb_x[fl] + mesh.fb_x[fu];
+			float ny = mesh.fa_y[f] + mesh.fa_y[fl] + mesh.fa_y[fu] + mesh.fb_y[ful] + mesh.fb_y[fl] + mesh.fb_y[fu];
+			float nz = mesh.fa_z[f] + mesh.fa_z[fl] + mesh.fa_z[fu] + mesh.fb_z[ful] + mesh.fb_z[fl] + mesh.fb_z[fu];
+
+			float inv_len = sign / std::sqrt(nx * nx + ny * ny + nz * nz);
+
+			int o = (y - 1) * S + (x - 1);
+			mesh.nrm_x[o] = nx * inv_len;
+			mesh.nrm_y[o] = ny * inv_len;
+			mesh.nrm_z[o] = nz * inv_len;
+		}
 	}
 }
 
-template<int S, typename T, bool water>
-void generate_vertices(T* verts, glm::dmat4 model, glm::dmat4 inverse_model_spheric, double* heights, glm::vec3* colors,
-			   double detail_start_x = 0, double detail_end_x = 1, double detail_start_y = 0, double detail_end_y = 1)
+// Writes the final vertices (dropping the border) in tile space, inverse_model_spheric
+// and origin must be the tile ones
+template<bool water>
+static void write_vertices(const PlanetTile::MeshArrays& mesh, const glm::dmat4& inverse_model_spheric, glm::dvec3 origin,
+	const double* heights, const glm::vec3* colors, const std::vector<PlanetTile::GeneratorInfo>& info, PlanetTileWorkVertex* out)
 {
-	for (int y = -1; y < S + 1; y++)
-	{
-		for (int x = -1; x < S + 1; x++)
-		{
-			size_t r_index = (y + 1) * (S + 2) + (x + 1);
+	constexpr int S = PlanetTile::TILE_SIZE;
 
-			double tx = (double)x / ((double)S - 1.0);
-			double ty = (double)y / ((double)S - 1.0);
+	glm::mat3 to_tile = glm::mat3(glm::dmat3(inverse_model_spheric));
+	glm::vec3 tile_origin = glm::vec3(inverse_model_spheric * glm::dvec4(origin, 1.0));
 
-			T vert;
-			glm::dvec3 in_tile = glm::dvec3(tx, ty, 0.0);
-
-			glm::dvec3 world_pos_cubic = model * glm::vec4(in_tile, 1.0);
-			glm::dvec3 world_pos_spheric = MathUtil::cube_to_sphere(world_pos_cubic);
-			glm::dvec3 world_pos_spheric_nrm = glm::normalize(world_pos_spheric);
+	for (int y = 0; y < S; y++)
+	{
+		for (int x = 0; x < S; x++)
+		{
+			size_t g = (y + 1) * (S + 2) + (x + 1);
+			size_t o = y * S + x;
 
-			double height = heights[r_index];
+			PlanetTileWorkVertex& vert = out[o];
+			vert.pos = to_tile * glm::vec3(mesh.pos_x[g], mesh.pos_y[g], mesh.pos_z[g]) + tile_origin;
+			vert.nrm = glm::vec3(mesh.nrm_x[o], mesh.nrm_y[o], mesh.nrm_z[o]);
 
 			if constexpr (water)
 			{
-				vert.col.x = -(float)height;
+				vert.col = glm::vec3(-(float)heights[g], 0.0f, 0.0f);
+				vert.planet_uv_tex = glm::vec3(0.0f);
 			}
 			else
 			{
-				world_pos_spheric += world_pos_spheric_nrm * height;
-				vert.col = colors[r_index];
+				vert.col = colors[g];
+				// The spherical coordinates (= to the equirrectangular projection in our case!), clipped to 0->1
+				glm::dvec2 sph = info[g].coord_2d;
+				vert.planet_uv_tex.x = (float)((sph.x + glm::half_pi<double>()) / glm::pi<double>());
+				vert.planet_uv_tex.y = (float)(sph.y / glm::pi<double>());
+				vert.planet_uv_tex.z = 0.0f;
 			}
-
-			vert.pos = (glm::vec3)(inverse_model_spheric * glm::dvec4(world_pos_spheric, 1.0));
-			vert.nrm = glm::vec3(0.0f, 0.0f, 0.0f);
-
-			if constexpr (std::is_same<T, PlanetTileVertex>::value)
-			{
-				// We find the points spherical coordinates (= to the equirrectangular projection in our case!)
-				glm::vec2 sph = MathUtil::euclidean_to_spherical_r1(world_pos_spheric_nrm);
-				// Clip to 0->1
-				vert.planet_uv_tex.x = (sph.x + glm::half_pi<float>()) / glm::pi<float>();
-				vert.planet_uv_tex.y = sph.y / glm::pi<float>();
-			}
-
-			verts[r_index] = vert;
 		}
 	}
 }
 
-
 template<typename T>
-void generate_vertices_simple(T* verts, glm::dmat4 model, glm::dmat4 inverse_model_spheric, double* heights)
+void generate_vertices_simple(T* verts, int size, glm::dmat4 model, glm::dmat4 inverse_model_spheric, double* heights)
 {
 	// We need some small tricks to keep the render and physics vertices aligned
-	for (int y = 0; y < PlanetTile::PHYSICS_SIZE; y++)
+	for (int y = 0; y < size; y++)
 	{
-		for (int x = 0; x < PlanetTile::PHYSICS_SIZE; x++)
+		for (int x = 0; x < size; x++)
 		{
-			size_t r_index = y * PlanetTile::PHYSICS_SIZE + x;
+			size_t r_index = y * size + x;
 
-			double tx = (double)x / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
-			double ty = (double)y / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
+			double tx = (double)x / ((double)size - 1.0);
+			double ty = (double)y / ((double)size - 1.0);
 
 			double height = heights[r_index];
 
@@ -160,38 +214,10 @@ void generate_vertices_simple(T* verts, glm::dmat4 model, glm::dmat4 inverse_mod
 	}
 }
 
-template<int S, typename T, typename Q>
-void copy_vertices(T* origin, Q* destination)
+void generate_skirt(PlanetTileWorkVertex* target, glm::dmat4 model, glm::dmat4 inverse_model_spheric,
+	double tile_size, PlanetTileWorkVertex& copy_vert)
 {
-	for (int y = 0; y < S; y++)
-	{
-		for (int x = 0; x < S; x++)
-		{
-			size_t o_index = (y + 1) * (S + 2) + (x + 1);
-			size_t f_index = y * S + x;
-
-			destination[f_index].pos = origin[o_index].pos;
-			destination[f_index].nrm = origin[o_index].nrm;
-			if constexpr (!std::is_same<Q, PlanetTileSimpleVertex>::value)
-			{
-				if constexpr (std::is_same<Q, PlanetTileWaterVertex>::value)
-				{
-					destination[f_index].depth = origin[o_index].col.x;
-				}
-				else
-				{
-					destination[f_index].col = origin[o_index].col;
-					destination[f_index].planet_uv_tex = origin[o_index].planet_uv_tex;
-				}
-			}
-		}
-	}
-}
-
-
-void generate_skirt(PlanetTileVertex* target, glm::dmat4 model, glm::dmat4 inverse_model_spheric, PlanetTileVertex& copy_vert)
-{
-	PlanetTileVertex vert;
+	PlanetTileWorkVertex vert;
 
 	double tx = 0.5;
 	double ty = 0.5;
@@ -201,7 +227,9 @@ void generate_skirt(PlanetTileVertex* target, glm::dmat4 model, glm::dmat4 inver
 	glm::dvec3 world_pos_cubic = model * glm::vec4(in_tile, 1.0);
 	glm::dvec3 world_pos_spheric = MathUtil::cube_to_sphere(world_pos_cubic);
 
-	world_pos_spheric *= 0.99;
+	// Sinking small tiles by a whole 1% of the radius would make their bounds
+	// (and thus the quantization step) huge, so the skirt scales with the tile
+	world_pos_spheric *= 1.0 - glm::min(0.01, tile_size * 0.5);
 
 	vert = copy_vert;
 	vert.pos = (glm::vec3)(inverse_model_spheric * glm::dvec4(world_pos_spheric, 1.0));
@@ -209,22 +237,172 @@ void generate_skirt(PlanetTileVertex* target, glm::dmat4 model, glm::dmat4 inver
 	*target = vert;
 }
 
+// Octahedral normal encoding, decoded in tile.vs and water.vs
+static glm::vec2 encode_normal(glm::vec3 n)
+{
+	n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+	glm::vec2 out = glm::vec2(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+		out = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+	}
+
+	return out;
+}
+
+static int16_t to_snorm16(float v)
+{
+	return (int16_t)glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+static uint16_t to_unorm16(float v)
+{
+	return (uint16_t)glm::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
+static uint8_t to_unorm8(float v)
+{
+	return (uint8_t)glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f);
+}
+
+// Bounds of the given vertices, so that pos = min + unorm16 * scale
+static void get_quantization_bounds(const PlanetTileWorkVertex* verts, size_t count, glm::vec3& min, glm::vec3& scale)
+{
+	min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < count; i++)
+	{
+		min = glm::min(min, verts[i].pos);
+		max = glm::max(max, verts[i].pos);
+	}
+
+	scale = (max - min) / 65535.0f;
+}
+
+template<typename Q>
+void quantize_vertices(const PlanetTileWorkVertex* origin, Q* destination, size_t count, glm::vec3 min, glm::vec3 scale)
+{
+	// Flat axes (scale = 0) are all at min anyway
+	glm::vec3 inv_scale = glm::vec3(
+		scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+		scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+		scale.z > 0.0f ? 1.0f / scale.z : 0.0f);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const PlanetTileWorkVertex& v = origin[i];
+		Q& q = destination[i];
+
+		glm::vec3 pos = glm::round((v.pos - min) * inv_scale);
+		q.pos[0] = (uint16_t)glm::clamp(pos.x, 0.0f, 65535.0f);
+		q.pos[1] = (uint16_t)glm::clamp(pos.y, 0.0f, 65535.0f);
+		q.pos[2] = (uint16_t)glm::clamp(pos.z, 0.0f, 65535.0f);
+		q.pos[3] = 0;
+
+		glm::vec2 nrm = encode_normal(v.nrm);
+		q.nrm[0] = to_snorm16(nrm.x);
+		q.nrm[1] = to_snorm16(nrm.y);
+
+		if constexpr (std::is_same<Q, PlanetTileWaterVertex>::value)
+		{
+			q.depth = v.col.x;
+		}
+		else
+		{
+			q.col[0] = to_unorm8(v.col.r);
+			q.col[1] = to_unorm8(v.col.g);
+			q.col[2] = to_unorm8(v.col.b);
+			q.col[3] = 255;
+			q.planet_uv[0] = to_unorm16(v.planet_uv_tex.x);
+			q.planet_uv[1] = to_unorm16(v.planet_uv_tex.y);
+		}
+	}
+}
+
+static void get_bounding_sphere(const PlanetTileWorkVertex* verts, size_t count, glm::dmat4 model_spheric,
+	glm::dvec3& center, double& radius)
+{
+	glm::dvec3 min = glm::dvec3(std::numeric_limits<double>::max());
+	glm::dvec3 max = glm::dvec3(-std::numeric_limits<double>::max());
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::dvec3 p = model_spheric * glm::dvec4(verts[i].pos, 1.0);
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	center = (min + max) * 0.5;
+	radius = 0.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::dvec3 p = model_spheric * glm::dvec4(verts[i].pos, 1.0);
+		radius = glm::max(radius, glm::distance(p, center));
+	}
+}
+
+// Grows the first sphere so it contains the second one
+static void merge_spheres(glm::dvec3& center, double& radius, glm::dvec3 o_center, double o_radius)
+{
+	double dist = glm::distance(center, o_center);
+	if (dist + o_radius <= radius)
+	{
+		return;
+	}
+
+	if (dist + radius <= o_radius)
+	{
+		center = o_center;
+		radius = o_radius;
+		return;
+	}
+
+	double n_radius = (dist + radius + o_radius) * 0.5;
+	center += (o_center - center) * ((n_radius - radius) / dist);
+	radius = n_radius;
+}
+
 #include <util/Timer.h>
 
-bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state& lua_state, bool has_water,
-	GeneratorArrays* arrays)
+bool PlanetTile::run_generator(sol::state& lua_state, const PlanetNoiseGraph* graph,
+	std::vector<GeneratorInfo>& info, std::vector<GeneratorOut>& out)
 {
-	auto& work_array = arrays->work_array;
+	if (graph != nullptr)
+	{
+		graph->generate(info, out);
+		return false;
+	}
+
+	sol::protected_function func = lua_state["generate"];
+	auto result = func(std::ref(info), std::ref(out));
+
+	if (!result.valid())
+	{
+		sol::error err = result;
+		LuaUtil::lua_error_handler(lua_state.lua_state(), err);
+		return true;
+	}
+
+	return false;
+}
+
+bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state& lua_state, const PlanetNoiseGraph* graph,
+	bool has_water, GeneratorArrays* arrays, PlanetTileCache* cache, uint64_t shared)
+{
+	auto& mesh = arrays->mesh;
+	auto& tile_array = arrays->tile_array;
 	auto& heights = arrays->heights;
 	auto& colors = arrays->colors;
+	auto& gen_info = arrays->gen_info;
+	auto& gen_out = arrays->gen_out;
 
 	bool errors = false;
 
 	clockwise = false;
 
-	if (path.side == PY ||
-		path.side == NY ||
-		path.side == NX)
+	if (path.get_side() == PY ||
+		path.get_side() == NY ||
+		path.get_side() == NX)
 	{
 		clockwise = true;
 	}
@@ -240,52 +418,40 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 	// We only need water if there is a tile over the water level (height = 0)
 	bool needs_water = false;
 
-	std::array<GeneratorInfo, GEN_ARRAY_SIZE> gen_info;
-	std::array<GeneratorOut, GEN_ARRAY_SIZE> gen_out;
+	gen_info.resize(GEN_ARRAY_SIZE);
+	gen_out.resize(GEN_ARRAY_SIZE);
 
 
+	Timer timer;
 
-	// Initialize gen_info
-	for (int x = -1; x < TILE_SIZE + 1; x++)
-	{
-		for (int y = -1; y < TILE_SIZE + 1; y++)
-		{
-
-			double tx = (double)x / ((double)TILE_SIZE - 1.0);
-			double ty = (double)y / ((double)TILE_SIZE - 1.0);
+	// Everything is meshed relative to this
+	glm::dvec3 origin = MathUtil::cube_to_sphere(model * glm::dvec4(0.5, 0.5, 0.0, 1.0));
+	generate_grid(model, origin, gen_info, &mesh);
+	setup_generator(gen_info, gen_out, depth, planet_radius);
 
-			glm::dvec3 in_tile = glm::dvec3(tx, ty, 0.0);
-
-			glm::dvec3 world_pos_cubic = model * glm::dvec4(in_tile, 1.0);
-			glm::dvec3 world_pos_spheric = MathUtil::cube_to_sphere(world_pos_cubic);
+	double mesh_time = timer.restart();
 
-			glm::dvec3 sphere = world_pos_spheric;
-			glm::dvec2 projected = MathUtil::euclidean_to_spherical_r1(sphere);
-
-			size_t i = (y + 1) * (TILE_SIZE + 2) + (x + 1);
-			
-			gen_info[i].coord_3d = sphere;
-			gen_info[i].coord_2d = projected;
-			gen_info[i].depth = (int)depth;
-			gen_info[i].radius = planet_radius;
-			gen_info[i].needs_color = true;
-
-			// Safe defaults
-			gen_out[i].height = 1.0;
-			gen_out[i].color = glm::vec3(1.0, 0.0, 1.0);
-
-		}
+	bool in_pack = cache != nullptr && cache->load(path, gen_out);
+	bool in_shared = !in_pack && shared != 0 && planet_height_cache->load(shared, path, gen_out);
+	bool cached = in_pack || in_shared;
+	if (!cached)
+	{
+		// We only write one error per tile so we don't overload the log
+		errors = run_generator(lua_state, graph, gen_info, gen_out);
 	}
 
-	sol::protected_function func = lua_state["generate"];
-	auto result = func(std::ref(gen_info), std::ref(gen_out));
-
-	if (!result.valid())
+	// Broken output is not kept around, the script may get fixed
+	if (!errors)
 	{
-		sol::error err = result;
-		LuaUtil::lua_error_handler(lua_state.lua_state(), err);
-		// We only write one error per tile so we don't overload the log
-		errors = true;
+		if (cache != nullptr && !in_pack)
+		{
+			cache->store(path, gen_out);
+		}
+
+		if (shared != 0 && !in_shared)
+		{
+			planet_height_cache->store(shared, path, gen_out);
+		}
 	}
 
 	// Post-process
@@ -303,141 +469,273 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 		colors[i] = (glm::vec3)gen_out[i].color;
 	}
 
-	lua_state.collect_garbage();
-
-	// Detail texture adjustements
-	glm::dvec2 min = path.get_min(), max;
-	double detail_size = 1.0f / glm::pow(2.0f, DETAIL_DEPTH);
-	double tile_size = path.get_size();
-	min.x = fmod(min.x, detail_size) / detail_size;
-	min.y = fmod(min.y, detail_size) / detail_size;
-	max.x = min.x + tile_size / detail_size;
-	max.y = min.y + tile_size / detail_size;
-	// We can finally generate the vertices
-	generate_vertices<TILE_SIZE, PlanetTileVertex, false>(work_array.data(), model, inverse_model_spheric,
-	  &heights[0], &colors[0], min.x, max.x, min.y, max.y);
-	generate_normals<TILE_SIZE>(work_array.data(), work_array.size(), model_spheric, clockwise);
-	copy_vertices<TILE_SIZE>(work_array.data(), vertices.data());
-
-	water_vertices = nullptr;
-	water_vbo = 0;
-	if (has_water && needs_water)
+	// Keep the heights around for queries
+	min_height = std::numeric_limits<float>::max();
+	max_height = -std::numeric_limits<float>::max();
+	for (int y = 0; y < TILE_SIZE; y++)
 	{
-		generate_vertices<TILE_SIZE, PlanetTileVertex, true>(work_array.data(), 
-				model, inverse_model_spheric, &heights[0], nullptr);
+		for (int x = 0; x < TILE_SIZE; x++)
+		{
+			float h = (float)heights[(y + 1) * (TILE_SIZE + 2) + (x + 1)];
+			this->heights[y * TILE_SIZE + x] = h;
+			min_height = glm::min(min_height, h);
+			max_height = glm::max(max_height, h);
+		}
+	}
 
-		generate_normals<TILE_SIZE>(work_array.data(), work_array.size(), model_spheric, clockwise);
-		water_vertices = new std::array<PlanetTileWaterVertex, VERTEX_COUNT>();
-		copy_vertices<TILE_SIZE>(work_array.data(), water_vertices->data());
+	if (graph == nullptr && !cached)
+	{
+		lua_state.collect_garbage();
 	}
 
+	arrays->gen_time = timer.restart();
+
+	double tile_size = path.get_size();
+	// We can finally generate the vertices
+	apply_heights<false>(mesh, &heights[0]);
+	generate_normals(mesh, clockwise);
+	write_vertices<false>(mesh, inverse_model_spheric, origin, &heights[0], &colors[0], gen_info, tile_array.data());
+
 	// We generate the up vector easily
 	glm::dvec3 world_pos_cubic = glm::normalize(model * glm::vec4(0.5, 0.5, 0.0, 1.0));
 	glm::dvec3 world_pos_spheric = MathUtil::cube_to_sphere(world_pos_cubic);
 	glm::dvec3 world_pos_center = world_pos_spheric * 0.5;
 	up = glm::normalize(world_pos_spheric);
 
-	std::array<PlanetTileVertex, 4> skirts;
+	std::array<PlanetTileWorkVertex, 4> skirts;
 	// Up
-	generate_skirt(&skirts[0], model, inverse_model_spheric, vertices[0 * TILE_SIZE + 0]);
+	generate_skirt(&skirts[0], model, inverse_model_spheric, tile_size, tile_array[0 * TILE_SIZE + 0]);
 
 	// Down
-	generate_skirt(&skirts[1], model, inverse_model_spheric, vertices[(TILE_SIZE - 1) * TILE_SIZE + 0]);
+	generate_skirt(&skirts[1], model, inverse_model_spheric, tile_size, tile_array[(TILE_SIZE - 1) * TILE_SIZE + 0]);
 
 	// Left
-	generate_skirt(&skirts[2], model, inverse_model_spheric, vertices[0 * TILE_SIZE + 0]);
+	generate_skirt(&skirts[2], model, inverse_model_spheric, tile_size, tile_array[0 * TILE_SIZE + 0]);
 
 	// Right
-	generate_skirt(&skirts[3], model, inverse_model_spheric, vertices[0 * TILE_SIZE + (TILE_SIZE - 1)]);
+	generate_skirt(&skirts[3], model, inverse_model_spheric, tile_size, tile_array[0 * TILE_SIZE + (TILE_SIZE - 1)]);
 
 	// Copy skirts
 	for (size_t i = 0; i < skirts.size(); i++)
 	{
-		vertices[i + TILE_SIZE * TILE_SIZE] = skirts[i];
+		tile_array[i + TILE_SIZE * TILE_SIZE] = skirts[i];
+	}
+
+	get_quantization_bounds(tile_array.data(), tile_array.size(), pos_min, pos_scale);
+	get_bounding_sphere(tile_array.data(), tile_array.size(), model_spheric, bound_center, bound_radius);
+	vertices = new std::array<PlanetTileVertex, VERTEX_COUNT>();
+	quantize_vertices(tile_array.data(), vertices->data(), tile_array.size(), pos_min, pos_scale);
+
+	water_vertices = nullptr;
+	if (has_water && needs_water)
+	{
+		apply_heights<true>(mesh, &heights[0]);
+		generate_normals(mesh, clockwise);
+		write_vertices<true>(mesh, inverse_model_spheric, origin, &heights[0], nullptr, gen_info, tile_array.data());
+
+		// Water has no skirts, only the bulk indices are drawn
+		size_t water_count = TILE_SIZE * TILE_SIZE;
+		get_quantization_bounds(tile_array.data(), water_count, water_pos_min, water_pos_scale);
+
+		glm::dvec3 water_center;
+		double water_radius;
+		get_bounding_sphere(tile_array.data(), water_count, model_spheric, water_center, water_radius);
+		merge_spheres(bound_center, bound_radius, water_center, water_radius);
+		water_vertices = new std::array<PlanetTileWaterVertex, VERTEX_COUNT>();
+		quantize_vertices(tile_array.data(), water_vertices->data(), water_count, water_pos_min, water_pos_scale);
 	}
 
+	arrays->mesh_time = mesh_time + timer.get_elapsed_time();
+
 	return errors;
 
 }
 
 
-bool PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, sol::state& lua_state,
-	SimpleVertexArray<PlanetTile::PHYSICS_SIZE>* work_array)
+bool PlanetTile::generate_physics_heights(PlanetTilePath path, double planet_radius, sol::state& lua_state,
+	const PlanetNoiseGraph* graph, int size, std::vector<GeneratorInfo>& info, std::vector<GeneratorOut>& out,
+	std::vector<double>& heights)
 {
-	bool errors = false;
+	constexpr int S = TILE_SIZE;
+	int stride = (S - 1) / (size - 1);
+	size_t count = (size_t)(size * size);
+
+	info.resize(count);
+	out.resize(count);
 
+	// Same points as the render grid (see generate_grid), without its border
 	glm::dmat4 model = path.get_model_matrix();
-	glm::dmat4 model_spheric = path.get_model_spheric_matrix();
-	glm::dmat4 inverse_model = glm::inverse(model);
-	glm::dmat4 inverse_model_spheric = glm::inverse(model_spheric);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			size_t i = y * size + x;
 
-	constexpr size_t ARR_SIZE = PHYSICS_SIZE * PHYSICS_SIZE;
+			double tx = (double)(x * stride) / ((double)S - 1.0);
+			double ty = (double)(y * stride) / ((double)S - 1.0);
 
-	std::array<double, ARR_SIZE> heights;
+			glm::dvec3 world_pos_cubic = model * glm::dvec4(tx, ty, 0.0, 1.0);
+			glm::dvec3 sphere = MathUtil::cube_to_sphere(world_pos_cubic);
 
-	size_t depth = path.get_depth();
+			info[i].coord_3d = sphere;
+			info[i].coord_2d = MathUtil::euclidean_to_spherical_r1(sphere);
+			info[i].depth = (int)path.get_depth();
+			info[i].radius = planet_radius;
+			info[i].needs_color = false;
 
-	std::array<GeneratorInfo, ARR_SIZE> info;
-	std::array<GeneratorOut, ARR_SIZE> out;
+			out[i].height = 1.0;
+			out[i].color = glm::vec3(1.0, 0.0, 1.0);
+		}
+	}
 
-	sol::protected_function func = lua_state["generate"];
+	bool errors = run_generator(lua_state, graph, info, out);
 
-	 
-	// We need some small tricks to keep the render and physics vertices aligned
-	for (int y = 0; y < PlanetTile::PHYSICS_SIZE; y++)
+	if (graph == nullptr)
+	{
+		lua_state.collect_garbage();
+	}
+
+	heights.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		heights[i] = out[i].height;
+	}
+
+	return errors;
+}
+
+void PlanetTile::get_physics_heights(const std::vector<GeneratorOut>& gen_out, int size, std::vector<double>& heights)
+{
+	constexpr int S = TILE_SIZE;
+	int stride = (S - 1) / (size - 1);
+
+	heights.resize(size * size);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			heights[y * size + x] = gen_out[(y * stride + 1) * (S + 2) + (x * stride + 1)].height;
+		}
+	}
+}
+
+// The size * size grid contained in the fine grid
+static void subsample_heights(const std::vector<double>& fine, int fine_size, int size, std::vector<double>& heights)
+{
+	int stride = (fine_size - 1) / (size - 1);
+
+	heights.resize(size * size);
+	for (int y = 0; y < size; y++)
 	{
-		for (int x = 0; x < PlanetTile::PHYSICS_SIZE; x++)
+		for (int x = 0; x < size; x++)
 		{
-			size_t r_index = y * PlanetTile::PHYSICS_SIZE + x;
+			heights[y * size + x] = fine[(y * stride) * fine_size + x * stride];
+		}
+	}
+}
 
-			double tx = (double)x / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
-			double ty = (double)y / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
+// Maximum difference between the fine grid and the physics mesh built from the coarse
+// grid (which is contained in the fine one), following its triangulation
+static double get_physics_error(const std::vector<double>& coarse, int coarse_size,
+	const std::vector<double>& fine, int fine_size)
+{
+	int step = (fine_size - 1) / (coarse_size - 1);
+	double inv_step = 1.0 / (double)step;
+	double max_error = 0.0;
 
-			glm::dvec3 in_tile = glm::dvec3(tx, ty, 0.0);
+	for (int y = 0; y < fine_size; y++)
+	{
+		for (int x = 0; x < fine_size; x++)
+		{
+			if (x % step == 0 && y % step == 0)
+			{
+				// Shared vertex
+				continue;
+			}
 
-			glm::dvec3 world_pos_cubic = model * glm::dvec4(in_tile, 1.0);
-			glm::dvec3 world_pos_spheric = MathUtil::cube_to_sphere(world_pos_cubic);
+			int cx = glm::min(x / step, coarse_size - 2);
+			int cy = glm::min(y / step, coarse_size - 2);
+			double fx = (double)(x - cx * step) * inv_step;
+			double fy = (double)(y - cy * step) * inv_step;
 
-			glm::dvec3 sphere = world_pos_spheric;
-			glm::dvec2 projected = MathUtil::euclidean_to_spherical_r1(sphere);
+			double h00 = coarse[cy * coarse_size + cx];
+			double h10 = coarse[cy * coarse_size + cx + 1];
+			double h01 = coarse[(cy + 1) * coarse_size + cx];
+			double h11 = coarse[(cy + 1) * coarse_size + cx + 1];
 
+			// Quads are split along the (right, bottom) diagonal, see generate_physics_index_array
+			double interp;
+			if (fx + fy <= 1.0)
+			{
+				interp = h00 + (h10 - h00) * fx + (h01 - h00) * fy;
+			}
+			else
+			{
+				interp = h11 + (h01 - h11) * (1.0 - fx) + (h10 - h11) * (1.0 - fy);
+			}
 
-			info[r_index].coord_3d = sphere;
-			info[r_index].coord_2d = projected;
-			info[r_index].depth = (int)depth;
-			info[r_index].radius = planet_radius;
-			info[r_index].needs_color = false;
-			out[r_index].height = 1.0;
-			out[r_index].color = glm::dvec3(1.0, 0.0, 1.0);
+			max_error = glm::max(max_error, glm::abs(fine[y * fine_size + x] - interp));
 		}
 	}
 
-	auto result = func(std::ref(info), std::ref(out));
+	return max_error;
+}
 
+void PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, const std::vector<double>& max_heights,
+	const PhysicsSettings& settings, std::vector<PlanetTileSimpleVertex>& work_array, int& out_size)
+{
+	glm::dmat4 model = path.get_model_matrix();
+	glm::dmat4 model_spheric = path.get_model_spheric_matrix();
+	glm::dmat4 inverse_model_spheric = glm::inverse(model_spheric);
 
-	if (!result.valid())
+	int max_size = sanitize_physics_size(settings.max_size);
+	int size = settings.max_error > 0.0 ? glm::min(sanitize_physics_size(settings.min_size), max_size) : max_size;
+
+	// Refine while the coarse grid is not good enough, always measured against the
+	// finest grid as errors of the intermediate levels would add up
+	std::vector<double> heights;
+	subsample_heights(max_heights, max_size, size, heights);
+	while (size < max_size && get_physics_error(heights, size, max_heights, max_size) > settings.max_error)
 	{
-		sol::error err = result;
-		logger->error("Lua Runtime Error:\n{}", err.what());
-		// We only write one error per tile so we don't overload the log
-		errors = true;
+		size = (size - 1) * 2 + 1;
+		subsample_heights(max_heights, max_size, size, heights);
 	}
 
-	for(size_t i = 0; i < out.size(); i++)
+	for (size_t i = 0; i < heights.size(); i++)
 	{
-		heights[i] = (out[i].height) / planet_radius;
+		heights[i] = heights[i] / planet_radius;
 	}
 
-	lua_state.collect_garbage();
-	generate_vertices_simple<PlanetTileSimpleVertex>(work_array->data(), model, inverse_model_spheric, heights.data());
+	out_size = size;
+	work_array.resize(size * size);
+	generate_vertices_simple<PlanetTileSimpleVertex>(work_array.data(), size, model, inverse_model_spheric, heights.data());
+}
 
-	return errors;
+int PlanetTile::sanitize_physics_size(int size)
+{
+	int out = PHYSICS_MIN_SIZE;
+	while (out < size && out < PHYSICS_MAX_SIZE)
+	{
+		out = (out - 1) * 2 + 1;
+	}
+
+	return out;
 }
 
 void PlanetTile::prepare_lua(sol::state& lua_state)
 {
-	lua_core->load(lua_state, osp->assets->get_current_package());
+	prepare_lua(lua_state, osp->assets->get_current_package());
+}
 
+void PlanetTile::prepare_lua(sol::state& lua_state, const std::string& pkg)
+{
+	// An empty package would make dofile read the AssetManager's current package
+	logger->check(!pkg.empty(), "Planet scripts need a package");
+
+	lua_core->load(lua_state, pkg);
+	// The asset library caches into the AssetManager, which is not thread safe.
+	// dofile and loadfile only resolve paths against our package, so they are fine
+	lua_core->block_library(lua_state, LuaCore::LibraryID::ASSETS);
 
 	// We must define the little utility struct GeneratorInfo
 	lua_state.new_usertype<GeneratorInfo>("generator_info",
@@ -451,22 +749,69 @@ void PlanetTile::prepare_lua(sol::state& lua_state)
 		"color", &GeneratorOut::color);
 }
 
+double PlanetTile::sample_height(glm::dvec2 in_tile) const
+{
+	glm::dvec2 f = glm::clamp(in_tile, 0.0, 1.0) * (double)(TILE_SIZE - 1);
+	int x0 = glm::min((int)f.x, TILE_SIZE - 2);
+	int y0 = glm::min((int)f.y, TILE_SIZE - 2);
+	double ax = f.x - (double)x0;
+	double ay = f.y - (double)y0;
+
+	double h00 = heights[y0 * TILE_SIZE + x0];
+	double h10 = heights[y0 * TILE_SIZE + x0 + 1];
+	double h01 = heights[(y0 + 1) * TILE_SIZE + x0];
+	double h11 = heights[(y0 + 1) * TILE_SIZE + x0 + 1];
+
+	return glm::mix(glm::mix(h00, h10, ax), glm::mix(h01, h11, ax), ay);
+}
+
 void PlanetTile::upload()
 {
 	logger->check(!is_uploaded(), "Tried to upload an already uploaded tile");
 
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(PlanetTileVertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	slot = planet_tile_arena->allocate();
+	planet_tile_uploader->upload((*vertices).data(), sizeof(PlanetTileVertex) * (*vertices).size(),
+		planet_tile_arena->get_buffer(), planet_tile_arena->get_offset(slot));
 
 	if (water_vertices != nullptr)
 	{
-		glGenBuffers(1, &water_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, water_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(PlanetTileWaterVertex) * (*water_vertices).size(), (*water_vertices).data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		water_slot = planet_water_arena->allocate();
+		planet_tile_uploader->upload((*water_vertices).data(), sizeof(PlanetTileWaterVertex) * (*water_vertices).size(),
+			planet_water_arena->get_buffer(), planet_water_arena->get_offset(water_slot));
 	}
+
+	// Nothing reads the vertices back, heights are kept separately
+	delete vertices;
+	vertices = nullptr;
+	delete water_vertices;
+	water_vertices = nullptr;
+}
+
+size_t PlanetTile::get_upload_size() const
+{
+	size_t size = vertices == nullptr ? 0 : sizeof(PlanetTileVertex) * VERTEX_COUNT;
+	if (water_vertices != nullptr)
+	{
+		size += sizeof(PlanetTileWaterVertex) * VERTEX_COUNT;
+	}
+
+	return size;
+}
+
+size_t PlanetTile::get_memory_size() const
+{
+	size_t size = sizeof(PlanetTile) + get_upload_size();
+	if (is_uploaded())
+	{
+		size += sizeof(PlanetTileVertex) * VERTEX_COUNT;
+	}
+
+	if (has_water())
+	{
+		size += sizeof(PlanetTileWaterVertex) * VERTEX_COUNT;
+	}
+
+	return size;
 }
 
 
@@ -543,35 +888,33 @@ void PlanetTile::generate_index_array_with_skirts(std::array<uint16_t, INDEX_COU
 	}
 }
 
-void PlanetTile::generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX_COUNT>& indices)
+void PlanetTile::generate_physics_index_array(std::vector<uint16_t>& indices, int size)
 {
-	for (size_t i = 0; i < indices.size(); i++)
-	{
-		indices[i] = 65535;
-	}
+	indices.clear();
+	indices.resize(get_physics_index_count(size), 65535);
 
 	// Only Bulk indices
-	for (size_t y = 0; y < PlanetTile::PHYSICS_SIZE - 1; y++)
+	for (int y = 0; y < size - 1; y++)
 	{
-		for (size_t x = 0; x < PlanetTile::PHYSICS_SIZE - 1; x++)
+		for (int x = 0; x < size - 1; x++)
 		{
-			uint16_t vi = (uint16_t)(y * PlanetTile::PHYSICS_SIZE + x);
-			size_t i = (y * (PlanetTile::PHYSICS_SIZE - 1) + x) * 6;
+			uint16_t vi = (uint16_t)(y * size + x);
+			size_t i = (y * (size - 1) + x) * 6;
 
 			// Right
 			indices[i + 0] = vi + 1;
 			// Center
 			indices[i + 1] = vi;
 			// Bottom
-			indices[i + 2] = vi + PlanetTile::PHYSICS_SIZE;
+			indices[i + 2] = vi + size;
 
 
 			// Bottom Right
-			indices[i + 0 + 3] = vi + 1 + PlanetTile::PHYSICS_SIZE;
+			indices[i + 0 + 3] = vi + 1 + size;
 			// Right
 			indices[i + 1 + 3] = vi + 1;
 			// Bottom
-			indices[i + 2 + 3] = vi + PlanetTile::PHYSICS_SIZE;
+			indices[i + 2 + 3] = vi + size;
 
 		}
 	}
@@ -579,29 +922,34 @@ void PlanetTile::generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX
 
 PlanetTile::PlanetTile()
 {
-	vbo = 0;
-	water_vbo = 0;
+	slot = PlanetTileArena::NO_SLOT;
+	water_slot = PlanetTileArena::NO_SLOT;
+	vertices = nullptr;
 	water_vertices = nullptr;
+	pos_min = glm::vec3(0.0f);
+	pos_scale = glm::vec3(0.0f);
+	water_pos_min = glm::vec3(0.0f);
+	water_pos_scale = glm::vec3(0.0f);
+	min_height = 0.0f;
+	max_height = 0.0f;
+	bound_center = glm::dvec3(0.0);
+	bound_radius = 0.0;
 
 }
 
 PlanetTile::~PlanetTile()
 {
+	// Only still around if we were never uploaded
+	delete vertices;
+	delete water_vertices;
 
-	if (water_vertices != nullptr)
-	{
-		delete water_vertices;
-	}
-
-	if (vbo != 0)
+	if (slot != PlanetTileArena::NO_SLOT)
 	{
-		glDeleteBuffers(1, &vbo);
-		vbo = 0;
+		planet_tile_arena->free(slot);
 	}
 
-	if (water_vbo != 0)
+	if (water_slot != PlanetTileArena::NO_SLOT)
 	{
-		glDeleteBuffers(1, &water_vbo);
-		water_vbo = 0;
+		planet_water_arena->free(water_slot);
 	}
 }
@@ -2,6 +2,7 @@
 #include <array>
 #include <glm/glm.hpp>
 #include "PlanetTilePath.h"
+#include "PlanetTileArena.h"
 #include <glad/glad.h>
 #include <glm/gtx/normal.hpp>
 #include <sol/sol.hpp>
@@ -9,9 +10,11 @@
 #include <lua/LuaCore.h>
 #include <assets/AssetManager.h>
 
-// TODO: Tile vertex structure
-// We may not even use colors
-struct PlanetTileVertex
+class PlanetNoiseGraph;
+class PlanetTileCache;
+
+// Full precision vertex, only used while generating
+struct PlanetTileWorkVertex
 {
 	glm::vec3 pos;
 	glm::vec3 nrm;
@@ -20,10 +23,24 @@ struct PlanetTileVertex
 	glm::vec3 planet_uv_tex;
 };
 
+// Uploaded vertex, decoded in tile.vs:
+//	pos: unorm16, relative to the tile bounds (see PlanetTile::pos_min and pos_scale), w unused
+//	nrm: snorm16, octahedral encoded
+//	col: rgba8 (alpha unused)
+//	planet_uv: unorm16
+struct PlanetTileVertex
+{
+	uint16_t pos[4];
+	int16_t nrm[2];
+	uint8_t col[4];
+	uint16_t planet_uv[2];
+};
+
+// Same encoding as PlanetTileVertex, decoded in water.vs
 struct PlanetTileWaterVertex
 {
-	glm::vec3 pos;
-	glm::vec3 nrm;
+	uint16_t pos[4];
+	int16_t nrm[2];
 	float depth;
 };
 
@@ -55,62 +72,154 @@ struct PlanetTile
 
 	bool clockwise;
 
-	GLuint vbo, water_vbo;
+	// Where our vertices are in the global arenas (see PlanetTileArena), NO_SLOT if not uploaded
+	uint32_t slot, water_slot;
 	// The average up vector of the tile, for texturing
 	glm::dvec3 up;
 
-	// Keep below ~128, for OpenGL reasons (index buffer too big)
-	// In debug, 32 is good for performance, but in Release 64 can be used just fine
-	static const int TILE_SIZE = 32;
+	// Keep below ~128, for OpenGL reasons (index buffer too big), and (2^n + 1) so
+	// the physics grids are contained in it (see generate_physics)
+	// In debug, 33 is good for performance, but in Release 65 can be used just fine
+	static const int TILE_SIZE = 33;
 	static const size_t GEN_ARRAY_SIZE = (TILE_SIZE + 2) * (TILE_SIZE + 2);
-	// TODO: Make it possible for this number to be different, the whole tile is overkill
-	static const int PHYSICS_SIZE = TILE_SIZE;
-	static const int PHYSICS_GRAPHICS_RELATION = TILE_SIZE / (PHYSICS_SIZE - 1);
+	// Physics tiles use grids of (2^n + 1) vertices per side, so every coarser
+	// grid is contained in the finer ones. The finest one is the render grid,
+	// coarser ones are chosen per-tile (see PhysicsSettings)
+	static const int PHYSICS_MAX_SIZE = TILE_SIZE;
+	static const int PHYSICS_MIN_SIZE = 3;
+	// Physics tiles are generated at the same depth as the deepest render tiles
+	static const int PHYSICS_GRAPHICS_RELATION = 1;
+	static size_t get_physics_depth(int max_depth) { return (size_t)(max_depth + PHYSICS_GRAPHICS_RELATION - 1); }
 	static const int VERTEX_COUNT = TILE_SIZE * TILE_SIZE + 4;
 	static const int INDEX_COUNT = (TILE_SIZE - 1) * (TILE_SIZE - 1) * 6 + (TILE_SIZE - 1) * 4 * 3;
-	static const int PHYSICS_INDEX_COUNT = (PHYSICS_SIZE - 1) * (PHYSICS_SIZE - 1) * 6;
 	// Depth at which the detail texture tiles
 	// TODO: May need to be adjustable per-planet
 	static const int DETAIL_DEPTH = 10;
 	static const int SHOW_DETAIL_DEPTH = 7;
 
-	template <typename T, size_t S>
-	using VertexArray = std::array<T, (S + 2) * (S + 2)>;
-
-	template<size_t S>
-	using SimpleVertexArray = std::array<PlanetTileSimpleVertex, S * S>;
-
-	std::array<PlanetTileVertex, VERTEX_COUNT> vertices;
+	// Two triangles per quad of the grid with its border, as used for normals
+	static const size_t QUAD_COUNT = (TILE_SIZE + 1) * (TILE_SIZE + 1);
 
+	// Both are freed once uploaded, the GPU has its own copy
+	std::array<PlanetTileVertex, VERTEX_COUNT>* vertices;
 	// This one is optional, so we only allocate it if needed
 	std::array<PlanetTileWaterVertex, VERTEX_COUNT>* water_vertices;
 
+	// Decode the quantized positions: pos = pos_min + unorm * pos_scale
+	glm::vec3 pos_min, pos_scale;
+	glm::vec3 water_pos_min, water_pos_scale;
+
+	// Heights of the vertices (without the border) relative to the planet
+	// radius, used for queries such as raycasts
+	std::array<float, TILE_SIZE * TILE_SIZE> heights;
+	// Bounds of the heights above, also relative to the planet radius
+	float min_height, max_height;
+	// Bounding sphere of everything drawn (skirts and water included), in
+	// planet coordinates (unit radius, not rotated), used for culling
+	glm::dvec3 bound_center;
+	double bound_radius;
+
+	// Bilinear interpolation of heights, in_tile uses the same [0, 1] coordinates
+	// as generation (see PlanetTilePath::get_model_matrix)
+	double sample_height(glm::dvec2 in_tile) const;
+
+	// The mesher works on these as structures of arrays, so its loops vectorize.
+	// Positions are floats relative to the tile origin, only the origin is double
+	struct MeshArrays
+	{
+		// Over the whole grid (border included), in planet space: the points on
+		// the sphere relative to the tile origin, and their up directions
+		std::array<float, GEN_ARRAY_SIZE> sph_x, sph_y, sph_z;
+		std::array<float, GEN_ARRAY_SIZE> up_x, up_y, up_z;
+		// Same as sph, with the heights applied
+		std::array<float, GEN_ARRAY_SIZE> pos_x, pos_y, pos_z;
+		// Normals of the two triangles of each quad
+		std::array<float, QUAD_COUNT> fa_x, fa_y, fa_z;
+		std::array<float, QUAD_COUNT> fb_x, fb_y, fb_z;
+		// Vertex normals, without the border
+		std::array<float, TILE_SIZE * TILE_SIZE> nrm_x, nrm_y, nrm_z;
+	};
+
 	struct GeneratorArrays
 	{
-		VertexArray<PlanetTileVertex, PlanetTile::TILE_SIZE> work_array;
+		MeshArrays mesh;
+		// Final vertices (without the border) before quantization
+		std::array<PlanetTileWorkVertex, VERTEX_COUNT> tile_array;
 		std::array<double, GEN_ARRAY_SIZE> heights;
 		std::array<glm::vec3, GEN_ARRAY_SIZE> colors;
+		std::vector<GeneratorInfo> gen_info;
+		std::vector<GeneratorOut> gen_out;
+
+		// Seconds spent by the last generate running the generator
+		// and meshing, for stats (see PlanetTileWorkerPool)
+		double gen_time;
+		double mesh_time;
+	};
+
+	// Runs the noise graph over all the points if there's one, otherwise the
+	// lua generate function. Returns true if errors happened
+	static bool run_generator(sol::state& lua_state, const PlanetNoiseGraph* graph,
+		std::vector<GeneratorInfo>& info, std::vector<GeneratorOut>& out);
+
+	// Return true if errors happened. If a cache is given, the generator is only
+	// run if the tile is not in it (and then stored). Same for the global
+	// PlanetHeightCache if shared is not 0, it's then our generator key
+	bool generate(PlanetTilePath path, double planet_radius, sol::state& lua_state, const PlanetNoiseGraph* graph,
+		bool has_water, GeneratorArrays* arrays, PlanetTileCache* cache = nullptr, uint64_t shared = 0);
+
+	// Heights (in meters) of the size * size physics grid (see PhysicsSettings), running the
+	// generator only over those points and without colors. Returns true if errors happened
+	static bool generate_physics_heights(PlanetTilePath path, double planet_radius, sol::state& lua_state,
+		const PlanetNoiseGraph* graph, int size, std::vector<GeneratorInfo>& info, std::vector<GeneratorOut>& out,
+		std::vector<double>& heights);
+
+	// Same, but taken from the generator output over the render grid (as generate does),
+	// every physics grid is contained in it (see TILE_SIZE)
+	static void get_physics_heights(const std::vector<GeneratorOut>& gen_out, int size, std::vector<double>& heights);
+
+	struct PhysicsSettings
+	{
+		// Grid sizes, rounded to (2^n + 1) by sanitize_physics_size
+		int min_size;
+		int max_size;
+		// Maximum height difference (in meters) between the chosen grid and the
+		// max_size grid. If <= 0, max_size is always used
+		double max_error;
 	};
 
-	// Return true if errors happened
-	bool generate(PlanetTilePath path, double planet_radius, sol::state& lua_state, bool has_water,
-		GeneratorArrays* arrays);
+	// Simply generates stuff to the output_array, that's it, we can be static
+	// max_heights are the heights of the max_size grid (see get_physics_heights).
+	// Starts from the coarsest grid and refines it while the error bound is not met,
+	// out_size is set to the chosen grid size and work_array holds out_size * out_size vertices
+	static void generate_physics(PlanetTilePath path, double planet_radius, const std::vector<double>& max_heights,
+		const PhysicsSettings& settings, std::vector<PlanetTileSimpleVertex>& work_array, int& out_size);
 
-	// Simply generates stuff to the output_array, that's it, we can be static 
-	static bool generate_physics(PlanetTilePath path, double planet_radius, sol::state& lua_state,
-		SimpleVertexArray<PHYSICS_SIZE>* work_array);
+	// Rounds up to the nearest valid physics grid size
+	static int sanitize_physics_size(int size);
+
+	static size_t get_physics_index_count(int size) { return (size_t)((size - 1) * (size - 1) * 6); }
 
 	static void prepare_lua(sol::state& lua_state);
+	// Same, but for states created away from the main thread, where the
+	// current package may be anything. The "assets" library is blocked in
+	// these, planet scripts may only dofile / loadfile from their package
+	static void prepare_lua(sol::state& lua_state, const std::string& pkg);
 
+	// Through the global PlanetTileUploader, check get_upload_size against its budget first
 	void upload();
 
-	bool is_uploaded() { return vbo != 0; }
+	size_t get_upload_size() const;
+
+	// Roughly what the tile takes, both in RAM and in the GPU
+	size_t get_memory_size() const;
+
+	bool is_uploaded() const { return slot != PlanetTileArena::NO_SLOT; }
 
-	bool has_water() { return water_vbo != 0; }
+	bool has_water() const { return water_slot != PlanetTileArena::NO_SLOT; }
 
 	static void generate_index_array_with_skirts(std::array<uint16_t, INDEX_COUNT>& target, size_t& bulk_index_count);
 
-	static void generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX_COUNT>& target);
+	static void generate_physics_index_array(std::vector<uint16_t>& target, int size);
 
 
 	PlanetTile();
@@ -0,0 +1,88 @@
+#include "PlanetTileArena.h"
+#include "PlanetTile.h"
+#include <imgui/imgui.h>
+
+PlanetTileArena* planet_tile_arena;
+PlanetTileArena* planet_water_arena;
+
+void PlanetTileArena::grow()
+{
+	size_t new_capacity = capacity * 2;
+
+	GLuint new_buffer;
+	glGenBuffers(1, &new_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_capacity * slot_size, nullptr, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * slot_size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &buffer);
+	buffer = new_buffer;
+
+	// Reversed so slots are handed out in order
+	for (size_t i = new_capacity; i > capacity; i--)
+	{
+		free_slots.push_back((uint32_t)(i - 1));
+	}
+
+	capacity = new_capacity;
+}
+
+uint32_t PlanetTileArena::allocate()
+{
+	if (free_slots.empty())
+	{
+		grow();
+	}
+
+	uint32_t slot = free_slots.back();
+	free_slots.pop_back();
+	return slot;
+}
+
+void PlanetTileArena::free(uint32_t slot)
+{
+	free_slots.push_back(slot);
+}
+
+void PlanetTileArena::do_imgui(const char* name)
+{
+	ImGui::Text("%s arena: %i / %i slots (%.2fMB)", name, (int)get_used_slots(), (int)capacity,
+		(float)(capacity * slot_size) / 1000000.0f);
+}
+
+PlanetTileArena::PlanetTileArena(size_t slot_size, size_t initial_capacity)
+{
+	this->slot_size = slot_size;
+	capacity = initial_capacity;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, capacity * slot_size, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	for (size_t i = capacity; i > 0; i--)
+	{
+		free_slots.push_back((uint32_t)(i - 1));
+	}
+}
+
+PlanetTileArena::~PlanetTileArena()
+{
+	glDeleteBuffers(1, &buffer);
+}
+
+void create_global_planet_tile_arenas()
+{
+	planet_tile_arena = new PlanetTileArena(sizeof(PlanetTileVertex) * PlanetTile::VERTEX_COUNT, 1024);
+	planet_water_arena = new PlanetTileArena(sizeof(PlanetTileWaterVertex) * PlanetTile::VERTEX_COUNT, 256);
+}
+
+void destroy_global_planet_tile_arenas()
+{
+	delete planet_tile_arena;
+	delete planet_water_arena;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+// One big GPU buffer split in fixed size slots, every tile takes a slot for
+// its vertices so all tiles can be drawn from a single buffer (see
+// PlanetRenderer). Grows (copying everything to a bigger buffer) when full,
+// so don't keep the buffer name around between frames.
+// Main thread only
+class PlanetTileArena
+{
+private:
+
+	GLuint buffer;
+	size_t slot_size;
+	size_t capacity;
+
+	std::vector<uint32_t> free_slots;
+
+	void grow();
+
+public:
+
+	static const uint32_t NO_SLOT = UINT32_MAX;
+
+	uint32_t allocate();
+	void free(uint32_t slot);
+
+	GLuint get_buffer() const { return buffer; }
+	size_t get_offset(uint32_t slot) const { return (size_t)slot * slot_size; }
+	size_t get_used_slots() const { return capacity - free_slots.size(); }
+	size_t get_capacity() const { return capacity; }
+
+	void do_imgui(const char* name);
+
+	PlanetTileArena(size_t slot_size, size_t initial_capacity);
+	~PlanetTileArena();
+
+	PlanetTileArena(const PlanetTileArena&) = delete;
+	PlanetTileArena& operator=(const PlanetTileArena&) = delete;
+};
+
+// Land and water vertices have different layouts, so they get their own arena
+extern PlanetTileArena* planet_tile_arena;
+extern PlanetTileArena* planet_water_arena;
+
+// Needs the OpenGL context
+void create_global_planet_tile_arenas();
+void destroy_global_planet_tile_arenas();
@@ -0,0 +1,150 @@
+#include "PlanetTileBench.h"
+#include "PlanetTile.h"
+#include "PlanetNoiseGraph.h"
+#include <util/Logger.h>
+#include <util/SerializeUtil.h>
+#include <GLFW/glfw3.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+// Roughly as heavy as the graphs planets use
+static const char* BENCH_GRAPH = R"(
+height = "final"
+
+[[node]]
+name = "base"
+type = "simplex_fractal"
+seed = 4
+frequency = 2.0
+octaves = 6
+
+[[node]]
+name = "detail"
+type = "perlin_fractal"
+seed = 7
+frequency = 40.0
+octaves = 4
+
+[[node]]
+name = "sum"
+type = "add"
+inputs = [ "base", "detail" ]
+
+[[node]]
+name = "final"
+type = "scale_bias"
+input = "sum"
+scale = 3000.0
+
+[color]
+input = "final"
+stops = [ [-100.0, 0.1, 0.2, 0.6], [0.0, 0.8, 0.8, 0.5], [3000.0, 1.0, 1.0, 1.0] ]
+)";
+
+static constexpr double BENCH_RADIUS = 600000.0;
+static constexpr size_t BENCH_DEPTH = 10;
+
+// Spread over every side so all the branches of the mesher run
+static PlanetTilePath get_bench_path(size_t i)
+{
+	uint64_t bits = ((uint64_t)i * 0x9E3779B97F4A7C15ULL) & ((1ULL << (BENCH_DEPTH * 2)) - 1);
+	return PlanetTilePath::from_parts((PlanetSide)(i % 6), BENCH_DEPTH, bits);
+}
+
+static void bench_thread(const PlanetNoiseGraph* graph, size_t first, size_t count, double* mesh_time)
+{
+	PlanetTile::GeneratorArrays* arrays = new PlanetTile::GeneratorArrays();
+	// Never touched as we use a noise graph
+	sol::state unused_state;
+
+	*mesh_time = 0.0;
+	for (size_t i = first; i < first + count; i++)
+	{
+		PlanetTile* tile = new PlanetTile();
+		tile->generate(get_bench_path(i), BENCH_RADIUS, unused_state, graph, true, arrays);
+		*mesh_time += arrays->mesh_time;
+		delete tile;
+	}
+
+	delete arrays;
+}
+
+// Returns the wall time, mesh_time is the sum over all threads
+static double run_threads(const PlanetNoiseGraph* graph, size_t thread_count, size_t tile_count, double& mesh_time)
+{
+	std::vector<std::thread*> threads;
+	std::vector<double> mesh_times = std::vector<double>(thread_count, 0.0);
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads.push_back(new std::thread(bench_thread, graph, i * tile_count, tile_count, &mesh_times[i]));
+	}
+
+	for (std::thread* th : threads)
+	{
+		th->join();
+		delete th;
+	}
+	auto t1 = std::chrono::steady_clock::now();
+
+	mesh_time = 0.0;
+	for (double t : mesh_times)
+	{
+		mesh_time += t;
+	}
+
+	return std::chrono::duration<double>(t1 - t0).count();
+}
+
+int run_mesher_benchmark(size_t tile_count)
+{
+	// Only for the generator and mesher timers (see PlanetTile::GeneratorArrays)
+	bool has_timers = glfwInit() == GLFW_TRUE;
+	if (!has_timers)
+	{
+		logger->warn("Could not init GLFW, mesher times will not be shown");
+	}
+
+	PlanetNoiseGraph* graph = new PlanetNoiseGraph(*SerializeUtil::load_string(BENCH_GRAPH));
+
+	// Warm up the caches and the allocator
+	double mesh_time;
+	run_threads(graph, 1, tile_count / 10 + 1, mesh_time);
+
+	size_t cores = (size_t)std::thread::hardware_concurrency();
+	if (cores == 0)
+	{
+		cores = 1;
+	}
+
+	std::vector<size_t> thread_counts = {1};
+	if (cores > 1)
+	{
+		thread_counts.push_back(cores);
+	}
+
+	logger->info("Benchmarking the tile mesher, {} tiles per thread at depth {}", tile_count, BENCH_DEPTH);
+	for (size_t thread_count : thread_counts)
+	{
+		double wall = run_threads(graph, thread_count, tile_count, mesh_time);
+		double per_core = (double)tile_count / wall;
+
+		logger->info("{} thread(s): {:.0f} tiles/s, {:.0f} tiles/s per core", thread_count,
+			per_core * (double)thread_count, per_core);
+		if (has_timers && mesh_time > 0.0)
+		{
+			logger->info("  Meshing alone: {:.0f} tiles/s per core", (double)(tile_count * thread_count) / mesh_time);
+		}
+	}
+
+	delete graph;
+
+	if (has_timers)
+	{
+		glfwTerminate();
+	}
+
+	return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+
+// Measures how many tiles per second a single core can generate and mesh, run
+// with -bench_mesher=tile_count instead of the game (see Main.cpp). Tiles are
+// generated by a noise graph, so no script or assets are needed. It runs once
+// on a single thread and once on every core, each thread doing tile_count tiles.
+// Returns the exit code
+int run_mesher_benchmark(size_t tile_count);
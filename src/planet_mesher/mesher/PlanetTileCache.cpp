@@ -0,0 +1,185 @@
+#include "PlanetTileCache.h"
+#include <util/Logger.h>
+#include <filesystem>
+#include <cstring>
+#include <unordered_set>
+
+static const char CACHE_MAGIC[8] = { 'O', 'S', 'P', 'T', 'I', 'L', 'E', '2' };
+
+// Packs currently open, appending from two handles would break them
+static std::mutex open_mtx;
+static std::unordered_set<std::string> open_paths;
+
+void PlanetTileCache::open(const std::string& path, uint64_t key)
+{
+	{
+		std::lock_guard<std::mutex> lock(open_mtx);
+		if (!open_paths.insert(path).second)
+		{
+			logger->info("Tile cache {} is already in use, tiles will not be cached", path);
+			return;
+		}
+		file_path = path;
+	}
+
+	std::error_code code;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), code);
+
+	FileHeader expected;
+	memcpy(expected.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	expected.key = key;
+	expected.tile_size = (uint32_t)PlanetTile::TILE_SIZE;
+	expected.record_size = (uint32_t)RECORD_SIZE;
+
+	file = fopen(path.c_str(), "r+b");
+	if (file != nullptr)
+	{
+		FileHeader header;
+		if (fread(&header, sizeof(FileHeader), 1, file) == 1 && memcmp(&header, &expected, sizeof(FileHeader)) == 0)
+		{
+			// Index every complete record, a partial one at the end (we crashed while
+			// writing) gets overwritten by the next store
+			file_size = sizeof(FileHeader);
+			RecordHeader rheader;
+			while (fseek(file, (long)file_size, SEEK_SET) == 0 && fread(&rheader, sizeof(RecordHeader), 1, file) == 1)
+			{
+				if (fseek(file, (long)(file_size + RECORD_SIZE - 1), SEEK_SET) != 0 || fgetc(file) == EOF)
+				{
+					break;
+				}
+
+				index[PlanetTilePath::from_key(rheader.key)] = file_size;
+				file_size += RECORD_SIZE;
+			}
+
+			logger->info("Loaded tile cache {} ({} tiles)", path, index.size());
+			return;
+		}
+
+		// Old or broken, start again
+		fclose(file);
+	}
+
+	file = fopen(path.c_str(), "w+b");
+	if (file == nullptr)
+	{
+		logger->warn("Could not create tile cache {}, tiles will not be cached", path);
+		return;
+	}
+
+	if (fwrite(&expected, sizeof(FileHeader), 1, file) != 1)
+	{
+		logger->warn("Could not write tile cache {}, tiles will not be cached", path);
+		fclose(file);
+		file = nullptr;
+		return;
+	}
+
+	file_size = sizeof(FileHeader);
+}
+
+bool PlanetTileCache::load(const PlanetTilePath& path, std::vector<PlanetTile::GeneratorOut>& out)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	auto it = index.find(path);
+	if (it == index.end())
+	{
+		return false;
+	}
+
+	if (fseek(file, (long)(it->second + sizeof(RecordHeader)), SEEK_SET) != 0 ||
+		fread(buffer.data(), sizeof(float), RECORD_FLOATS, file) != RECORD_FLOATS)
+	{
+		index.erase(it);
+		return false;
+	}
+
+	for (size_t i = 0; i < PlanetTile::GEN_ARRAY_SIZE; i++)
+	{
+		out[i].height = (double)buffer[i * 4 + 0];
+		out[i].color = glm::dvec3(buffer[i * 4 + 1], buffer[i * 4 + 2], buffer[i * 4 + 3]);
+	}
+
+	return true;
+}
+
+void PlanetTileCache::store(const PlanetTilePath& path, const std::vector<PlanetTile::GeneratorOut>& out)
+{
+	RecordHeader header;
+	header.key = path.key;
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (file == nullptr || file_size + RECORD_SIZE > MAX_FILE_SIZE || index.find(path) != index.end())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < PlanetTile::GEN_ARRAY_SIZE; i++)
+	{
+		buffer[i * 4 + 0] = (float)out[i].height;
+		buffer[i * 4 + 1] = (float)out[i].color.r;
+		buffer[i * 4 + 2] = (float)out[i].color.g;
+		buffer[i * 4 + 3] = (float)out[i].color.b;
+	}
+
+	if (fseek(file, (long)file_size, SEEK_SET) != 0 ||
+		fwrite(&header, sizeof(RecordHeader), 1, file) != 1 ||
+		fwrite(buffer.data(), sizeof(float), RECORD_FLOATS, file) != RECORD_FLOATS)
+	{
+		logger->warn("Could not write to the tile cache, tiles will not be cached anymore");
+		fclose(file);
+		file = nullptr;
+		return;
+	}
+
+	index[path] = file_size;
+	file_size += RECORD_SIZE;
+}
+
+size_t PlanetTileCache::get_tile_count()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return index.size();
+}
+
+uint64_t PlanetTileCache::hash(const std::string& data, uint64_t seed)
+{
+	uint64_t h = seed;
+	for (char c : data)
+	{
+		h ^= (uint64_t)(uint8_t)c;
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+PlanetTileCache::PlanetTileCache(const std::string& path, uint64_t key)
+{
+	file = nullptr;
+	file_size = 0;
+	buffer.resize(RECORD_FLOATS);
+
+	open(path, key);
+}
+
+PlanetTileCache::~PlanetTileCache()
+{
+	if (file != nullptr)
+	{
+		fclose(file);
+	}
+
+	if (!file_path.empty())
+	{
+		std::lock_guard<std::mutex> lock(open_mtx);
+		open_paths.erase(file_path);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "PlanetTilePath.h"
+#include "PlanetTile.h"
+
+// Persistent storage of generator output (heights and colors) so tiles visited
+// before, even on a previous launch, don't run the script / noise graph again.
+// Each planet gets a pack file in udata/cache/tiles/ named after the hash of
+// everything that affects generation (script, graph, radius, tile size), so
+// editing the script simply makes a new pack.
+// The pack is a small header followed by fixed size records, new tiles are
+// appended and an index of the records is built when opening.
+// Safe to use from many threads
+class PlanetTileCache
+{
+private:
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint64_t key;
+		uint32_t tile_size;
+		uint32_t record_size;
+	};
+
+	struct RecordHeader
+	{
+		// PlanetTilePath::key
+		uint64_t key;
+	};
+
+	static constexpr size_t RECORD_FLOATS = PlanetTile::GEN_ARRAY_SIZE * 4;
+	static constexpr size_t RECORD_SIZE = sizeof(RecordHeader) + RECORD_FLOATS * sizeof(float);
+	// The pack stops growing past this
+	static constexpr size_t MAX_FILE_SIZE = 512 * 1024 * 1024;
+
+	std::mutex mtx;
+	std::string file_path;
+	FILE* file;
+	size_t file_size;
+
+	// Offset of each record
+	std::unordered_map<PlanetTilePath, size_t, PlanetTilePathHasher> index;
+
+	std::vector<float> buffer;
+
+	void open(const std::string& path, uint64_t key);
+
+public:
+
+	// Returns false if the tile is not cached, out must have GEN_ARRAY_SIZE elements
+	bool load(const PlanetTilePath& path, std::vector<PlanetTile::GeneratorOut>& out);
+	void store(const PlanetTilePath& path, const std::vector<PlanetTile::GeneratorOut>& out);
+
+	size_t get_tile_count();
+
+	// FNV-1a, used to build the key
+	static uint64_t hash(const std::string& data, uint64_t seed = 14695981039346656037ULL);
+
+	// Creates the file (and folders) if needed, if it can't be opened the cache
+	// silently does nothing. The same pack can't be open twice (bodies with the same
+	// script and radius), the second one simply doesn't cache
+	PlanetTileCache(const std::string& path, uint64_t key);
+	~PlanetTileCache();
+};
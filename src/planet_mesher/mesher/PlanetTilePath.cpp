@@ -6,100 +6,80 @@ double sizeAtPathDepth(size_t depth)
 }
 
 
-size_t PlanetTilePath::get_depth() const
+PlanetTilePath::PlanetTilePath(const std::vector<QuadTreeQuadrant>& path, PlanetSide side)
 {
-	return path.size();
+	size_t depth = glm::min(path.size(), MAX_DEPTH);
+	uint64_t quads = 0;
+	for (size_t i = 0; i < depth; i++)
+	{
+		quads = (quads << 2) | (uint64_t)path[i];
+	}
+
+	key = ((uint64_t)side << 61) | ((uint64_t)depth << 56) | quads;
 }
 
-glm::dvec2 PlanetTilePath::get_min() const
+glm::ivec2 PlanetTilePath::get_grid_pos() const
 {
-	glm::dvec2 out = glm::dvec2(0.0, 0.0);
-
-	for (size_t i = 0; i < path.size(); i++)
-	{
-		double size = sizeAtPathDepth(i + 1);
-
-		if (path[i] == NORTH_WEST)
-		{
-			// Nothing
-		}
-		else if (path[i] == NORTH_EAST)
-		{
-			out.x += size;
-		}
-		else if (path[i] == SOUTH_WEST)
-		{
-			out.y += size;
-		}
-		else
-		{
-			out.x += size;
-			out.y += size;
-		}
+	// De-interleave the morton code
+	uint64_t quads = get_quadrant_bits();
+	glm::ivec2 out = glm::ivec2(0, 0);
+	for (size_t i = 0; i < get_depth(); i++)
+	{
+		out.x |= (int)((quads >> (i * 2)) & 1) << i;
+		out.y |= (int)((quads >> (i * 2 + 1)) & 1) << i;
 	}
 
 	return out;
 }
 
-
-
-double PlanetTilePath::get_size() const
-{
-	return sizeAtPathDepth(path.size());
-}
-
-bool arePathsEqual(const std::vector<QuadTreeQuadrant>& a, const std::vector<QuadTreeQuadrant>& b)
+std::vector<QuadTreeQuadrant> PlanetTilePath::get_quadrants() const
 {
-	if (a.size() == b.size())
+	std::vector<QuadTreeQuadrant> out;
+	out.resize(get_depth());
+	for (size_t i = 0; i < out.size(); i++)
 	{
-		for (size_t i = 0; i < a.size(); i++)
-		{
-			if (a[i] != b[i])
-			{
-				return false;
-			}
-		}
-
-		return true;
-	}
-	else
-	{
-		return false;
+		out[i] = get_quadrant(i);
 	}
+
+	return out;
 }
 
-bool operator==(const PlanetTilePath& a, const PlanetTilePath& b)
+glm::dvec2 PlanetTilePath::get_min() const
 {
-	return a.side == b.side && arePathsEqual(a.path, b.path);
+	return glm::dvec2(get_grid_pos()) * get_size();
 }
 
+double PlanetTilePath::get_size() const
+{
+	return sizeAtPathDepth(get_depth());
+}
 
 glm::dvec3 PlanetTilePath::get_tile_rotation() const
 {
 	// Tiles look by default into the positive Z so...
 	double rot = glm::radians(90.0);
 
-	if (side == PX)
+	if (get_side() == PX)
 	{
 		return glm::dvec3(0.0, rot, 0.0);
 	}
-	else if (side == NX)
+	else if (get_side() == NX)
 	{
 		return glm::dvec3(0.0, -rot, 0.0);
 	}
-	else if (side == PY)
+	else if (get_side() == PY)
 	{
 		return glm::dvec3(rot, 0.0, 0.0);
 	}
-	else if (side == NY)
+	else if (get_side() == NY)
 	{
 		return glm::dvec3(-rot, 0.0, 0.0);
 	}
-	else if (side == PZ)
+	else if (get_side() == PZ)
 	{
 		return glm::dvec3(0.0, 0.0, 0.0);
 	}
-	else if (side == NZ)
+	else if (get_side() == NZ)
 	{
 		return glm::dvec3(0.0, rot * 2.0, 0.0);
 	}
@@ -111,27 +91,27 @@ glm::dvec3 PlanetTilePath::get_tile_postrotation() const
 {
 	double r_90 = glm::radians(90.0);
 
-	if (side == PX)
+	if (get_side() == PX)
 	{
 		return glm::dvec3(0.0, 0.0, 0.0);
 	}
-	else if (side == NX)
+	else if (get_side() == NX)
 	{
 		return glm::dvec3(0.0, r_90 * 2.0, 0.0);
 	}
-	else if (side == PY)
+	else if (get_side() == PY)
 	{
 		return glm::dvec3(r_90 * 2.0, -r_90, 0.0);
 	}
-	else if (side == NY)
+	else if (get_side() == NY)
 	{
 		return glm::dvec3(r_90 * 2.0, -r_90, 0.0);
 	}
-	else if (side == PZ)
+	else if (get_side() == PZ)
 	{
 		return glm::dvec3(0.0, 0.0, 0.0);
 	}
-	else if (side == NZ)
+	else if (get_side() == NZ)
 	{
 		return glm::dvec3(0.0, 0.0, 0.0);
 	}
@@ -151,27 +131,27 @@ glm::dvec3 PlanetTilePath::get_tile_translation(bool get_spheric) const
 
 	glm::dvec3 cubic;
 
-	if (side == PX)
+	if (get_side() == PX)
 	{
 		cubic = glm::dvec3(1.0f, -deviation.y, -deviation.x);
 	}
-	else if (side == NX)
+	else if (get_side() == NX)
 	{
 		cubic = glm::dvec3(1.0f, deviation.y, deviation.x);
 	}
-	else if (side == PY)
+	else if (get_side() == PY)
 	{
 		cubic = glm::dvec3(deviation.x, 1.0f, deviation.y);
 	}
-	else if (side == NY)
+	else if (get_side() == NY)
 	{
 		cubic = glm::dvec3(deviation.x, 1.0f, deviation.y);
 	}
-	else if (side == PZ)
+	else if (get_side() == PZ)
 	{
 		cubic = glm::dvec3(deviation.x, -deviation.y, 1.0f);
 	}
-	else if (side == NZ)
+	else if (get_side() == NZ)
 	{
 		cubic = glm::dvec3(-deviation.x, -deviation.y, -1.0f);
 	}
@@ -190,27 +170,27 @@ glm::dvec3 PlanetTilePath::get_tile_scale() const
 {
 	double scale = get_size() * 2.0;
 
-	if (side == PX)
+	if (get_side() == PX)
 	{
 		return glm::dvec3(scale, -scale, scale);
 	}
-	else if (side == NX)
+	else if (get_side() == NX)
 	{
 		return glm::dvec3(scale, scale, scale);
 	}
-	else if (side == PY)
+	else if (get_side() == PY)
 	{
 		return glm::dvec3(scale, scale, scale);
 	}
-	else if (side == NY)
+	else if (get_side() == NY)
 	{
 		return glm::dvec3(scale, -scale, scale);
 	}
-	else if (side == PZ)
+	else if (get_side() == PZ)
 	{
 		return glm::dvec3(scale, -scale, scale);
 	}
-	else if (side == NZ)
+	else if (get_side() == NZ)
 	{
 		return glm::dvec3(scale, -scale, scale);
 	}
@@ -220,15 +200,15 @@ glm::dvec3 PlanetTilePath::get_tile_scale() const
 
 glm::dvec3 PlanetTilePath::get_tile_postscale() const
 {
-	if (side == PY)
+	if (get_side() == PY)
 	{
 		return glm::dvec3(1.0f, -1.0f, 1.0f);
 	}
-	else if (side == NY)
+	else if (get_side() == NY)
 	{
 		return glm::dvec3(1.0f, 1.0f, -1.0f);
 	}
-	else if (side == NX)
+	else if (get_side() == NX)
 	{
 		return glm::dvec3(1.0f, 1.0f, -1.0f);
 	}
@@ -278,7 +258,7 @@ glm::dmat4 PlanetTilePath::get_scaled_matrix() const
 
 	double scale = get_size() * 2.0;
 
-	if(side == NX || side == PY)
+	if(get_side() == NX || get_side() == PY)
 	{
 		out = glm::scale(glm::dmat4(1.0), glm::dvec3(0.0, 0.0, -1.0) * scale);
 	}
@@ -1,18 +1,59 @@
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include "../quadtree/QuadTreeDefines.h"
 #include <util/defines.h>
 #include <util/MathUtil.h>
+#include <util/Logger.h>
 
+// A tile is identified by its side and the quadrants followed from the root of
+// the side, all packed in 64 bits so hashing, comparing and copying are trivial:
+//	bits 63-61: side, bits 60-56: depth, bits 55-0: quadrants (2 bits each,
+//	the deepest one in the lowest bits)
+// As quadrants are (y * 2 + x), the quadrant bits are the morton code of the
+// tile in the grid of its depth.
 struct PlanetTilePath
 {
-	std::vector<QuadTreeQuadrant> path;
-	PlanetSide side;
+	static const size_t MAX_DEPTH = 28;
+
+	uint64_t key;
+
+	PlanetSide get_side() const { return (PlanetSide)(key >> 61); }
+	size_t get_depth() const { return (size_t)((key >> 56) & 31); }
+	uint64_t get_quadrant_bits() const { return key & ((1ULL << 56) - 1); }
+
+	// i = 0 is the quadrant just below the root
+	QuadTreeQuadrant get_quadrant(size_t i) const
+	{
+		return (QuadTreeQuadrant)((key >> ((get_depth() - 1 - i) * 2)) & 3);
+	}
+
+	// The root's parent is itself
+	PlanetTilePath get_parent() const
+	{
+		size_t depth = get_depth();
+		if (depth == 0)
+		{
+			return *this;
+		}
+		return from_parts(get_side(), depth - 1, get_quadrant_bits() >> 2);
+	}
+
+	// Depth must be below MAX_DEPTH, deeper tiles don't fit in the key
+	PlanetTilePath get_child(QuadTreeQuadrant quad) const
+	{
+		logger->check(get_depth() < MAX_DEPTH, "Tile depth over PlanetTilePath::MAX_DEPTH");
+		return from_parts(get_side(), get_depth() + 1, (get_quadrant_bits() << 2) | (uint64_t)quad);
+	}
+
+	// Position of the tile in the (2^depth)^2 grid of its side
+	glm::ivec2 get_grid_pos() const;
+
+	std::vector<QuadTreeQuadrant> get_quadrants() const;
 
-	size_t get_depth() const;
 	glm::dvec2 get_min() const;
 	double get_size() const;
 
@@ -31,29 +72,52 @@ struct PlanetTilePath
 	// Gets the aproximated up vector of the tile
 	glm::dvec3 get_tile_up() const;
 
+	static PlanetTilePath from_parts(PlanetSide side, size_t depth, uint64_t quadrant_bits)
+	{
+		PlanetTilePath out = PlanetTilePath(side);
+		out.key = ((uint64_t)side << 61) | ((uint64_t)depth << 56) | quadrant_bits;
+		return out;
+	}
 
+	static PlanetTilePath from_key(uint64_t key)
+	{
+		PlanetTilePath out = PlanetTilePath(PX);
+		out.key = key;
+		return out;
+	}
 
-	PlanetTilePath(std::vector<QuadTreeQuadrant> path, PlanetSide side)
+	// Root of the side
+	explicit PlanetTilePath(PlanetSide side)
 	{
-		this->path = path;
-		this->side = side;
+		key = (uint64_t)side << 61;
 	}
+
+	// Paths deeper than MAX_DEPTH are cut
+	PlanetTilePath(const std::vector<QuadTreeQuadrant>& path, PlanetSide side);
 };
 
-bool operator==(const PlanetTilePath& a, const PlanetTilePath& b);
+inline bool operator==(const PlanetTilePath& a, const PlanetTilePath& b)
+{
+	return a.key == b.key;
+}
+
+inline bool operator!=(const PlanetTilePath& a, const PlanetTilePath& b)
+{
+	return a.key != b.key;
+}
 
 struct PlanetTilePathHasher
 {
 	std::size_t operator()(const PlanetTilePath &t) const
 	{
-		std::size_t ret = 0;
-		hash_combine(ret, t.side);
-		for (size_t i = 0; i < t.path.size(); i++)
-		{
-			hash_combine(ret, t.path[i]);
-		}
-
-		return ret;
+		// Mixes the bits, as std::hash is often the identity
+		uint64_t h = t.key;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return (std::size_t)h;
 	}
 };
 
@@ -0,0 +1,201 @@
+#include "PlanetTileRaycaster.h"
+
+double PlanetTileRaycaster::get_height(PlanetTileSampler& sampler, glm::dvec3 dir) const
+{
+	double height = 0.0;
+	sampler.get_height(dir, height);
+	return height;
+}
+
+glm::dvec3 PlanetTileRaycaster::get_normal(PlanetTileSampler& sampler, glm::dvec3 dir, double cell) const
+{
+	glm::dvec3 other = glm::abs(dir.y) < 0.9 ? glm::dvec3(0.0, 1.0, 0.0) : glm::dvec3(1.0, 0.0, 0.0);
+	glm::dvec3 e1 = glm::normalize(glm::cross(dir, other));
+	glm::dvec3 e2 = glm::cross(dir, e1);
+
+	// Central differences, one vertex spacing apart
+	double eps = cell / radius;
+	glm::dvec3 d[4] = { dir + e1 * eps, dir - e1 * eps, dir + e2 * eps, dir - e2 * eps };
+	glm::dvec3 p[4];
+	for (size_t i = 0; i < 4; i++)
+	{
+		d[i] = glm::normalize(d[i]);
+		p[i] = d[i] * (radius + get_height(sampler, d[i]));
+	}
+
+	glm::dvec3 nrm = glm::normalize(glm::cross(p[0] - p[1], p[2] - p[3]));
+	if (glm::dot(nrm, dir) < 0.0)
+	{
+		nrm = -nrm;
+	}
+
+	return nrm;
+}
+
+void PlanetTileRaycaster::cast(PlanetTileSampler& sampler, const Ray& ray, Hit& hit) const
+{
+	hit.hit = false;
+	hit.t = ray.length;
+	hit.pos = ray.origin + ray.dir * ray.length;
+	hit.nrm = glm::dvec3(0.0);
+	hit.depth = -1;
+
+	// Nothing can be hit outside of the max_height sphere
+	double top = radius + max_height + ray.radius;
+	double b = glm::dot(ray.origin, ray.dir);
+	double c = glm::dot(ray.origin, ray.origin) - top * top;
+	double disc = b * b - c;
+	if (disc < 0.0)
+	{
+		return;
+	}
+
+	double sq = glm::sqrt(disc);
+	double t_end = glm::min(-b + sq, ray.length);
+	double t = glm::max(-b - sq, 0.0);
+
+	double prev_t = t;
+	bool first = true;
+	// Vertex spacing of the last tile, used as the step size near the surface
+	double cell = 1.0;
+
+	for (int step = 0; step < MAX_STEPS && t <= t_end; step++)
+	{
+		glm::dvec3 p = ray.origin + ray.dir * t;
+		double r = glm::length(p);
+		glm::dvec3 dir = p / r;
+
+		double next;
+		double alt;
+
+		if (sampler.find_tile(dir))
+		{
+			double arc = radius * glm::half_pi<double>() * sampler.get_size();
+			cell = arc / (double)(PlanetTile::TILE_SIZE - 1);
+
+			// Over the tile bounds we can skip ahead, but never further than
+			// half a tile, as neighbor tiles may be higher
+			double clearance = r - radius * (1.0 + sampler.get_tile()->max_height) - ray.radius;
+			if (clearance > 0.0)
+			{
+				prev_t = t;
+				first = false;
+				t += glm::clamp(clearance, cell * 0.5, arc * 0.5);
+				continue;
+			}
+
+			alt = r - (radius + sampler.sample(dir)) - ray.radius;
+			next = glm::clamp(alt, cell * 0.25, cell);
+		}
+		else
+		{
+			// Sea-level sphere, distance to it is a safe step
+			alt = r - radius - ray.radius;
+			next = glm::max(alt, 1.0);
+		}
+
+		if (alt <= 0.0)
+		{
+			if (!first)
+			{
+				// Bisect between the last point over the terrain and this one
+				double t0 = prev_t, t1 = t;
+				for (int i = 0; i < BISECTION_STEPS; i++)
+				{
+					double tm = (t0 + t1) * 0.5;
+					glm::dvec3 pm = ray.origin + ray.dir * tm;
+					double rm = glm::length(pm);
+					double altm = rm - (radius + get_height(sampler, pm / rm)) - ray.radius;
+					if (altm > 0.0)
+					{
+						t0 = tm;
+					}
+					else
+					{
+						t1 = tm;
+					}
+				}
+				t = t1;
+			}
+
+			hit.hit = true;
+			hit.t = t;
+			hit.pos = ray.origin + ray.dir * t;
+			glm::dvec3 hit_dir = glm::normalize(hit.pos);
+			if (sampler.find_tile(hit_dir))
+			{
+				hit.depth = (int)sampler.get_path().get_depth();
+				hit.nrm = get_normal(sampler, hit_dir, cell);
+			}
+			else
+			{
+				hit.nrm = hit_dir;
+			}
+			return;
+		}
+
+		prev_t = t;
+		first = false;
+		t += next;
+	}
+}
+
+void PlanetTileRaycaster::raycast(const std::vector<Ray>& rays, std::vector<Hit>& hits) const
+{
+	hits.resize(rays.size());
+
+	auto tiles_w = server->tiles.get();
+	PlanetTileSampler sampler = PlanetTileSampler(*tiles_w, radius);
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		cast(sampler, rays[i], hits[i]);
+	}
+}
+
+PlanetTileRaycaster::Hit PlanetTileRaycaster::raycast(const Ray& ray) const
+{
+	Hit hit;
+
+	auto tiles_w = server->tiles.get();
+	PlanetTileSampler sampler = PlanetTileSampler(*tiles_w, radius);
+	cast(sampler, ray, hit);
+
+	return hit;
+}
+
+void PlanetTileRaycaster::raycast_sphere(const Ray& ray, double sphere_radius, Hit& hit)
+{
+	hit.hit = false;
+	hit.t = ray.length;
+	hit.pos = ray.origin + ray.dir * ray.length;
+	hit.nrm = glm::dvec3(0.0);
+	hit.depth = -1;
+
+	double rad = sphere_radius + ray.radius;
+	double b = glm::dot(ray.origin, ray.dir);
+	double c = glm::dot(ray.origin, ray.origin) - rad * rad;
+	double disc = b * b - c;
+	if (disc < 0.0)
+	{
+		return;
+	}
+
+	// Starting inside the sphere counts as an instant hit
+	double t = c < 0.0 ? 0.0 : -b - glm::sqrt(disc);
+	if (t < 0.0 || t > ray.length)
+	{
+		return;
+	}
+
+	hit.hit = true;
+	hit.t = t;
+	hit.pos = ray.origin + ray.dir * t;
+	hit.nrm = glm::normalize(hit.pos);
+}
+
+PlanetTileRaycaster::PlanetTileRaycaster(PlanetTileServer* server)
+{
+	this->server = server;
+	radius = server->config->radius;
+	max_height = server->config->surface.max_height;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "PlanetTileServer.h"
+
+// Fast ray and sphere sweep queries against the tiles loaded on a PlanetTileServer,
+// without going through bullet (which would generate physics tiles and a quadtree).
+// Loaded tiles act as a coarse bounding volume hierarchy: every tile knows the bounds
+// of its heights, so rays skip quickly over terrain they are above and only step through
+// the heightfield (bilinearly sampled) once they get near it.
+// Coordinates are relative to the planet center, not rotated, and in meters.
+// Precision depends on the currently loaded tiles. If no tile is loaded, the
+// sea-level sphere is used instead.
+class PlanetTileRaycaster
+{
+public:
+
+	struct Ray
+	{
+		glm::dvec3 origin;
+		// Must be normalized
+		glm::dvec3 dir;
+		double length;
+		// If over 0, a sphere of this radius is swept instead of a ray
+		// (approximated by raising the terrain by radius)
+		double radius;
+
+		Ray() : origin(0.0), dir(0.0, 1.0, 0.0), length(0.0), radius(0.0) {}
+		Ray(glm::dvec3 origin, glm::dvec3 dir, double length, double radius = 0.0)
+			: origin(origin), dir(dir), length(length), radius(radius) {}
+	};
+
+	struct Hit
+	{
+		bool hit;
+		// Distance along the ray, length if there was no hit
+		double t;
+		// For sweeps, this is the position of the center of the sphere
+		glm::dvec3 pos;
+		glm::dvec3 nrm;
+		// Depth of the tile the hit happened in, -1 if the sea-level sphere was used
+		int depth;
+	};
+
+	static constexpr int MAX_STEPS = 4096;
+	static constexpr int BISECTION_STEPS = 16;
+
+private:
+
+	PlanetTileServer* server;
+	double radius;
+	double max_height;
+
+	// Height (in meters) in the given direction, 0 if no tile is loaded
+	double get_height(PlanetTileSampler& sampler, glm::dvec3 dir) const;
+
+	glm::dvec3 get_normal(PlanetTileSampler& sampler, glm::dvec3 dir, double cell) const;
+
+	void cast(PlanetTileSampler& sampler, const Ray& ray, Hit& hit) const;
+
+public:
+
+	// Tiles are locked once per batch, so prefer this over many single raycasts
+	void raycast(const std::vector<Ray>& rays, std::vector<Hit>& hits) const;
+	Hit raycast(const Ray& ray) const;
+
+	// Ray against a sphere of given radius, used when no tiles are available
+	static void raycast_sphere(const Ray& ray, double sphere_radius, Hit& hit);
+
+	explicit PlanetTileRaycaster(PlanetTileServer* server);
+};
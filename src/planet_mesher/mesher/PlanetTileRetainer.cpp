@@ -0,0 +1,91 @@
+#include "PlanetTileRetainer.h"
+#include <imgui/imgui.h>
+
+PlanetTileRetainer* planet_tile_retainer;
+
+void PlanetTileRetainer::evict()
+{
+	while (used > budget && !lru.empty())
+	{
+		Entry& entry = lru.back();
+		used -= entry.bytes;
+		index.erase(entry.key);
+		delete entry.tile;
+		lru.pop_back();
+		evicted++;
+	}
+}
+
+void PlanetTileRetainer::retain(uint64_t server, const PlanetTilePath& path, PlanetTile* tile)
+{
+	Key key = Key{server, path};
+	if (index.find(key) != index.end())
+	{
+		// Another server with the same generator already gave us this one
+		delete tile;
+		return;
+	}
+
+	size_t bytes = tile->get_memory_size();
+	lru.push_front(Entry{key, tile, bytes});
+	index[key] = lru.begin();
+	used += bytes;
+
+	evict();
+}
+
+PlanetTile* PlanetTileRetainer::revive(uint64_t server, const PlanetTilePath& path)
+{
+	auto it = index.find(Key{server, path});
+	if (it == index.end())
+	{
+		return nullptr;
+	}
+
+	PlanetTile* tile = it->second->tile;
+	used -= it->second->bytes;
+	lru.erase(it->second);
+	index.erase(it);
+	revived++;
+
+	return tile;
+}
+
+void PlanetTileRetainer::set_budget(size_t bytes)
+{
+	budget = bytes;
+	evict();
+}
+
+void PlanetTileRetainer::do_imgui()
+{
+	ImGui::Text("Retained tiles: %i (%.2fMB of %.2fMB), %i revived, %i evicted", (int)lru.size(),
+		(float)used / 1000000.0f, (float)budget / 1000000.0f, (int)revived, (int)evicted);
+}
+
+PlanetTileRetainer::PlanetTileRetainer(size_t budget)
+{
+	this->budget = budget;
+	used = 0;
+	revived = 0;
+	evicted = 0;
+}
+
+PlanetTileRetainer::~PlanetTileRetainer()
+{
+	for (Entry& entry : lru)
+	{
+		delete entry.tile;
+	}
+}
+
+void create_global_planet_tile_retainer()
+{
+	// A few thousand tiles
+	planet_tile_retainer = new PlanetTileRetainer(128 * 1024 * 1024);
+}
+
+void destroy_global_planet_tile_retainer()
+{
+	delete planet_tile_retainer;
+}
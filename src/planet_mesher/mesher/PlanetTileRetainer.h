@@ -0,0 +1,73 @@
+#pragma once
+#include <list>
+#include <cstdint>
+#include <unordered_map>
+#include "PlanetTilePath.h"
+#include "PlanetTile.h"
+
+// Tiles no longer wanted by their server (or whose server was destroyed) are
+// kept here instead of being deleted, so a tile that comes back soon (LOD going
+// back and forth near a boundary, a body unloaded and loaded again) is revived
+// instead of generated again. Once over budget the least recently retained
+// tiles are deleted.
+// Tiles are identified by the server's tile key (see PlanetTileServer::tile_key),
+// so servers with identical generators share them.
+// Main thread only, as deleting a tile frees its GPU buffers
+class PlanetTileRetainer
+{
+private:
+
+	struct Key
+	{
+		uint64_t server;
+		PlanetTilePath path;
+
+		bool operator==(const Key& other) const { return server == other.server && path == other.path; }
+	};
+
+	struct KeyHasher
+	{
+		std::size_t operator()(const Key& k) const
+		{
+			return PlanetTilePathHasher()(k.path) ^ (std::size_t)(k.server * 0x9e3779b97f4a7c15ULL);
+		}
+	};
+
+	struct Entry
+	{
+		Key key;
+		PlanetTile* tile;
+		size_t bytes;
+	};
+
+	// Most recent first
+	std::list<Entry> lru;
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHasher> index;
+
+	size_t budget;
+	size_t used;
+
+	size_t revived, evicted;
+
+	void evict();
+
+public:
+
+	// Takes ownership of the tile
+	void retain(uint64_t server, const PlanetTilePath& path, PlanetTile* tile);
+	// Gives back ownership of a retained tile, or returns nullptr
+	PlanetTile* revive(uint64_t server, const PlanetTilePath& path);
+
+	// In bytes, including GPU memory (see PlanetTile::get_memory_size)
+	void set_budget(size_t bytes);
+
+	void do_imgui();
+
+	explicit PlanetTileRetainer(size_t budget);
+	~PlanetTileRetainer();
+};
+
+extern PlanetTileRetainer* planet_tile_retainer;
+
+void create_global_planet_tile_retainer();
+void destroy_global_planet_tile_retainer();
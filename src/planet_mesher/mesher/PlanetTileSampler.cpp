@@ -0,0 +1,97 @@
+#include "PlanetTileSampler.h"
+#include "../quadtree/QuadTreePlanet.h"
+
+bool PlanetTileSampler::find_tile(glm::dvec3 dir)
+{
+	PlanetSide side = QuadTreePlanet::get_planet_side((glm::vec3)dir);
+	glm::dvec2 offset = QuadTreePlanet::get_planet_side_offset((glm::vec3)dir, side);
+
+	PlanetTilePath n_path = PlanetTilePath(side);
+	PlanetTile* n_tile = nullptr;
+	glm::dvec2 n_min = glm::dvec2(0.0, 0.0);
+	double n_size = 1.0;
+
+	bool in_current = tile != nullptr && path.get_side() == side &&
+		offset.x >= min.x && offset.x < min.x + size &&
+		offset.y >= min.y && offset.y < min.y + size;
+
+	if (in_current)
+	{
+		// We only need to look for deeper tiles
+		n_path = path;
+		n_tile = tile;
+		n_min = min;
+		n_size = size;
+	}
+	else
+	{
+		auto it = tiles.find(n_path);
+		if (it == tiles.end())
+		{
+			return false;
+		}
+		n_tile = it->second;
+	}
+
+	size_t start_depth = n_path.get_depth();
+
+	while (n_path.get_depth() < PlanetTilePath::MAX_DEPTH)
+	{
+		double half = n_size * 0.5;
+		int qx = offset.x >= n_min.x + half ? 1 : 0;
+		int qy = offset.y >= n_min.y + half ? 1 : 0;
+
+		// NORTH_WEST, NORTH_EAST, SOUTH_WEST, SOUTH_EAST
+		auto it = tiles.find(n_path.get_child((QuadTreeQuadrant)(qy * 2 + qx)));
+		if (it == tiles.end())
+		{
+			break;
+		}
+
+		n_path = it->first;
+
+		n_tile = it->second;
+		n_min += glm::dvec2((double)qx, (double)qy) * half;
+		n_size = half;
+	}
+
+	if (!in_current || n_path.get_depth() != start_depth)
+	{
+		path = n_path;
+		tile = n_tile;
+		min = n_min;
+		size = n_size;
+		inverse_model = glm::inverse(path.get_model_matrix());
+	}
+
+	return true;
+}
+
+double PlanetTileSampler::sample(glm::dvec3 dir) const
+{
+	// Exact inverse of the generation mapping (in_tile -> cubic -> spheric)
+	glm::dvec3 cubic = MathUtil::sphere_to_cube(dir);
+	glm::dvec2 in_tile = glm::dvec2(inverse_model * glm::dvec4(cubic, 1.0));
+
+	return tile->sample_height(in_tile) * radius;
+}
+
+bool PlanetTileSampler::get_height(glm::dvec3 dir, double& height)
+{
+	if (find_tile(dir))
+	{
+		height = sample(dir);
+		return true;
+	}
+
+	return false;
+}
+
+PlanetTileSampler::PlanetTileSampler(const TileMap& tiles, double radius)
+	: tiles(tiles), path(PX)
+{
+	this->radius = radius;
+	tile = nullptr;
+	min = glm::dvec2(0.0, 0.0);
+	size = 1.0;
+}
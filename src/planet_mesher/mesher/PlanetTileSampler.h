@@ -0,0 +1,47 @@
+#pragma once
+#include <unordered_map>
+#include "PlanetTile.h"
+
+// Samples the heights of already generated tiles, always from the deepest
+// tile loaded at a given point. Used by height queries and raycasts so they
+// never need to run the planet script.
+// The tile map must stay locked for the whole lifetime of the sampler,
+// as it keeps pointers to tiles around.
+class PlanetTileSampler
+{
+public:
+
+	using TileMap = std::unordered_map<PlanetTilePath, PlanetTile*, PlanetTilePathHasher>;
+
+private:
+
+	const TileMap& tiles;
+	double radius;
+
+	// Consecutive samples usually land on the same tile, so we keep it around
+	PlanetTilePath path;
+	PlanetTile* tile;
+	glm::dmat4 inverse_model;
+	glm::dvec2 min;
+	double size;
+
+public:
+
+	// Finds the deepest loaded tile containing dir (normalized), and makes it
+	// the current tile. Returns false if no tile is loaded there
+	bool find_tile(glm::dvec3 dir);
+
+	// Height (in meters) of the current tile in the given direction
+	double sample(glm::dvec3 dir) const;
+
+	// Finds the tile and samples it, returns false (and doesn't touch height) if
+	// no tile is loaded there
+	bool get_height(glm::dvec3 dir, double& height);
+
+	PlanetTile* get_tile() const { return tile; }
+	const PlanetTilePath& get_path() const { return path; }
+	// Size of the current tile in side coordinates (1 = whole cube side)
+	double get_size() const { return size; }
+
+	PlanetTileSampler(const TileMap& tiles, double radius);
+};
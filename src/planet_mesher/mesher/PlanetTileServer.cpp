@@ -1,97 +1,188 @@
 #include "PlanetTileServer.h"
+#include "PlanetTileWorkerPool.h"
+#include "PlanetTileUploader.h"
+#include "PlanetTileRetainer.h"
+#include "PlanetHeightCache.h"
 #include <imgui/imgui.h>
+#include <OSP.h>
 #include "../../util/Logger.h"
+#include <algorithm>
+
+void PlanetTileServer::merge_finished(TileMap& tiles_w)
+{
+	finished_buffer.clear();
+	finished.get()->swap(finished_buffer);
+
+	for (const std::pair<PlanetTilePath, PlanetTile*>& pair : finished_buffer)
+	{
+		if (tiles_w.find(pair.first) == tiles_w.end())
+		{
+			tiles_w[pair.first] = pair.second;
+		}
+		else
+		{
+			delete pair.second;
+		}
+	}
+}
 
 void PlanetTileServer::update(QuadTreePlanet& planet)
 {
-	if (dirty)
+	// Set again by any tile finishing from now on
+	if (dirty.exchange(false))
 	{
-		planet.iteration++;
-		auto tiles_w = tiles.get();
+		pending_uploads.clear();
+		{
+			auto tiles_w = tiles.get();
+			merge_finished(*tiles_w);
+
+			for (auto it = tiles_w->begin(); it != tiles_w->end(); it++)
+			{
+				if (!it->second->is_uploaded())
+				{
+					pending_uploads.push_back(PendingUpload{get_priority(it->first), it->first, it->second});
+				}
+			}
+		}
+
+		// Most urgent first, the rest waits for the next frames. Tiles are only
+		// deleted from this thread, so we don't need the lock while uploading
+		std::sort(pending_uploads.begin(), pending_uploads.end(),
+			[](const PendingUpload& a, const PendingUpload& b)
+		{
+			return a.priority > b.priority;
+		});
 
-		for (auto it = tiles_w->begin(); it != tiles_w->end(); it++)
+		size_t upload_count = 0;
+		for (; upload_count < pending_uploads.size(); upload_count++)
 		{
-			if (!it->second->is_uploaded())
+			const PendingUpload& pending = pending_uploads[upload_count];
+			if (!planet_tile_uploader->has_budget(pending.tile->get_upload_size()))
 			{
-				it->second->upload();
+				planet_tile_uploader->defer(pending_uploads.size() - upload_count);
+				dirty = true;
+				break;
 			}
+
+			pending.tile->upload();
+			uploaded[pending.path] = pending.tile;
 		}
 
-		dirty = false;
+		if (upload_count != 0)
+		{
+			planet.iteration++;
+		}
 	}
 
-	if (!planet.dirty)
+	added.clear();
+	removed.clear();
+	if (!synced)
 	{
-		return;
+		// We may be new for an old planet, start with the whole tree
+		planet.take_changes(added, removed);
+		added.clear();
+		removed.clear();
+		planet.get_all_paths(added);
+		synced = true;
+	}
+	else
+	{
+		planet.take_changes(added, removed);
 	}
 
-	std::vector<PlanetTilePath> paths = planet.get_all_paths();
+	if (added.empty() && removed.empty() && work_list.get_unsafe()->size() == 0)
+	{
+		return;
+	}
 
-	std::vector<PlanetTilePath> new_paths;
+	new_paths.clear();
 	{
-		// We obtain the lock on tiles during this block
+		// We obtain the lock on tiles during this block, and the work list too
+		// so no tile can finish in between (it'd be neither loaded nor in flight)
 		auto tiles_w = tiles.get();
+		auto work_list_w = work_list.get();
+		merge_finished(*tiles_w);
 
-		// Find new paths to generate
-		for (size_t i = 0; i < paths.size(); i++)
+		// Unload removed paths, they may come back soon so they are kept around
+		for (const PlanetTilePath& path : removed)
 		{
-			if (tiles_w->find(paths[i]) == tiles_w->end())
+			auto it = tiles_w->find(path);
+			if (it != tiles_w->end() && it->first.get_depth() > depth_for_unload)
 			{
-				new_paths.push_back(paths[i]);
+				uploaded.erase(path);
+				planet_tile_retainer->retain(tile_key, it->first, it->second);
+				tiles_w->erase(it);
 			}
 		}
 
-		// Find unused paths to unload, and unload them
-		for (auto it = tiles_w->begin(); it != tiles_w->end();)
+		for (const PlanetTilePath& path : added)
 		{
-			bool found = false;
-			for(size_t i = 0; i < paths.size(); i++)
-			{ 
-				if (paths[i] == it->first)
-				{
-					found = true;
-					break;
-				}
+			if (tiles_w->find(path) != tiles_w->end())
+			{
+				continue;
 			}
 
-			if (!found)
+			PlanetTile* tile = planet_tile_retainer->revive(tile_key, path);
+			if (tile != nullptr)
 			{
-				if (it->first.get_depth() > depth_for_unload)
+				(*tiles_w)[path] = tile;
+				if (tile->is_uploaded())
 				{
-					delete it->second;
-					it = tiles_w->erase(it);
+					uploaded[path] = tile;
 				}
 				else
 				{
-					it++;
+					dirty = true;
 				}
 			}
 			else
 			{
-				it++;
+				new_paths.push_back(path);
 			}
 		}
-		
 
+		// Anything that's not wanted anymore is cancelled, paths already being
+		// generated are not queued again
+		work_list_w->remove(removed);
+		work_list_w->get_queued(queued_paths);
 	}
 
+	// Priorities (the camera may have moved since they were queued) are computed and
+	// sorted without any lock, so finishing workers never wait for it. Workers only pop
+	// meanwhile, which set_queue takes into account
+	entries.clear();
+	for (const PlanetTilePath& path : queued_paths)
 	{
-		auto work_list_w = work_list.get();
-
-		work_list_w->clear();
+		entries.push_back(PlanetTileWorkQueue::Entry{path, get_priority(path)});
+	}
+	for (const PlanetTilePath& path : new_paths)
+	{
+		entries.push_back(PlanetTileWorkQueue::Entry{path, get_priority(path)});
+	}
+	PlanetTileWorkQueue::sort_entries(entries);
 
-		for (size_t i = 0; i < new_paths.size(); i++)
-		{
-			work_list_w->insert(new_paths[i]);
-		}
+	work_list.get()->set_queue(entries);
 
-		if (work_list_w->size() != 0)
-		{
-			condition_var.notify_all();
-		}
-		
+	// Outside of our locks, as the pool locks them after its own
+	if (!new_paths.empty())
+	{
+		planet_tile_pool->notify();
 	}
+}
 
+double PlanetTileServer::get_priority(const PlanetTilePath& path) const
+{
+	double size = config->radius * glm::half_pi<double>() * path.get_size();
+	double spacing = size / (double)(PlanetTile::TILE_SIZE - 1);
+
+	glm::dvec3 center_cubic = path.get_model_matrix() * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+	glm::dvec3 center = glm::normalize(MathUtil::cube_to_sphere(center_cubic)) * config->radius;
+
+	// Distance to (roughly) the closest point of the tile, tiles below the camera
+	// get a very small distance and thus go first
+	double dist = glm::max(glm::distance(center, camera_pos) - size * 0.75, spacing);
+
+	return spacing / dist;
 }
 
 void PlanetTileServer::set_depth_for_unload(int depth)
@@ -101,91 +192,149 @@ void PlanetTileServer::set_depth_for_unload(int depth)
 
 
 
-double PlanetTileServer::get_height(glm::dvec3 pos_3d, size_t depth)
+void PlanetTileServer::get_heights(const std::vector<glm::dvec3>& pos_3d, std::vector<double>& out, size_t depth)
 {
-	pos_3d = glm::normalize(pos_3d);
-	glm::dvec2 projected = MathUtil::euclidean_to_spherical_r1(pos_3d);
-
+	out.resize(pos_3d.size());
 
-	default_lua(lua_state);
+	std::vector<size_t> misses;
+	{
+		auto tiles_w = tiles.get();
+		PlanetTileSampler sampler = PlanetTileSampler(*tiles_w, config->radius);
 
-	PlanetTile::GeneratorInfo info;
-	info.depth = (int)depth;
-	info.coord_3d = pos_3d;
-	info.coord_2d = projected;
-	info.radius = config->radius;
+		for (size_t i = 0; i < pos_3d.size(); i++)
+		{
+			if (!sampler.get_height(glm::normalize(pos_3d[i]), out[i]))
+			{
+				misses.push_back(i);
+			}
+		}
+	}
 
-	PlanetTile::GeneratorOut out;
+	if (misses.empty())
+	{
+		return;
+	}
 
-	sol::protected_function func = lua_state["generate"];
-	auto result = func(info, &out);
+	std::vector<PlanetTile::GeneratorInfo> info;
+	std::vector<PlanetTile::GeneratorOut> gen_out;
+	info.resize(misses.size());
+	gen_out.resize(misses.size());
 
-	// We ignore errors here
-	if (result.valid())
+	for (size_t i = 0; i < misses.size(); i++)
 	{
-		return out.height;
+		glm::dvec3 pos_nrm = glm::normalize(pos_3d[misses[i]]);
+
+		info[i].depth = (int)depth;
+		info[i].coord_3d = pos_nrm;
+		info[i].coord_2d = MathUtil::euclidean_to_spherical_r1(pos_nrm);
+		info[i].radius = config->radius;
+		info[i].needs_color = false;
+		gen_out[i].height = 0.0;
 	}
-	else
+
 	{
-		return 0.0;
+		std::lock_guard<std::mutex> lock(lua_mtx);
+		default_lua(lua_state);
+
+		// Errors are only logged, we just return sea level
+		bool errors = PlanetTile::run_generator(lua_state, graph, info, gen_out);
+		for (size_t i = 0; i < misses.size(); i++)
+		{
+			out[misses[i]] = errors ? 0.0 : gen_out[i].height;
+		}
 	}
 }
 
+double PlanetTileServer::get_height(glm::dvec3 pos_3d, size_t depth)
+{
+	std::vector<glm::dvec3> pos = { pos_3d };
+	std::vector<double> out;
+	get_heights(pos, out, depth);
+
+	return out[0];
+}
+
 PlanetTileServer::PlanetTileServer(const std::string& script, const std::string& script_path,
-								   ElementConfig* config, bool has_water, size_t thread_count)
+								   ElementConfig* config, bool has_water, const std::string& pkg, PlanetNoiseGraph* graph)
 {
 	this->has_water = has_water;
 
 	this->config = config;
+	this->script = script;
+	this->script_path = script_path;
+	script_pkg = pkg;
 	has_errors = false;
-	threads_run = true;
+	dirty = false;
+	synced = false;
 	depth_for_unload = 0;
+	camera_pos = glm::dvec3(0.0, 0.0, 0.0);
 
 	bool wrote_error = false;
 
-	PlanetTile::prepare_lua(lua_state);
-	LuaUtil::safe_lua(lua_state, script, wrote_error, script_path);
+	this->graph = graph;
 
-	threads.resize(thread_count);
-
-	for (size_t i = 0; i < threads.size(); i++)
 	{
-
-		threads[i].thread = new std::thread(thread_func, this, &threads[i]);
-		PlanetTile::prepare_lua(threads[i].lua_state);
-		
-		LuaUtil::safe_lua(threads[i].lua_state, script, wrote_error, script_path);
-
-		if (wrote_error)
+		// We may be away from the main thread, like the workers, so the script
+		// can't use the assets library here either
+		std::lock_guard<std::mutex> lock(planet_tile_pool->get_create_mutex());
+		PlanetTile::prepare_lua(lua_state, pkg);
+		// The script is still loaded if present, but only used without a graph
+		if (!script.empty())
 		{
-			has_errors = true;
+			LuaUtil::safe_lua(lua_state, script, wrote_error, script_path);
 		}
 	}
-}
 
+	if (wrote_error)
+	{
+		has_errors = true;
+	}
 
-PlanetTileServer::~PlanetTileServer()
-{
-	threads_run = false;
+	generator_key = get_generator_key(script, *config, graph);
+	cache = new PlanetTileCache(fmt::format("{}cache/tiles/{:016x}.pack", osp->assets->udata_path, generator_key),
+		generator_key);
+	// Water vertices are not in the cache but they are in the tiles
+	tile_key = PlanetTileCache::hash(has_water ? "water" : "", generator_key);
 
+	planet_tile_pool->add_server(this);
+}
 
-	for (size_t i = 0; i < threads.size(); i++)
-	{
-		// We must work hard to get those threads to wake up!
-		condition_var.notify_all();
 
-		threads[i].thread->join();
-		delete threads[i].thread;
-	}
+PlanetTileServer::~PlanetTileServer()
+{
+	// Waits for any tile being generated for us
+	planet_tile_pool->remove_server(this);
 
-	// Tiles are now only managed by us so this is actually safe
+	// Tiles are now only managed by us so this is actually safe. They are kept
+	// around in case the body is loaded again soon
+	merge_finished(*tiles.get_unsafe());
 	for (auto it = tiles.get_unsafe()->begin(); it != tiles.get_unsafe()->end(); it++)
 	{
-		delete it->second;
+		planet_tile_retainer->retain(tile_key, it->first, it->second);
 	}
 
+	delete graph;
+	delete cache;
 
+}
 
+uint64_t PlanetTileServer::get_generator_key(const std::string& script, const ElementConfig& config,
+	const PlanetNoiseGraph* graph)
+{
+	// Anything that changes the generator output must go in the key
+	uint64_t key = PlanetTileCache::hash(script);
+	if (!config.surface.graph_path.empty())
+	{
+		key = PlanetTileCache::hash(AssetManager::load_string_raw(config.surface.graph_path), key);
+	}
+	if (graph != nullptr)
+	{
+		key = PlanetTileCache::hash(fmt::format("{:016x}", graph->get_image_key()), key);
+	}
+	key = PlanetTileCache::hash(fmt::format("{:.17g}", config.radius), key);
+	key = PlanetTileCache::hash(fmt::format("{}", config.surface.version), key);
+
+	return key;
 }
 
 void PlanetTileServer::do_imgui()
@@ -193,73 +342,44 @@ void PlanetTileServer::do_imgui()
 	// (Not really unsafe!)
 	size_t tiles_size = tiles.get_unsafe()->size();
 	ImGui::Text("Loaded tiles: %i (%.2fMB)", (int)tiles_size, (float)(tiles_size * sizeof(PlanetTile)) / 1000000.0f);
-	ImGui::Text("Work List: %i", (int)work_list.get_unsafe()->size());
+	ImGui::Text("Work List: %i (%i in flight, %i cancelled)", (int)work_list.get_unsafe()->size(),
+		(int)work_list.get_unsafe()->get_in_flight(), (int)work_list.get_unsafe()->get_cancelled());
+	ImGui::Text("Cached tiles: %i", (int)cache->get_tile_count());
+	planet_tile_pool->do_imgui();
+	planet_tile_uploader->do_imgui();
+	planet_tile_retainer->do_imgui();
+	planet_height_cache->do_imgui();
 }
 
-void PlanetTileServer::thread_func(PlanetTileServer* server, PlanetTileThread* thread)
+void PlanetTileServer::generate_tile(const PlanetTilePath& target, sol::state& lua_state, PlanetTile::GeneratorArrays& arrays)
 {
-	PlanetTile::GeneratorArrays arrays;
+	// Physics tiles are built from these (see GroundShapeServer)
+	bool physics = target.get_depth() == PlanetTile::get_physics_depth(config->surface.max_depth);
 
-	while (server->threads_run)
+	PlanetTile* ntile = new PlanetTile();
+	bool errors = ntile->generate(target, config->radius, lua_state, graph, has_water, &arrays, cache,
+		physics ? generator_key : 0);
+
+	if (errors)
 	{
-		{
-			// Needs a block so the lock is free once the wait is over
-			std::unique_lock<std::mutex> lock(server->condition_mtx);
-			server->condition_var.wait(lock);
-		}
+		has_errors = true;
+	}
 
-		// (We break out of this loop)
-		while (true)
+	{
+		// Staged under the work list lock, so update never sees the tile as
+		// neither loaded nor in flight. It's moved to tiles on the next update
+		auto work_list_w = work_list.get();
+		if (work_list_w->finish(target))
 		{
-			PlanetTilePath target = PlanetTilePath(std::vector<QuadTreeQuadrant>(), PX);
-
-			{
-				auto work_list_w = server->work_list.get();
-
-				if (work_list_w->size() == 0)
-				{
-					break;
-				}
-			
-				
-				// Simpler method, starts from smallest tile
-				target = *work_list_w->begin();
-				work_list_w->erase(work_list_w->begin());
-				
-				
-			}
-
-			// Work on the target
-			PlanetTile* ntile = new PlanetTile();
-			bool has_errors = ntile->generate(target, server->config->radius, 
-				thread->lua_state, server->has_water, &arrays);
-
-			if (has_errors)
-			{
-				server->has_errors = true;
-			}
-
-
-			{
-				// Send it to the tiles
-				auto tiles_w = server->tiles.get();
-				if (tiles_w->find(target) == tiles_w->end())
-				{
-					(*tiles_w)[target] = ntile;
-				}
-				else
-				{
-					// Weird, but can happen, thread will have wasted some precious CPU
-					// time. TODO: Try to reduce the frequency of this
-					delete ntile;
-				}
-				
-			}
-
-			server->dirty = true;
+			finished.get()->emplace_back(target, ntile);
+			ntile = nullptr;
 		}
 	}
 
+	// The camera moved on while we were working
+	delete ntile;
+
+	dirty = true;
 }
 
 void PlanetTileServer::default_lua(sol::state& lua_state)
@@ -1,6 +1,7 @@
 #pragma once
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <set>
 #include <array>
@@ -11,6 +12,10 @@
 #include <universe/element/config/ElementConfig.h>
 #include "PlanetTilePath.h"
 #include "PlanetTile.h"
+#include "PlanetTileSampler.h"
+#include "PlanetNoiseGraph.h"
+#include "PlanetTileWorkQueue.h"
+#include "PlanetTileCache.h"
 #include "../quadtree/QuadTreePlanet.h"
 #include <util/ThreadUtil.h>
 #include <assets/AssetManager.h>
@@ -19,65 +24,106 @@
 
 
 
-struct PlanetTileThread
-{
-	sol::state lua_state;
-	std::thread* thread;
-};
-
 // The tile server handles storage, creation and removal
 // of tiles via a simple interface.
-// This is the "master" of tile generation, while
-// the "slave" threads will do the weight lifting
+// This is the "master" of tile generation, while the threads
+// of the global PlanetTileWorkerPool do the weight lifting
 class PlanetTileServer
 {
-private:
+public:
 
-	bool dirty;
+	using TileMap = PlanetTileSampler::TileMap;
 
-	size_t worker_thread_count;
+private:
+
+	// Set by the workers as tiles finish
+	std::atomic<bool> dirty;
 
 	int depth_for_unload;
 
-	std::vector<PlanetTileThread> threads;
+	// Set once the whole quadtree has been seen, from then on only changes are used
+	bool synced;
+	// Reused on every update
+	std::vector<PlanetTilePath> added, removed;
+	std::vector<PlanetTilePath> new_paths, queued_paths;
+	std::vector<PlanetTileWorkQueue::Entry> entries;
+	// Tiles waiting for upload and their priority
+	struct PendingUpload
+	{
+		double priority;
+		PlanetTilePath path;
+		PlanetTile* tile;
+	};
+	std::vector<PendingUpload> pending_uploads;
+
+	// Tiles finished by the workers, moved to tiles on the next update.
+	// Workers only ever lock this (and the work list), never tiles
+	Atomic<std::vector<std::pair<PlanetTilePath, PlanetTile*>>> finished;
+	std::vector<std::pair<PlanetTilePath, PlanetTile*>> finished_buffer;
+
+	// Main thread only, see get_uploaded_tiles
+	TileMap uploaded;
+
+	// Moves the finished tiles to tiles_w
+	void merge_finished(TileMap& tiles_w);
+
+	// Relative to the planet, not rotated, see set_camera
+	glm::dvec3 camera_pos;
 
-	static void thread_func(PlanetTileServer* server, PlanetTileThread* thread);
+	// Roughly the screen-space error of the tile as it is now (its vertex
+	// spacing over its distance to the camera). Higher is more urgent
+	double get_priority(const PlanetTilePath& path) const;
 
 	// Loads default values for the different libraries
 	void default_lua(sol::state& lua_state);
 
 	// We keep a little state to find height and so 
 	// everybody can query to find stuff about the script
+	// It's only used for height queries when no tile is loaded
 	sol::state lua_state;
+	std::mutex lua_mtx;
 
 public:
 
+	// If the surface uses a noise graph, it's used instead of the lua script
+	// by all threads (it's read-only once compiled). nullptr otherwise
+	PlanetNoiseGraph* graph;
+
 	bool has_water;
 
+	// Generated tiles are kept here across launches
+	PlanetTileCache* cache;
+	// Identifies the generator output, see get_generator_key
+	uint64_t generator_key;
+	// Identifies what we generate, servers with the same key make the
+	// same tiles (see PlanetTileRetainer)
+	uint64_t tile_key;
+
 	ElementConfig* config;
 
 	bool has_errors;
 
-	bool threads_run;
-
-	using TileMap = std::unordered_map<PlanetTilePath, PlanetTile*, PlanetTilePathHasher>;
-
-
-
-	// Used for waking up threads efficiently, instead
-	// of a wait-loop which uses 100% CPU
-	std::mutex condition_mtx;
-	std::condition_variable condition_var;
+	// Used by the worker pool to create lua states for us
+	std::string script;
+	std::string script_path;
+	std::string script_pkg;
 
 	std::unordered_map<std::string, AssetHandle<Image>> images;
 
+	// Every loaded tile, uploaded or not. Only changed by update
 	Atomic<TileMap> tiles;
-	// Threads always try to work on the highest priority
-	// (ie. lowest detail tile) first
-	Atomic<std::multiset<PlanetTilePath, PlanetTilePathLess>> work_list;
+
+	// The uploaded tiles, for the renderer. It only changes during update, so
+	// it stays the same for the whole frame and no locking is needed, but it
+	// must only be used from the main thread
+	const TileMap& get_uploaded_tiles() const { return uploaded; }
+	// Threads always work on the highest priority tile first, which are
+	// the ones that look the worst right now (see get_priority)
+	Atomic<PlanetTileWorkQueue> work_list;
 
 	// Tells threads to start loading some new tiles, if neccesary
-	// or unloads unused, small enough tiles.
+	// or unloads unused, small enough tiles. Only the changes of the
+	// quadtree since the last call are looked at.
 	void update(QuadTreePlanet& planet);
 
 	// Any tile deeper than, or equal to this will be unloaded
@@ -86,6 +132,24 @@ public:
 	// are unloaded the moment they are not needed
 	void set_depth_for_unload(int depth);
 
+	// Generates a tile popped from work_list and stores it (if still wanted),
+	// called from the worker pool threads
+	void generate_tile(const PlanetTilePath& target, sol::state& lua_state, PlanetTile::GeneratorArrays& arrays);
+
+	// Servers with the same key can share lua states
+	std::string get_script_key() const { return script_pkg + ":" + script_path; }
+
+	// Hash of everything that affects the generator output (script, graph and its images,
+	// radius and surface.version), anything generating tiles with the same key gets the
+	// same heights and colors. graph may be nullptr. Files the script dofiles are not
+	// tracked, surface.version must be bumped if they change
+	static uint64_t get_generator_key(const std::string& script, const ElementConfig& config,
+		const PlanetNoiseGraph* graph);
+
+	// Position of the camera relative to the planet (not rotated), used to
+	// prioritize work. Takes effect on the next update that changes the tiles
+	void set_camera(glm::dvec3 pos) { camera_pos = pos; }
+
 	void do_imgui();
 
 	bool is_built()
@@ -93,12 +157,22 @@ public:
 		return work_list.get_unsafe()->size() == 0;
 	}
 	
+	// Heights (in meters) sampled from the deepest loaded tile at each position, positions
+	// are relative to the planet (not rotated) and don't need to be normalized.
+	// Only positions without any loaded tile run the planet script (all in a single call),
+	// which should only happen while the root tiles are still generating.
+	// Safe to call from any thread
+	void get_heights(const std::vector<glm::dvec3>& pos_3d, std::vector<double>& out, size_t depth = 1);
+
 	double get_height(glm::dvec3 pos_3d, size_t depth = 1);
 
-	// Make sure you call once a OpenGL context is available
-	// as we will create the index buffer here
+	// Doesn't need the OpenGL context, so it may be created away from the main
+	// thread (see BodyLoader). pkg is the package the script is run from
+	// graph must be loaded beforehand in the main thread as it loads assets,
+	// nullptr if the surface has none. We take ownership of it
+	// The script's top level runs here, without the "assets" library (see PlanetTile::prepare_lua)
 	PlanetTileServer(const std::string& script, const std::string& script_path,
-					 ElementConfig* config, bool has_water, size_t thread_count = 4);
+					 ElementConfig* config, bool has_water, const std::string& pkg, PlanetNoiseGraph* graph);
 
 	~PlanetTileServer();
 };
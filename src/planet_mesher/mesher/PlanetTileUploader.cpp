@@ -0,0 +1,144 @@
+#include "PlanetTileUploader.h"
+#include <imgui/imgui.h>
+#include <glm/glm.hpp>
+#include <cstring>
+
+PlanetTileUploader* planet_tile_uploader;
+
+bool PlanetTileUploader::has_budget(size_t bytes)
+{
+	if (frame_uploads == 0)
+	{
+		return true;
+	}
+
+	return frame_bytes + bytes <= byte_budget && frame_timer.get_elapsed_time() < time_budget;
+}
+
+void PlanetTileUploader::upload(const void* data, size_t bytes, GLuint target, size_t offset)
+{
+	if (frame_uploads == 0)
+	{
+		frame_timer.restart();
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+
+	bool staged = false;
+	if (head + bytes <= SEGMENT_SIZE)
+	{
+		size_t staging_offset = segment * SEGMENT_SIZE + head;
+
+		// The fence in new_frame guarantees the GPU is done with this segment
+		glBindBuffer(GL_COPY_READ_BUFFER, staging);
+		void* ptr = glMapBufferRange(GL_COPY_READ_BUFFER, staging_offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (ptr != nullptr)
+		{
+			memcpy(ptr, data, bytes);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, staging_offset, offset, bytes);
+
+			// Keep mappings aligned
+			head += (bytes + 63) & ~(size_t)63;
+			staged = true;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	if (!staged)
+	{
+		// Too big for what's left of the segment (can only happen to the first upload
+		// of a frame if the budget is small), or the driver could not map it
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	frame_bytes += bytes;
+	frame_uploads++;
+}
+
+void PlanetTileUploader::new_frame()
+{
+	if (fences[segment] != 0)
+	{
+		glDeleteSync(fences[segment]);
+	}
+	fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	segment = (segment + 1) % FRAMES_IN_FLIGHT;
+	head = 0;
+
+	if (fences[segment] != 0)
+	{
+		// Usually signaled long ago, the frame was FRAMES_IN_FLIGHT - 1 frames back
+		glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(fences[segment]);
+		fences[segment] = 0;
+	}
+
+	last_bytes = frame_bytes;
+	last_uploads = frame_uploads;
+	last_deferred = frame_deferred;
+	frame_bytes = 0;
+	frame_uploads = 0;
+	frame_deferred = 0;
+}
+
+void PlanetTileUploader::set_budget(size_t bytes, double seconds)
+{
+	byte_budget = glm::min(bytes, SEGMENT_SIZE);
+	time_budget = seconds;
+}
+
+void PlanetTileUploader::do_imgui()
+{
+	ImGui::Text("Tile uploads: %i (%.2fMB), %i deferred", (int)last_uploads,
+		(float)last_bytes / 1000000.0f, (int)last_deferred);
+}
+
+PlanetTileUploader::PlanetTileUploader(size_t byte_budget, double time_budget)
+{
+	set_budget(byte_budget, time_budget);
+
+	glGenBuffers(1, &staging);
+	glBindBuffer(GL_COPY_READ_BUFFER, staging);
+	glBufferData(GL_COPY_READ_BUFFER, SEGMENT_SIZE * FRAMES_IN_FLIGHT, nullptr, GL_STREAM_COPY);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	fences.fill(0);
+	segment = 0;
+	head = 0;
+
+	frame_bytes = 0;
+	frame_uploads = 0;
+	frame_deferred = 0;
+	last_bytes = 0;
+	last_uploads = 0;
+	last_deferred = 0;
+}
+
+PlanetTileUploader::~PlanetTileUploader()
+{
+	for (GLsync fence : fences)
+	{
+		if (fence != 0)
+		{
+			glDeleteSync(fence);
+		}
+	}
+
+	glDeleteBuffers(1, &staging);
+}
+
+void create_global_planet_tile_uploader()
+{
+	// Roughly 25 tiles (with water) or 2ms per frame
+	planet_tile_uploader = new PlanetTileUploader(1024 * 1024, 0.002);
+}
+
+void destroy_global_planet_tile_uploader()
+{
+	delete planet_tile_uploader;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <glad/glad.h>
+#include <util/Timer.h>
+
+// Uploads tile vertices to the GPU through a staging ring, limiting how much
+// is uploaded every frame (in bytes and time) so a burst of finished tiles
+// doesn't cause a spike. Shared by all tile servers so the budget is global.
+//
+// The ring is split in one segment per frame in flight, each fenced once its
+// frame is done, so writing to it never waits on the GPU (OpenGL 4.3 has no
+// persistent mapping, so every write is an unsynchronized map instead).
+class PlanetTileUploader
+{
+private:
+
+	static const size_t FRAMES_IN_FLIGHT = 3;
+	static const size_t SEGMENT_SIZE = 4 * 1024 * 1024;
+
+	GLuint staging;
+	std::array<GLsync, FRAMES_IN_FLIGHT> fences;
+	size_t segment;
+	// Offset inside the current segment
+	size_t head;
+
+	size_t byte_budget;
+	double time_budget;
+
+	Timer frame_timer;
+	// Stats of the current frame
+	size_t frame_bytes, frame_uploads, frame_deferred;
+	// And the last one, for imgui
+	size_t last_bytes, last_uploads, last_deferred;
+
+public:
+
+	// Returns false if the given amount of data shouldn't be uploaded this frame.
+	// The first upload of a frame is always allowed so we always progress
+	bool has_budget(size_t bytes);
+	// Call with whatever was left for the next frames, only for stats
+	void defer(size_t count) { frame_deferred += count; }
+
+	// Copies data to the given buffer through the ring, data can be freed right away
+	void upload(const void* data, size_t bytes, GLuint target, size_t offset);
+
+	// Call once per frame, before any upload
+	void new_frame();
+
+	// Bytes per frame are capped to a ring segment
+	void set_budget(size_t bytes, double seconds);
+
+	void do_imgui();
+
+	PlanetTileUploader(size_t byte_budget, double time_budget);
+	~PlanetTileUploader();
+};
+
+extern PlanetTileUploader* planet_tile_uploader;
+
+// Needs the OpenGL context
+void create_global_planet_tile_uploader();
+void destroy_global_planet_tile_uploader();
@@ -0,0 +1,102 @@
+#include "PlanetTileWorkQueue.h"
+#include <algorithm>
+
+void PlanetTileWorkQueue::sort_entries(std::vector<Entry>& entries)
+{
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+	{
+		// Bigger tiles first on ties, as the smaller ones need them to be shown
+		if (a.priority == b.priority)
+		{
+			return a.path.get_depth() > b.path.get_depth();
+		}
+
+		return a.priority < b.priority;
+	});
+}
+
+void PlanetTileWorkQueue::get_queued(std::vector<PlanetTilePath>& out) const
+{
+	out.clear();
+	out.reserve(queue.size());
+	for (const Entry& entry : queue)
+	{
+		out.push_back(entry.path);
+	}
+}
+
+void PlanetTileWorkQueue::set_queue(const std::vector<Entry>& sorted)
+{
+	std::unordered_set<PlanetTilePath, PlanetTilePathHasher> queued;
+	queued.reserve(queue.size());
+	for (const Entry& entry : queue)
+	{
+		queued.insert(entry.path);
+	}
+
+	queue.clear();
+	for (const Entry& entry : sorted)
+	{
+		if (queued.find(entry.path) != queued.end())
+		{
+			queue.push_back(entry);
+		}
+		else if (wanted.insert(entry.path).second && in_flight.find(entry.path) == in_flight.end())
+		{
+			queue.push_back(entry);
+		}
+	}
+}
+
+void PlanetTileWorkQueue::remove(const std::vector<PlanetTilePath>& paths)
+{
+	size_t removed = 0;
+	for (const PlanetTilePath& path : paths)
+	{
+		removed += wanted.erase(path);
+	}
+
+	if (removed == 0)
+	{
+		return;
+	}
+
+	// Single pass, the order is kept
+	auto it = std::remove_if(queue.begin(), queue.end(), [this](const Entry& entry)
+	{
+		return wanted.find(entry.path) == wanted.end();
+	});
+	cancelled += (size_t)(queue.end() - it);
+	queue.erase(it, queue.end());
+}
+
+bool PlanetTileWorkQueue::pop(PlanetTilePath& out)
+{
+	if (queue.empty())
+	{
+		return false;
+	}
+
+	out = queue.back().path;
+	queue.pop_back();
+	in_flight.insert(out);
+
+	return true;
+}
+
+bool PlanetTileWorkQueue::finish(const PlanetTilePath& path)
+{
+	in_flight.erase(path);
+	if (wanted.find(path) == wanted.end())
+	{
+		cancelled++;
+		return false;
+	}
+
+	return true;
+}
+
+PlanetTileWorkQueue::PlanetTileWorkQueue()
+{
+	cancelled = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <unordered_set>
+#include "PlanetTilePath.h"
+
+// Tiles waiting to be generated, most important first. It also keeps track
+// of the tiles being generated right now, so the same tile is never generated
+// twice, and of the tiles still wanted, so work the camera moved away from is dropped.
+// Not thread safe by itself, the server keeps it in an Atomic
+class PlanetTileWorkQueue
+{
+public:
+
+	struct Entry
+	{
+		PlanetTilePath path;
+		// Higher goes first
+		double priority;
+	};
+
+private:
+
+	// Sorted by ascending priority, we pop from the back
+	std::vector<Entry> queue;
+	std::unordered_set<PlanetTilePath, PlanetTilePathHasher> in_flight;
+	// Added and not removed yet
+	std::unordered_set<PlanetTilePath, PlanetTilePathHasher> wanted;
+
+	size_t cancelled;
+
+public:
+
+	// Sorts by ascending priority, as the queue is kept
+	static void sort_entries(std::vector<Entry>& entries);
+
+	// Paths waiting to be generated, so their priorities can be computed away from the lock
+	void get_queued(std::vector<PlanetTilePath>& out) const;
+
+	// Replaces the queue with the given entries, sorted with sort_entries. Entries that
+	// were queued keep their place only if still waiting (they may have been popped
+	// meanwhile), any other is queued as new unless already wanted
+	void set_queue(const std::vector<Entry>& sorted);
+
+	// Paths not wanted anymore, they are dropped from the queue and thrown
+	// away if they are being generated
+	void remove(const std::vector<PlanetTilePath>& paths);
+
+	// Takes the most important path and marks it as in flight
+	bool pop(PlanetTilePath& out);
+
+	// Call once a popped path has been generated, returns false if it's
+	// not wanted anymore (so the tile can be thrown away)
+	bool finish(const PlanetTilePath& path);
+
+	size_t size() const { return queue.size(); }
+	// Priority of the path pop would return, the queue must not be empty
+	double top_priority() const { return queue.back().priority; }
+	size_t get_in_flight() const { return in_flight.size(); }
+	// Total number of cancelled requests, for debugging
+	size_t get_cancelled() const { return cancelled; }
+
+	PlanetTileWorkQueue();
+};
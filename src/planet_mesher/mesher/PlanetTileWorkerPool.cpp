@@ -0,0 +1,249 @@
+#include "PlanetTileWorkerPool.h"
+#include "PlanetTileServer.h"
+#include <imgui/imgui.h>
+#include <algorithm>
+
+PlanetTileWorkerPool* planet_tile_pool;
+
+bool PlanetTileWorkerPool::pick(PlanetTileServer*& server, PlanetTilePath& target)
+{
+	PlanetTileServer* best = nullptr;
+	double best_priority = 0.0;
+
+	for (PlanetTileServer* candidate : servers)
+	{
+		auto work_list_w = candidate->work_list.get();
+		if (work_list_w->size() != 0 && (best == nullptr || work_list_w->top_priority() > best_priority))
+		{
+			best = candidate;
+			best_priority = work_list_w->top_priority();
+		}
+	}
+
+	if (best == nullptr)
+	{
+		return false;
+	}
+
+	auto work_list_w = best->work_list.get();
+	if (!work_list_w->pop(target))
+	{
+		return false;
+	}
+
+	server = best;
+	jobs[server]++;
+
+	return true;
+}
+
+sol::state* PlanetTileWorkerPool::acquire_state(PlanetTileServer* server)
+{
+	std::string script, script_path, pkg;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		ScriptStates& states = scripts[server->get_script_key()];
+		if (!states.free.empty())
+		{
+			sol::state* state = states.free.back();
+			states.free.pop_back();
+			return state;
+		}
+
+		script = states.script;
+		script_path = states.script_path;
+		pkg = states.pkg;
+	}
+
+	// None free, create a new one (other threads keep working meanwhile)
+	sol::state* state = new sol::state();
+	bool wrote_error = false;
+	{
+		std::lock_guard<std::mutex> lock(create_mtx);
+		PlanetTile::prepare_lua(*state, pkg);
+		LuaUtil::safe_lua(*state, script, wrote_error, script_path);
+	}
+
+	if (wrote_error)
+	{
+		server->has_errors = true;
+	}
+
+	return state;
+}
+
+void PlanetTileWorkerPool::release_state(PlanetTileServer* server, sol::state* state)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	scripts[server->get_script_key()].free.push_back(state);
+}
+
+void PlanetTileWorkerPool::thread_func(PlanetTileWorkerPool* pool)
+{
+	PlanetTile::GeneratorArrays arrays;
+	// Passed to servers using a noise graph, which never touch it
+	sol::state unused_state;
+
+	while (true)
+	{
+		PlanetTileServer* server = nullptr;
+		PlanetTilePath target = PlanetTilePath(PX);
+
+		{
+			std::unique_lock<std::mutex> lock(pool->mtx);
+			pool->work_var.wait(lock, [pool, &server, &target]()
+			{
+				return !pool->run || pool->pick(server, target);
+			});
+
+			if (!pool->run)
+			{
+				if (server != nullptr)
+				{
+					pool->jobs[server]--;
+				}
+				break;
+			}
+		}
+
+		if (server->graph != nullptr)
+		{
+			server->generate_tile(target, unused_state, arrays);
+		}
+		else
+		{
+			sol::state* state = pool->acquire_state(server);
+			server->generate_tile(target, *state, arrays);
+			pool->release_state(server, state);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(pool->mtx);
+			pool->jobs[server]--;
+			pool->stats_tiles++;
+			pool->stats_gen_time += arrays.gen_time;
+			pool->stats_mesh_time += arrays.mesh_time;
+		}
+		pool->idle_var.notify_all();
+	}
+
+	pool->idle_var.notify_all();
+}
+
+void PlanetTileWorkerPool::add_server(PlanetTileServer* server)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	servers.push_back(server);
+	jobs[server] = 0;
+
+	ScriptStates& states = scripts[server->get_script_key()];
+	if (states.users == 0)
+	{
+		states.script = server->script;
+		states.script_path = server->script_path;
+		states.pkg = server->script_pkg;
+	}
+	states.users++;
+}
+
+void PlanetTileWorkerPool::remove_server(PlanetTileServer* server)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+
+	auto it = std::find(servers.begin(), servers.end(), server);
+	if (it == servers.end())
+	{
+		return;
+	}
+
+	// No new jobs will be picked for it
+	servers.erase(it);
+	idle_var.wait(lock, [this, server]()
+	{
+		return jobs[server] == 0;
+	});
+	jobs.erase(server);
+
+	auto states_it = scripts.find(server->get_script_key());
+	states_it->second.users--;
+	if (states_it->second.users == 0)
+	{
+		// Every state is free as there are no jobs left for the script
+		for (sol::state* state : states_it->second.free)
+		{
+			delete state;
+		}
+		scripts.erase(states_it);
+	}
+}
+
+void PlanetTileWorkerPool::notify()
+{
+	{
+		// Makes sure no thread is between checking for work and waiting
+		std::lock_guard<std::mutex> lock(mtx);
+	}
+	work_var.notify_all();
+}
+
+void PlanetTileWorkerPool::do_imgui()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	ImGui::Text("Terrain threads: %i, bodies: %i, scripts: %i", (int)threads.size(), (int)servers.size(), (int)scripts.size());
+	if (stats_tiles != 0)
+	{
+		// Per thread, as if it was always busy
+		double total_time = stats_gen_time + stats_mesh_time;
+		ImGui::Text("Tiles: %i, %.0f tiles/s per thread (meshing alone: %.0f tiles/s)", (int)stats_tiles,
+			(double)stats_tiles / total_time, (double)stats_tiles / stats_mesh_time);
+	}
+}
+
+PlanetTileWorkerPool::PlanetTileWorkerPool(size_t thread_count)
+{
+	run = true;
+	stats_tiles = 0;
+	stats_gen_time = 0.0;
+	stats_mesh_time = 0.0;
+
+	for (size_t i = 0; i < std::max(thread_count, (size_t)1); i++)
+	{
+		threads.push_back(new std::thread(thread_func, this));
+	}
+}
+
+PlanetTileWorkerPool::~PlanetTileWorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		run = false;
+	}
+	work_var.notify_all();
+
+	for (std::thread* thread : threads)
+	{
+		thread->join();
+		delete thread;
+	}
+
+	for (auto& pair : scripts)
+	{
+		for (sol::state* state : pair.second.free)
+		{
+			delete state;
+		}
+	}
+}
+
+void create_global_planet_tile_pool()
+{
+	size_t cores = (size_t)std::thread::hardware_concurrency();
+	planet_tile_pool = new PlanetTileWorkerPool(cores > 1 ? cores - 1 : 1);
+}
+
+void destroy_global_planet_tile_pool()
+{
+	delete planet_tile_pool;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <sol/sol.hpp>
+#include "PlanetTile.h"
+
+class PlanetTileServer;
+
+// A single pool of threads generating tiles for every loaded planet, so loading
+// more bodies doesn't add more threads. Each tile job picks the most urgent tile
+// among all servers (priorities are comparable, see PlanetTileServer::get_priority).
+// Lua states are kept per script and created lazily by the threads themselves the
+// first time they are needed, so loading a body doesn't stall the main thread.
+class PlanetTileWorkerPool
+{
+private:
+
+	struct ScriptStates
+	{
+		std::string script;
+		std::string script_path;
+		std::string pkg;
+		// States not in use right now
+		std::vector<sol::state*> free;
+		// Servers using the script
+		size_t users;
+	};
+
+	std::vector<std::thread*> threads;
+	bool run;
+
+	// Guards everything below, never lock a server's tiles or work list
+	// and then this one (the other way around is fine)
+	std::mutex mtx;
+	// Wakes up threads when there's work
+	std::condition_variable work_var;
+	// Wakes up remove_server when a job is done
+	std::condition_variable idle_var;
+
+	std::vector<PlanetTileServer*> servers;
+	// Number of jobs running for each server
+	std::unordered_map<PlanetTileServer*, size_t> jobs;
+	// Indexed by script key (see PlanetTileServer::get_script_key)
+	std::unordered_map<std::string, ScriptStates> scripts;
+
+	// Totals of every tile generated, to measure the throughput of a thread
+	size_t stats_tiles;
+	double stats_gen_time, stats_mesh_time;
+
+	// Running scripts while loading them may touch shared stuff, so only
+	// one state is created at a time
+	std::mutex create_mtx;
+
+	static void thread_func(PlanetTileWorkerPool* pool);
+
+	// Pops the most urgent tile from all servers, must be called with mtx locked
+	bool pick(PlanetTileServer*& server, PlanetTilePath& target);
+
+	sol::state* acquire_state(PlanetTileServer* server);
+	void release_state(PlanetTileServer* server, sol::state* state);
+
+public:
+
+	// Servers must be added before they queue any work, and removed before
+	// they are destroyed (this waits for any job running on it)
+	void add_server(PlanetTileServer* server);
+	void remove_server(PlanetTileServer* server);
+
+	// Call when new work has been queued (without holding any server lock)
+	void notify();
+
+	size_t get_thread_count() const { return threads.size(); }
+
+	// Hold it while creating any lua state away from the main thread
+	std::mutex& get_create_mutex() { return create_mtx; }
+
+	void do_imgui();
+
+	explicit PlanetTileWorkerPool(size_t thread_count);
+	~PlanetTileWorkerPool();
+};
+
+extern PlanetTileWorkerPool* planet_tile_pool;
+
+// Uses all cores but one (the main thread's)
+void create_global_planet_tile_pool();
+void destroy_global_planet_tile_pool();
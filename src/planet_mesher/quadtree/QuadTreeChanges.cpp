@@ -0,0 +1,46 @@
+#include "QuadTreeChanges.h"
+
+void QuadTreeChanges::on_added(const PlanetTilePath& path)
+{
+	auto it = pending.find(path);
+	if (it != pending.end() && !it->second)
+	{
+		// It was there before, nothing changed
+		pending.erase(it);
+	}
+	else
+	{
+		pending[path] = true;
+	}
+}
+
+void QuadTreeChanges::on_removed(const PlanetTilePath& path)
+{
+	auto it = pending.find(path);
+	if (it != pending.end() && it->second)
+	{
+		// It was never seen
+		pending.erase(it);
+	}
+	else
+	{
+		pending[path] = false;
+	}
+}
+
+void QuadTreeChanges::take(std::vector<PlanetTilePath>& added, std::vector<PlanetTilePath>& removed)
+{
+	for (auto& pair : pending)
+	{
+		if (pair.second)
+		{
+			added.push_back(pair.first);
+		}
+		else
+		{
+			removed.push_back(pair.first);
+		}
+	}
+
+	pending.clear();
+}
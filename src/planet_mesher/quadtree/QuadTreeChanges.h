@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include "../mesher/PlanetTilePath.h"
+
+// Nodes created (by splits) and destroyed (by merges) in a tree since the last
+// take. Changes which undo each other, like merging and splitting again the same
+// node, cancel out, so only the real difference is seen
+class QuadTreeChanges
+{
+private:
+
+	// true if added, false if removed
+	std::unordered_map<PlanetTilePath, bool, PlanetTilePathHasher> pending;
+
+public:
+
+	void on_added(const PlanetTilePath& path);
+	void on_removed(const PlanetTilePath& path);
+
+	bool empty() const { return pending.empty(); }
+
+	// Appends to added and removed, and forgets all changes
+	void take(std::vector<PlanetTilePath>& added, std::vector<PlanetTilePath>& removed);
+};
@@ -1,4 +1,6 @@
 #include "QuadTreeNode.h"
+#include "QuadTreeNodePool.h"
+#include "QuadTreeChanges.h"
 #include <imgui/imgui.h>
 
 
@@ -12,10 +14,26 @@ bool QuadTreeNode::split(bool get_neighbors)
 	}
 
 	// Create new children
-	QuadTreeNode* nw = new QuadTreeNode(this, NORTH_WEST);
-	QuadTreeNode* ne = new QuadTreeNode(this, NORTH_EAST);
-	QuadTreeNode* sw = new QuadTreeNode(this, SOUTH_WEST);
-	QuadTreeNode* se = new QuadTreeNode(this, SOUTH_EAST);
+	QuadTreeNode* nw;
+	QuadTreeNode* ne;
+	QuadTreeNode* sw;
+	QuadTreeNode* se;
+
+	if (pool != nullptr)
+	{
+		QuadTreeNode* group = pool->allocate_children(this);
+		nw = &group[NORTH_WEST];
+		ne = &group[NORTH_EAST];
+		sw = &group[SOUTH_WEST];
+		se = &group[SOUTH_EAST];
+	}
+	else
+	{
+		nw = new QuadTreeNode(this, NORTH_WEST);
+		ne = new QuadTreeNode(this, NORTH_EAST);
+		sw = new QuadTreeNode(this, SOUTH_WEST);
+		se = new QuadTreeNode(this, SOUTH_EAST);
+	}
 
 	// Assign them
 	children[NORTH_WEST] = nw;
@@ -23,6 +41,15 @@ bool QuadTreeNode::split(bool get_neighbors)
 	children[SOUTH_WEST] = sw;
 	children[SOUTH_EAST] = se;
 
+	if (changes != nullptr)
+	{
+		PlanetTilePath path = get_path();
+		for (size_t i = 0; i < 4; i++)
+		{
+			changes->on_added(path.get_child((QuadTreeQuadrant)i));
+		}
+	}
+
 	if (get_neighbors)
 	{
 		nw->obtain_neighbors(NORTH_WEST, true);
@@ -40,6 +67,25 @@ bool QuadTreeNode::merge()
 	{
 		return false;
 	}
+
+	// Deeper nodes are reported by the children themselves as they merge
+	if (changes != nullptr)
+	{
+		PlanetTilePath path = get_path();
+		for (size_t i = 0; i < 4; i++)
+		{
+			changes->on_removed(path.get_child((QuadTreeQuadrant)i));
+		}
+	}
+
+	if (pool != nullptr)
+	{
+		// Children were allocated together, children[0] is the start of the group
+		QuadTreeNode* group = children[0];
+		children[0] = NULL; children[1] = NULL; children[2] = NULL; children[3] = NULL;
+		pool->free_children(group);
+		return true;
+	}
 	else
 	{
 		delete children[0]; children[0] = NULL;
@@ -93,7 +139,7 @@ bool QuadTreeNode::is_children_of(const QuadTreeNode* b) const
 	return false;
 }
 
-QuadTreeNode* QuadTreeNode::get_recursive(glm::dvec2 coord, size_t maxDepth)
+void QuadTreeNode::obtain_all_neighbors()
 {
 	if (depth >= 1)
 	{
@@ -104,6 +150,11 @@ QuadTreeNode* QuadTreeNode::get_recursive(glm::dvec2 coord, size_t maxDepth)
 		neighbors[SOUTH]->obtain_neighbors(neighbors[SOUTH]->quad);
 		neighbors[WEST]->obtain_neighbors(neighbors[WEST]->quad);
 	}
+}
+
+QuadTreeNode* QuadTreeNode::get_recursive(glm::dvec2 coord, size_t maxDepth)
+{
+	obtain_all_neighbors();
 
 	if (depth < maxDepth)
 	{
@@ -415,153 +466,88 @@ void QuadTreeNode::obtain_neighbors(QuadTreeQuadrant quad, bool nosplit)
 
 
 
-std::vector<QuadTreeQuadrant> QuadTreeNode::get_path() const
+PlanetTilePath QuadTreeNode::get_path() const
 {
-
 	if (depth > 0)
 	{
-
-		std::vector<QuadTreeQuadrant> fromParent = parent->get_path();
-
-		if (parent->children[NORTH_WEST] == this)
-		{
-			fromParent.push_back(NORTH_WEST);
-		}
-
-		if (parent->children[NORTH_EAST] == this)
-		{
-			fromParent.push_back(NORTH_EAST);
-		}
-
-		if (parent->children[SOUTH_WEST] == this)
-		{
-			fromParent.push_back(SOUTH_WEST);
-		}
-
-		if (parent->children[SOUTH_EAST] == this)
-		{
-			fromParent.push_back(SOUTH_EAST);
-		}
-
-		return fromParent;
+		return parent->get_path().get_child(quad);
 	}
 	else
 	{
-		return std::vector<QuadTreeQuadrant>();
+		return PlanetTilePath(planetside);
 	}
-	
 }
 
 
-std::vector<QuadTreeNode*> QuadTreeNode::get_all_leaf_nodes()
+void QuadTreeNode::get_all_leaf_nodes(std::vector<QuadTreeNode*>& out)
 {
-	std::vector<QuadTreeNode*> out;
+	if (!has_children())
+	{
+		out.push_back(this);
+		return;
+	}
 
 	for (size_t i = 0; i < 4; i++)
 	{
-		if (children[i] != NULL)
-		{
-			if (children[i]->has_children())
-			{
-				std::vector<QuadTreeNode*> fromChild = children[i]->get_all_leaf_nodes();
-				out.insert(out.end(), fromChild.begin(), fromChild.end());
-			}
-			else
-			{
-				out.push_back(children[i]);
-			}
-		}
-		else
-		{
-			out.push_back(this);
-		}
+		children[i]->get_all_leaf_nodes(out);
 	}
-
-	return out;
 }
 
-std::vector<std::vector<QuadTreeQuadrant>> QuadTreeNode::get_all_leaf_paths() const
+void QuadTreeNode::get_all_leaf_paths(std::vector<PlanetTilePath>& out) const
 {
-	std::vector<std::vector<QuadTreeQuadrant>> out;
+	if (!has_children())
+	{
+		out.push_back(get_path());
+		return;
+	}
 
 	for (size_t i = 0; i < 4; i++)
 	{
-		if (children[i] != NULL)
-		{
-			if (children[i]->has_children())
-			{
-				std::vector<std::vector<QuadTreeQuadrant>> fromChild = children[i]->get_all_leaf_paths();
-				out.insert(out.end(), fromChild.begin(), fromChild.end());
-			}
-			else
-			{
-				out.push_back(children[i]->get_path());
-			}
-		}
-		else
-		{
-			out.push_back(get_path());
-			return out;
-		}
+		children[i]->get_all_leaf_paths(out);
 	}
-
-
-	return out;
 }
 
-std::vector<QuadTreeNode*> QuadTreeNode::get_all()
+void QuadTreeNode::get_all(std::vector<QuadTreeNode*>& out)
 {
-	std::vector<QuadTreeNode*> out;
-
 	if (has_children())
 	{
 		for (size_t i = 0; i < 4; i++)
 		{
-			std::vector<QuadTreeNode*> from_child = children[0]->get_all();
-			out.insert(out.end(), from_child.begin(), from_child.end());
+			children[i]->get_all(out);
 		}
 	}
 
 	out.push_back(this);
-
-	return out;
 }
 
-std::vector<std::vector<QuadTreeQuadrant>> QuadTreeNode::get_all_paths() const
+void QuadTreeNode::get_all_paths(std::vector<PlanetTilePath>& out) const
 {
-	std::vector<std::vector<QuadTreeQuadrant>> out;
-
 	if (has_children())
 	{
 		for (size_t i = 0; i < 4; i++)
 		{
-			std::vector<std::vector<QuadTreeQuadrant>> fromChild = children[i]->get_all_paths();
-			out.insert(out.end(), fromChild.begin(), fromChild.end());
+			children[i]->get_all_paths(out);
 		}
 	}
 
 	out.push_back(get_path());
-
-	return out;
 }
 
-QuadTreeNode* QuadTreeNode::follow_path(std::vector<QuadTreeQuadrant> path)
+QuadTreeNode* QuadTreeNode::follow_path(const PlanetTilePath& path)
 {
-	if (path.size() == 0)
+	QuadTreeNode* node = this;
+	for (size_t i = 0; i < path.get_depth(); i++)
 	{
-		return this;
+		node = node->children[path.get_quadrant(i)];
 	}
-	else
-	{
-		std::vector<QuadTreeQuadrant> subpath = path;
-		subpath.erase(subpath.begin());
 
-		return children[path[0]]->follow_path(subpath);
-	}
+	return node;
 }
 
 QuadTreeNode::QuadTreeNode()
 {
+	pool = nullptr;
+	changes = nullptr;
 	depth = 0;
 	min_point = glm::dvec2(0.0, 0.0);
 	size = 1.0;
@@ -574,6 +560,8 @@ QuadTreeNode::QuadTreeNode()
 
 QuadTreeNode::QuadTreeNode(QuadTreeNode* n_nbor, QuadTreeNode* e_nbor, QuadTreeNode* s_nbor, QuadTreeNode* w_nbor) : parent(NULL)
 {
+	pool = nullptr;
+	changes = nullptr;
 	depth = 0;
 	min_point = glm::dvec2(0.0, 0.0);
 	size = 1.0;
@@ -593,6 +581,8 @@ QuadTreeNode::QuadTreeNode(QuadTreeNode* p, QuadTreeQuadrant quad) : parent(p)
 {
 	this->quad = quad;
 	this->planetside = p->planetside;
+	this->pool = p->pool;
+	this->changes = p->changes;
 
 	children[0] = NULL; children[1] = NULL; children[2] = NULL; children[3] = NULL;
 
@@ -695,7 +685,7 @@ void QuadTreeNode::draw_gui(int SCL, PlanetTileServer* server)
 	{
 		if (server)
 		{
-			PlanetTilePath path = PlanetTilePath(get_path(), planetside);
+			PlanetTilePath path = get_path();
 
 			{
 				auto server_tiles = server->tiles.try_get();
@@ -3,8 +3,11 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "QuadTreeDefines.h"
+#include "../mesher/PlanetTilePath.h"
 
 class PlanetTileServer;
+class QuadTreeNodePool;
+class QuadTreeChanges;
 
 class QuadTreeNode
 {
@@ -35,6 +38,12 @@ public:
 	// Parent
 	QuadTreeNode* parent;
 
+	// Children are allocated from here, inherited from the parent.
+	// If nullptr, new and delete are used
+	QuadTreeNodePool* pool;
+	// Splits and merges are reported here, inherited from the parent. Can be nullptr
+	QuadTreeChanges* changes;
+
 	// Patch (Renderable mesh)
 
 
@@ -72,6 +81,10 @@ public:
 
 	void obtain_neighbors(QuadTreeQuadrant quad, bool nosplit = false);
 
+	// Makes sure every neighbor (diagonals included) exists at our depth, so
+	// we can be split without breaking the balance of the tree
+	void obtain_all_neighbors();
+
 	// Draws a "widget" of the subdivided quad tree nodes
 	void draw_gui(int guiSize, PlanetTileServer* server);
 
@@ -79,22 +92,25 @@ public:
 
 	bool touches_any_edge();
 
-	// Gets the path to this quad tree node, from its parent to the node
+	// Gets the path to this quad tree node, from the root of the side to the node
 	// For example, a node may be {NW, NW, NE}, the first quadrant is the 
-	// root, second is parent of the parent and last is the parent
-	std::vector<QuadTreeQuadrant> get_path() const;
+	// child of the root, second is its child and last is the node itself
+	PlanetTilePath get_path() const;
+
+	// The get_all functions append to out, so buffers can be reused
 
-	// Gets all nodes with no children, sons of this node
-	std::vector<QuadTreeNode*> get_all_leaf_nodes();
+	// Gets all nodes with no children, sons of this node (or us if we are a leaf)
+	void get_all_leaf_nodes(std::vector<QuadTreeNode*>& out);
 
-	std::vector<std::vector<QuadTreeQuadrant>> get_all_leaf_paths() const;
+	void get_all_leaf_paths(std::vector<PlanetTilePath>& out) const;
 
-	std::vector<QuadTreeNode*> get_all();
+	void get_all(std::vector<QuadTreeNode*>& out);
 
-	std::vector<std::vector<QuadTreeQuadrant>> get_all_paths() const;
+	void get_all_paths(std::vector<PlanetTilePath>& out) const;
 
 
-	QuadTreeNode* follow_path(std::vector<QuadTreeQuadrant> path); 
+	// The path must be of our side and we must be the root
+	QuadTreeNode* follow_path(const PlanetTilePath& path);
 
 	QuadTreeNode();
 	QuadTreeNode(QuadTreeNode* n_nbor, QuadTreeNode* e_nbor, QuadTreeNode* s_nbor, QuadTreeNode* w_nbor);
@@ -0,0 +1,54 @@
+#include "QuadTreeNodePool.h"
+#include <new>
+
+QuadTreeNode* QuadTreeNodePool::allocate_children(QuadTreeNode* parent)
+{
+	if (free_groups.empty())
+	{
+		Group* block = new Group[GROUPS_PER_BLOCK];
+		blocks.push_back(block);
+
+		// Reversed so groups are handed out in memory order
+		for (size_t i = GROUPS_PER_BLOCK; i > 0; i--)
+		{
+			free_groups.push_back(&block[i - 1]);
+		}
+	}
+
+	Group* group = free_groups.back();
+	free_groups.pop_back();
+	used_groups++;
+
+	QuadTreeNode* nodes = reinterpret_cast<QuadTreeNode*>(group->data);
+	for (size_t i = 0; i < 4; i++)
+	{
+		new (&nodes[i]) QuadTreeNode(parent, (QuadTreeQuadrant)i);
+	}
+
+	return nodes;
+}
+
+void QuadTreeNodePool::free_children(QuadTreeNode* children)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		children[i].~QuadTreeNode();
+	}
+
+	free_groups.push_back(reinterpret_cast<Group*>(children));
+	used_groups--;
+}
+
+QuadTreeNodePool::QuadTreeNodePool()
+{
+	used_groups = 0;
+}
+
+QuadTreeNodePool::~QuadTreeNodePool()
+{
+	// Every node must have been merged by now (the tree goes before us)
+	for (Group* block : blocks)
+	{
+		delete[] block;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include "QuadTreeNode.h"
+
+// Children of quadtree nodes are always created and destroyed 4 at a time,
+// so they are stored together in big blocks which never move (nodes link to
+// each other by pointer). Freed groups go to a free list and are reused, so
+// once the tree has been deep once, splitting and merging doesn't touch the heap.
+class QuadTreeNodePool
+{
+private:
+
+	static const size_t GROUPS_PER_BLOCK = 256;
+
+	struct alignas(QuadTreeNode) Group
+	{
+		unsigned char data[sizeof(QuadTreeNode) * 4];
+	};
+
+	std::vector<Group*> blocks;
+	std::vector<Group*> free_groups;
+
+	size_t used_groups;
+
+public:
+
+	// Constructs the 4 children of parent, in quadrant order
+	QuadTreeNode* allocate_children(QuadTreeNode* parent);
+	// Takes what allocate_children returned, destroys the nodes (merging them first)
+	void free_children(QuadTreeNode* children);
+
+	size_t get_used_nodes() const { return used_groups * 4; }
+	size_t get_capacity_nodes() const { return blocks.size() * GROUPS_PER_BLOCK * 4; }
+
+	QuadTreeNodePool();
+	~QuadTreeNodePool();
+
+	QuadTreeNodePool(const QuadTreeNodePool&) = delete;
+	QuadTreeNodePool& operator=(const QuadTreeNodePool&) = delete;
+};
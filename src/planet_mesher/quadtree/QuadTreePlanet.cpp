@@ -1,4 +1,5 @@
 #include <cmath>
+#include <algorithm>
 
 #include "QuadTreePlanet.h"
 #include "imgui/imgui.h"
@@ -8,6 +9,14 @@
 
 using namespace std;
 
+// The view is only taken (and the tree updated) once the camera moves this much
+// relative to its distance to the terrain, or the pixel scale changes this much
+static constexpr double VIEW_MOVE_THRESHOLD = 0.02;
+static constexpr double VIEW_SCALE_THRESHOLD = 0.02;
+// Parents are merged once their error is this much under max_error, so
+// nodes near the threshold don't split and merge as the camera moves
+static constexpr double MERGE_HYSTERESIS = 0.75;
+
 void QuadTreePlanet::flatten()
 {
 	for (size_t i = 0; i < 6; i++)
@@ -16,62 +25,48 @@ void QuadTreePlanet::flatten()
 	}
 }
 
-std::vector<PlanetTilePath> QuadTreePlanet::get_all_render_leaf_paths(bool ignore_cache)
+const std::vector<PlanetTilePath>& QuadTreePlanet::get_all_render_leaf_paths(bool ignore_cache)
 {
 	if (iteration == old_render_leafs_it && !ignore_cache)
 	{
 		return old_render_leafs;
 	}
 
-	std::vector<PlanetTilePath> out;
-
-
+	old_render_leafs.clear();
 	for (size_t i = 0; i < 6; i++)
 	{
-		std::vector<std::vector<QuadTreeQuadrant>> from_side = render_sides[i].get_all_leaf_paths();
-		for (size_t j = 0; j < from_side.size(); j++)
-		{
-			out.push_back(PlanetTilePath(from_side[j], PlanetSide(i)));
-		}
+		render_sides[i].get_all_leaf_paths(old_render_leafs);
 	}
 
-	old_render_leafs = out;
 	old_render_leafs_it = iteration;
 
-	return out;
+	return old_render_leafs;
 }
 
-std::vector<QuadTreeNode*> QuadTreePlanet::get_all_leafs()
+void QuadTreePlanet::get_all_leafs(std::vector<QuadTreeNode*>& out)
 {
-	std::vector<QuadTreeNode*> out;
-
+	out.clear();
 	for (size_t i = 0; i < 6; i++)
 	{
-		std::vector<QuadTreeNode*> from_side = sides[i].get_all_leaf_nodes();
-		out.insert(out.end(), from_side.begin(), from_side.end());
+		sides[i].get_all_leaf_nodes(out);
 	}
-
-	return out;
 }
 
-std::vector<PlanetTilePath> QuadTreePlanet::get_all_paths() const
+void QuadTreePlanet::get_all_paths(std::vector<PlanetTilePath>& out) const
 {
-	std::vector<PlanetTilePath> out;
-
+	out.clear();
 	for (size_t i = 0; i < 6; i++)
 	{
-		std::vector<std::vector<QuadTreeQuadrant>> from_side = sides[i].get_all_paths();
-		for (size_t j = 0; j < from_side.size(); j++)
-		{
-			out.push_back(PlanetTilePath(from_side[j], PlanetSide(i)));
-		}
+		sides[i].get_all_paths(out);
 	}
+}
 
-
-	return out;
+void QuadTreePlanet::take_changes(std::vector<PlanetTilePath>& added, std::vector<PlanetTilePath>& removed)
+{
+	changes.take(added, removed);
 }
 
-PlanetSide QuadTreePlanet::get_planet_side(glm::vec3 f) const
+PlanetSide QuadTreePlanet::get_planet_side(glm::vec3 f)
 {
 	float xabs = glm::abs(f.x);
 	float yabs = glm::abs(f.y);
@@ -96,7 +91,7 @@ PlanetSide QuadTreePlanet::get_planet_side(glm::vec3 f) const
 	return PX;
 }
 
-glm::dvec2 QuadTreePlanet::get_planet_side_offset(glm::vec3 point_normalized, PlanetSide side) const
+glm::dvec2 QuadTreePlanet::get_planet_side_offset(glm::vec3 point_normalized, PlanetSide side)
 {
 	glm::dvec3 cube = MathUtil::sphere_to_cube(point_normalized);
 
@@ -149,129 +144,265 @@ glm::dvec2 QuadTreePlanet::get_planet_side_offset(glm::vec3 point_normalized, Pl
 	}
 }
 
-void QuadTreePlanet::set_wanted_subdivide(glm::dvec2 offset, PlanetSide side, size_t depth)
+void QuadTreePlanet::set_view(glm::dvec3 camera, double pixel_scale)
 {
-	previous_depth = current_depth;
+	// Screen errors go with the inverse of the distance, the closest node can't
+	// be closer than the highest terrain or the spacing of the deepest tile
+	double min_spacing = glm::half_pi<double>() / (double)(1ull << lod.max_depth) / (double)(PlanetTile::TILE_SIZE - 1);
+	double dist = glm::max(glm::length(view_camera) - (1.0 - lod.max_height), min_spacing);
 
-	dirty = true;
+	bool moved = glm::distance(camera, view_camera) > dist * VIEW_MOVE_THRESHOLD;
+	bool scaled = glm::abs(pixel_scale - view_pixel_scale) > view_pixel_scale * VIEW_SCALE_THRESHOLD;
 
-	if (current_depth > depth)
+	if (moved || scaled)
 	{
-		current_depth = depth;
+		view_camera = camera;
+		view_pixel_scale = pixel_scale;
+		dirty = true;
 	}
-
-	wanted_pos = offset;
-	wanted_side = side;
-	wanted_depth = depth;
 }
 
-
-void QuadTreePlanet::update(PlanetTileServer& server)
+double QuadTreePlanet::get_screen_error(const QuadTreeNode* node) const
 {
-	if (current_depth <= wanted_depth)
-	{
-		if (server.is_built())
-		{
-			flatten();
+	PlanetTilePath path = node->get_path();
+	double size = glm::half_pi<double>() * path.get_size();
+	double spacing = size / (double)(PlanetTile::TILE_SIZE - 1);
 
+	glm::dvec3 center_cubic = path.get_model_matrix() * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+	glm::dvec3 center = glm::normalize(MathUtil::cube_to_sphere(center_cubic));
+	// Rough bounding sphere, tall enough for any mountain in the node
+	double radius = size * 0.75 + lod.max_height;
 
-			sides[wanted_side].get_recursive(wanted_pos, current_depth);
+	// Valleys may go below sea level, so the occluder is shrunk a bit too
+	if (MathUtil::is_below_horizon(view_camera, 1.0 - lod.max_height, center, radius))
+	{
+		return 0.0;
+	}
 
+	double dist = glm::max(glm::distance(center, view_camera) - radius, spacing);
 
-			// Go for next step
-			current_depth++;
-			iteration++;
+	return spacing * view_pixel_scale / dist;
+}
 
-			dirty = true;
-		}
-	}
+void QuadTreePlanet::push_refine(QuadTreeNode* node)
+{
+	refine_heap.emplace_back(get_screen_error(node), node);
+	std::push_heap(refine_heap.begin(), refine_heap.end());
+}
 
-	for (size_t i = 0; i < 6; i++)
+// Neighbors are only obtained when a node is created or split, so they may point
+// to nodes shallower than what's there now. Going from the roots every node gets
+// its neighbor of the same depth, or the leaf covering it
+static void refresh_neighbors(QuadTreeNode* node)
+{
+	if (!node->has_children())
 	{
-		render_sides[i].merge();
+		return;
 	}
 
-	render_sides[wanted_side].get_recursive(wanted_pos, current_depth - 1);
+	for (size_t i = 0; i < 4; i++)
+	{
+		node->children[i]->obtain_neighbors(node->children[i]->quad, true);
+	}
 
-	// render_sides merges every parent of ANY NON LOADED CHILDREN
-	for (size_t i = 0; i < 6; i++)
+	for (size_t i = 0; i < 4; i++)
 	{
-		std::vector<QuadTreeNode*> all_leafs = render_sides[i].get_all_leaf_nodes();
+		refresh_neighbors(node->children[i]);
+	}
+}
 
-		std::vector<QuadTreeNode*> to_merge;
+bool QuadTreePlanet::can_merge(QuadTreeNode* node)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		QuadTreeNode* child = node->children[i];
+		if (child->has_children())
+		{
+			return false;
+		}
 
-		for (size_t j = 0; j < all_leafs.size(); j++)
+		for (size_t j = 0; j < 4; j++)
 		{
-			PlanetTilePath path = PlanetTilePath(all_leafs[j]->get_path(), all_leafs[j]->planetside);
-			bool found = true;
+			QuadTreeNode* nbor = child->neighbors[j];
+			if (nbor->depth != child->depth || nbor->parent == node)
 			{
-				auto tiles_m = server.tiles.get();
-				auto it = tiles_m->find(path);
-				if (it == tiles_m->end())
-				{
-					found = false;
-				}
+				continue;
 			}
 
-			if (!found)
+			// Same for diagonals, the tree must stay balanced once we are gone
+			if (nbor->has_children())
 			{
-				if (path.path.size() != 0)
-				{
-					path.path.pop_back();
-				}
-
-				// path is now the parent
-				QuadTreeNode* parent = render_sides[i].follow_path(path.path);
-				bool good = true;
-
-				// Check that renderer has parent, if it does not then we moved too far, reduce quality
-				{
-					auto tiles_m = server.tiles.get();
-					if (tiles_m->find(path) == tiles_m->end())
-					{
-						// Horror, we moved too far, the user will be over low quality terrain
-						good = false;
-					}
-				}
+				return false;
+			}
 
-				if (good)
+			for (size_t k = 0; k < 4; k++)
+			{
+				if (nbor->neighbors[k]->depth == child->depth && nbor->neighbors[k]->has_children())
 				{
-					to_merge.push_back(parent);
+					return false;
 				}
 			}
 		}
+	}
+
+	return true;
+}
+
+bool QuadTreePlanet::merge_coarse(QuadTreeNode* node)
+{
+	if (!node->has_children())
+	{
+		return false;
+	}
 
-		// Make sure we only have parents in the list
-		// otherwise we will try to merge nodes which
-		// have been deleted (This can happen on very fast movement)
-		// This ends up being quite fast, not only is to_merge
-		// generally a small vector, but the is_children_of function
-		// returns very early on most cases.
-		// Don't bother removing this, it's the easy solution
-		std::vector<int> to_ignore;
-		to_ignore.resize(to_merge.size(), false);
-
-		for (size_t i = 0; i < to_merge.size(); i++)
+	bool merged = false;
+	for (size_t i = 0; i < 4; i++)
+	{
+		merged |= merge_coarse(node->children[i]);
+	}
+
+	if (get_screen_error(node) >= lod.max_error * MERGE_HYSTERESIS || !can_merge(node))
+	{
+		return merged;
+	}
+
+	// Leafs next to us would keep pointing to the children, nothing deeper
+	// may point to them as it can_merge
+	for (size_t i = 0; i < 4; i++)
+	{
+		QuadTreeNode* child = node->children[i];
+		for (size_t j = 0; j < 4; j++)
 		{
-			for (size_t j = 0; j < to_merge.size(); j++)
+			QuadTreeNode* nbor = child->neighbors[j];
+			for (size_t k = 0; k < 4; k++)
 			{
-				if (i != j)
+				if (nbor->neighbors[k] == child)
 				{
-					if (to_merge[i]->is_children_of(to_merge[j]))
-					{
-						to_ignore[i] = true;
-					}
+					nbor->neighbors[k] = node;
 				}
 			}
 		}
+	}
+
+	node->merge();
+	return true;
+}
+
+void QuadTreePlanet::refine()
+{
+	for (size_t i = 0; i < 6; i++)
+	{
+		refresh_neighbors(&sides[i]);
+	}
+
+	// Merging may allow merging neighbors which were already visited
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t i = 0; i < 6; i++)
+		{
+			merged |= merge_coarse(&sides[i]);
+		}
+	}
+
+	refine_heap.clear();
+	get_all_leafs(refine_leafs);
+	for (QuadTreeNode* node : refine_leafs)
+	{
+		push_refine(node);
+	}
+
+	last_max_error = 0.0;
+
+	while (!refine_heap.empty())
+	{
+		std::pop_heap(refine_heap.begin(), refine_heap.end());
+		std::pair<double, QuadTreeNode*> worst = refine_heap.back();
+		refine_heap.pop_back();
+
+		if (worst.first <= lod.max_error)
+		{
+			// Everything else looks good enough
+			break;
+		}
+
+		QuadTreeNode* node = worst.second;
+		if (node->depth >= lod.max_depth)
+		{
+			continue;
+		}
 
-		for (size_t i = 0; i < to_merge.size(); i++)
+		// The node may have been split already to keep a neighbor balanced
+		if (!node->has_children())
 		{
-			if (to_ignore[i] == false)
+			// Roots are not in the pool, and balancing may go a bit over, that's fine
+			if (pool.get_used_nodes() + 4 > lod.max_nodes)
 			{
-				to_merge[i]->merge();
+				last_max_error = worst.first;
+				break;
 			}
+
+			node->obtain_all_neighbors();
+			node->split();
+		}
+
+		for (size_t i = 0; i < 4; i++)
+		{
+			push_refine(node->children[i]);
+		}
+	}
+}
+
+// Children are only copied if all of them are uploaded, otherwise
+// we draw the parent until they are ready
+static void copy_to_render(const QuadTreeNode* from, QuadTreeNode* to, const PlanetTileServer::TileMap& tiles)
+{
+	if (!from->has_children())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (tiles.find(from->children[i]->get_path()) == tiles.end())
+		{
+			return;
+		}
+	}
+
+	to->split(false);
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		copy_to_render(from->children[i], to->children[i], tiles);
+	}
+}
+
+void QuadTreePlanet::update(PlanetTileServer& server)
+{
+	for (size_t i = 0; i < 6; i++)
+	{
+		render_sides[i].merge();
+	}
+
+	if (dirty)
+	{
+		// Changes which cancel out are never seen by the server (see QuadTreeChanges)
+		refine();
+		last_nodes = pool.get_used_nodes() + 6;
+
+		if (!changes.empty())
+		{
+			iteration++;
 		}
+
+		dirty = false;
+	}
+
+	for (size_t i = 0; i < 6; i++)
+	{
+		copy_to_render(&sides[i], &render_sides[i], server.get_uploaded_tiles());
 	}
 }
 
@@ -283,17 +414,26 @@ QuadTreeNode* QuadTreePlanet::subdivide_to(glm::dvec2 offset, PlanetSide side, s
 QuadTreePlanet::QuadTreePlanet()
 {
 	iteration = 0;
+	old_render_leafs_it = UINT64_MAX;
 
 	for (size_t i = 0; i < 6; i++)
 	{
 		sides[i] = QuadTreeNode();
+		sides[i].pool = &pool;
+		sides[i].changes = &changes;
+		render_sides[i].pool = &pool;
 	}
 
-	current_depth = 0;
-	previous_depth = 0;
-	wanted_depth = 0;
-	wanted_pos = glm::dvec2(0.5, 0.5);
-	wanted_side = PX;
+	view_camera = glm::dvec3(0.0, 0.0, 0.0);
+	view_pixel_scale = 0.0;
+	last_nodes = 6;
+	last_max_error = 0.0;
+	dirty = true;
+
+	lod.max_error = 4.0;
+	lod.max_depth = 0;
+	lod.max_nodes = 1024;
+	lod.max_height = 0.0;
 
 	// Cardinal directions have no meaning!
 	sides[PX].neighbors[NORTH] = &sides[PY];
@@ -444,7 +584,10 @@ void QuadTreePlanet::do_imgui(PlanetTileServer* server)
 	render_sides[NZ].draw_gui(SIZE - 1, server);
 	ImGui::EndChild();
 
-	ImGui::Text("Wanted Depth: %i", (int)wanted_depth);
+	ImGui::Text("Wanted nodes: %i / %i", (int)last_nodes, (int)lod.max_nodes);
+	// Over max_error means we ran out of nodes
+	ImGui::Text("Remaining error: %.2fpx", last_max_error);
+	ImGui::Text("Nodes: %i / %i", (int)pool.get_used_nodes(), (int)pool.get_capacity_nodes());
 
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 #include "QuadTreeDefines.h"
 #include "QuadTreeNode.h"
+#include "QuadTreeNodePool.h"
+#include "QuadTreeChanges.h"
 #include "../mesher/PlanetTilePath.h"
 #include <util/MathUtil.h>
 
@@ -16,55 +18,103 @@ class QuadTreePlanet
 {
 private:
 
-	glm::dvec2 wanted_pos;
-	PlanetSide wanted_side;
-	size_t wanted_depth;
-
-	size_t current_depth;
-
-	size_t previous_depth = 0;
+	// Must go before the nodes, so they are destroyed after them
+	QuadTreeNodePool pool;
+	// Only tracks sides, not render_sides
+	QuadTreeChanges changes;
 
 	QuadTreeNode render_sides[6];
 
 	uint64_t old_render_leafs_it;
 	std::vector<PlanetTilePath> old_render_leafs;
 
+	// See set_view
+	glm::dvec3 view_camera;
+	double view_pixel_scale;
+
+	// Leafs waiting to be split, as a heap on the screen-space error
+	std::vector<std::pair<double, QuadTreeNode*>> refine_heap;
+	std::vector<QuadTreeNode*> refine_leafs;
+
+	// Stats of the last update, for imgui
+	size_t last_nodes;
+	double last_max_error;
+
+	// Projected error (in pixels) of the node, 0 if it's hidden by the horizon
+	double get_screen_error(const QuadTreeNode* node) const;
+
+	void push_refine(QuadTreeNode* node);
+
+	// Children must be leafs, and so must be their neighbors, diagonals included
+	bool can_merge(QuadTreeNode* node);
+
+	// Merges, from the bottom, every parent which looks good enough. Returns true
+	// if anything was merged
+	bool merge_coarse(QuadTreeNode* node);
+
+	// Updates the wanted tree, merging what is now too detailed and then
+	// splitting the worst leafs first
+	void refine();
+
 public:
 
+	struct LODSettings
+	{
+		// Nodes are split while the distance between their vertices, projected
+		// to the screen, is over this many pixels
+		double max_error;
+		size_t max_depth;
+		// Maximum number of nodes in the tree, once reached the rest stay coarse
+		size_t max_nodes;
+		// Maximum height of the terrain, relative to the radius, to bound the nodes
+		double max_height;
+	};
+
+	LODSettings lod;
+
 	// Used as an optimization so that get_leafs functions
 	// store the previous result, if nothing changed
 	uint64_t iteration;
 
-	// TODO: Automatically set dirty flag
+	// Set by set_view once the view changed enough, the wanted tree is only updated if set
 	bool dirty;
 
 	void flatten();
 
 	QuadTreeNode sides[6];
 	
-	std::vector<PlanetTilePath> get_all_render_leaf_paths(bool ignore_cache = false);
+	// The returned list is kept until the next call
+	const std::vector<PlanetTilePath>& get_all_render_leaf_paths(bool ignore_cache = false);
 
 	// Recursively obtains all leafs from all sides, don't hold the
-	// pointers for too long
-	std::vector<QuadTreeNode*> get_all_leafs();
+	// pointers for too long. out is cleared first
+	void get_all_leafs(std::vector<QuadTreeNode*>& out);
+
+	// Converts the pointers to paths, out is cleared first
+	void get_all_paths(std::vector<PlanetTilePath>& out) const;
 
-	// Converts the pointers to paths
-	std::vector<PlanetTilePath> get_all_paths() const;
+	// Nodes of sides created and destroyed since the last call, appended to added
+	// and removed. Start from get_all_paths, as the root nodes are never reported
+	void take_changes(std::vector<PlanetTilePath>& added, std::vector<PlanetTilePath>& removed);
 
 
 	// Gets the planet side a point is on from its normalized,
 	// relative to the planet center, coordinates
-	PlanetSide get_planet_side(glm::vec3 point_normalized) const;
+	static PlanetSide get_planet_side(glm::vec3 point_normalized);
 
 	// Gets planet side offset given a point and the side it's contained in
 	// (get it via get_planet_side)
-	glm::dvec2 get_planet_side_offset(glm::vec3 point_normalized, PlanetSide side) const;
+	static glm::dvec2 get_planet_side_offset(glm::vec3 point_normalized, PlanetSide side);
 
-	void set_wanted_subdivide(glm::dvec2 offset, PlanetSide side, size_t depth);
+	// camera is relative to the planet (not rotated) and in planet radii, pixel_scale
+	// is the screen height over 2 * tan(fov / 2), so sizes at a distance can be
+	// converted to pixels. Small changes are ignored, call every frame
+	void set_view(glm::dvec3 camera, double pixel_scale);
 
 	void do_imgui(PlanetTileServer* server);
 
-	// Tries to update subdivision, if the server has finished building
+	// Subdivides the whole surface based on the view, the render tree
+	// follows as the tiles are generated
 	void update(PlanetTileServer& server);
 	
 	// Not used by the rendering code, but by physics
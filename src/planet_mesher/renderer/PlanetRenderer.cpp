@@ -5,6 +5,41 @@
 #include <util/DebugDrawer.h>
 #include <imgui/imgui.h>
 #include <renderer/Renderer.h>
+#include "../mesher/PlanetTileArena.h"
+#include <glm/gtc/matrix_access.hpp>
+
+// Side planes of the frustum (near and far are useless with our log depth),
+// normalized so the distance to them can be compared with a radius
+static std::array<glm::dvec4, 4> get_frustum_planes(const glm::dmat4& m)
+{
+	std::array<glm::dvec4, 4> planes =
+	{
+		glm::row(m, 3) + glm::row(m, 0),
+		glm::row(m, 3) - glm::row(m, 0),
+		glm::row(m, 3) + glm::row(m, 1),
+		glm::row(m, 3) - glm::row(m, 1)
+	};
+
+	for (glm::dvec4& plane : planes)
+	{
+		plane /= glm::length(glm::dvec3(plane));
+	}
+
+	return planes;
+}
+
+static bool is_outside_frustum(const std::array<glm::dvec4, 4>& planes, glm::dvec3 center, double radius)
+{
+	for (const glm::dvec4& plane : planes)
+	{
+		if (glm::dot(glm::dvec3(plane), center) + plane.w < -radius)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
 
 void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 							const PlanetRenderer::PlanetRenderTforms &tforms, ElementConfig &config)
@@ -13,15 +48,10 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 	planet.do_imgui(nullptr);
 	ImGui::End();*/
 
-	auto render_tiles = planet.get_all_render_leaf_paths();
+	render_tiles = planet.get_all_render_leaf_paths();
 
-	// Renderer really needs the tiles so some tiny
-	// lags could be noticed by the user if there is
-	// a thread that happens to be pushing a new tile
-	//
-	// TODO: Test another configuration with the mutex lock
-	// inside the loop so we expend less time locked
-	// at the cost of having to lock every iteration
+	// Only changes in the server update, so there's nothing to lock
+	const PlanetTileServer::TileMap& tiles = server.get_uploaded_tiles();
 	{
 		float detail_scale = 2000.0f;
 		float detail_fade = 45000.0f;
@@ -29,8 +59,6 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 		float triplanar_y_mult = 0.28f;
 		float triplanar_power = 4.0f;
 
-		auto tiles_w = server.tiles.get();
-
 		shader->use();
 		shader->setFloat("f_coef", 2.0f / glm::log2(tforms.far_plane + 1.0f));
 		shader->setVec3("camera_pos", (glm::vec3)(tforms.camera_pos / config.radius));
@@ -68,7 +96,7 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			shader->setInt("cliff_nrm", 3);
 		}
 
-		bool cw_mode = false;
+		// Clockwise tiles use the reversed copy of the indices instead
 		glFrontFace(GL_CCW);
 
 		if(osp->renderer->quality.use_planet_detail_normal || osp->renderer->quality.use_planet_detail_map)
@@ -99,76 +127,126 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			shader->setMat4("inverse_tri_nrm_matrix", glm::inverse(tri_normal_matrix));
 		}
 
-        // improves the drawing order by sorting the list of tiles in ascending order of their distance from the camera
-        // could alternatively use `std::stable_sort` function instead of `std::sort` (ocean and non-ocean tiles)
-        std::sort(render_tiles.begin(), render_tiles.end(), [&](auto &a, auto &b)
+		// Cull in planet coordinates (unit radius, not rotated). The terrain we are seeing
+		// hides whatever is behind its lowest point, which is a safe occluder
+		glm::dvec3 camera = glm::inverse(tforms.wmodel) * glm::dvec4(0.0, 0.0, 0.0, 1.0);
+		std::array<glm::dvec4, 4> planes = get_frustum_planes(tforms.proj_view * tforms.wmodel);
+		double occluder_radius = 1.0;
+		for (const PlanetTilePath& path : render_tiles)
 		{
-             return a.get_depth() > b.get_depth();
-		});
+			auto it = tiles.find(path);
+			if (it != tiles.end())
+			{
+				occluder_radius = glm::min(occluder_radius, 1.0 + (double)it->second->min_height);
+			}
+		}
 
+		frustum_culled = 0;
+		horizon_culled = 0;
+		size_t visible = 0;
 		for (size_t i = 0; i < render_tiles.size(); i++)
 		{
-			auto it = tiles_w->find(render_tiles[i]);
-			if (it == tiles_w->end())
+			auto it = tiles.find(render_tiles[i]);
+			if (it == tiles.end())
 			{
-				// Really should not happen on normal
-				// gameplay, but it can happen when a 
-				// very sharp LOD change happens
-				// For example, teleporting to a surface
-				// Visually, it probably is a small flicker
 				continue;
 			}
-			auto tile = it->second;
-			auto path = it->first;
-
-			glm::dmat4 model = path.get_model_spheric_matrix();
-			// We also apply the camera tform, used by the deferred renderer
-			glm::dmat4 deferred_model = tforms.wmodel * model;
 
-			if (!tile->is_uploaded())
+			const PlanetTile* tile = it->second;
+			if (is_outside_frustum(planes, tile->bound_center, tile->bound_radius))
 			{
+				frustum_culled++;
 				continue;
 			}
 
-			if (tile->clockwise && !cw_mode)
+			if (MathUtil::is_below_horizon(camera, occluder_radius, tile->bound_center, tile->bound_radius))
 			{
-				glFrontFace(GL_CW);
-				cw_mode = true;
-			}
-
-			if (!tile->clockwise && cw_mode)
-			{
-				glFrontFace(GL_CCW);
-				cw_mode = false;
+				horizon_culled++;
+				continue;
 			}
 
+			render_tiles[visible++] = render_tiles[i];
+		}
+		render_tiles.resize(visible);
+		drawn_tiles = visible;
 
+        // improves the drawing order by sorting the list of tiles in ascending order of their distance from the camera
+        // could alternatively use `std::stable_sort` function instead of `std::sort` (ocean and non-ocean tiles)
+        std::sort(render_tiles.begin(), render_tiles.end(), [&](auto &a, auto &b)
+		{
+             return a.get_depth() > b.get_depth();
+		});
 
+		// Build the draws of both passes, each is then a single multi-draw
+		draws.clear();
+		commands.clear();
+		for (const PlanetTilePath& path : render_tiles)
+		{
+			const PlanetTile* tile = tiles.at(path);
 
-			shader->setMat4("tform", (glm::mat4)(tforms.proj_view * tforms.wmodel * model));
-			shader->setMat4("m_tform", (glm::mat4)(deferred_model));
-			shader->setMat4("rotm_tform", (glm::mat4)(tforms.rot_tform * model));
+			glm::dmat4 model = path.get_model_spheric_matrix();
+			// We also apply the camera tform, used by the deferred renderer
+			glm::dmat4 deferred_model = tforms.wmodel * model;
 
-			glm::dvec3 tile_or = tforms.wmodel * model * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+			glm::dvec3 tile_or = deferred_model * glm::dvec4(0.5, 0.5, 0.0, 1.0);
 			// We use a reasonalbe distance to prevent gaps but also not show detail very far away
 			// to reduce GPU load
 			bool do_detail = glm::dot(tile_or, tile_or) < detail_fade * 20;
-			shader->setInt("do_detail", do_detail);
 
-			glm::vec3 tile_i = glm::vec3(path.get_min(), (float)path.get_depth());
+			TileDraw draw;
+			draw.tform = (glm::mat4)(tforms.proj_view * deferred_model);
+			draw.m_tform = (glm::mat4)deferred_model;
+			draw.rotm_tform = (glm::mat4)(tforms.rot_tform * model);
+			draw.tile = glm::vec4(path.get_min(), (float)path.get_depth(), 0.0f);
+			draw.pos_min = glm::vec4(tile->pos_min, 0.0f);
+			draw.pos_scale = glm::vec4(tile->pos_scale, 0.0f);
+			draw.info = glm::ivec4(tile->slot * PlanetTile::VERTEX_COUNT, do_detail ? 1 : 0, 0, 0);
 
-			shader->setVec3("tile", tile_i);
-			glBindVertexArray(vao);
-			glBindVertexBuffer(0, tile->vbo, 0, sizeof(PlanetTileVertex));
-			glBindVertexBuffer(1, uv_bo, 0, sizeof(glm::vec2));
-			glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-			glBindVertexArray(0);
+			add_draw(draw, tile->clockwise, indices.size(), tile->slot);
+		}
+		size_t land_draws = commands.size();
 
+		if (config.surface.has_water)
+		{
+			// Can be used for tides, or simple waves as we do here
+			double sfactor = 1.0 + sin(tforms.time * 0.3) * 0.000000025;
 
+			glm::dmat4 t_model = glm::dmat4(1.0f);
+			t_model = glm::scale(t_model, glm::dvec3(sfactor, sfactor, sfactor));
 
+			for (const PlanetTilePath& path : render_tiles)
+			{
+				const PlanetTile* tile = tiles.at(path);
+				if (!tile->has_water())
+				{
+					continue;
+				}
+
+				glm::dmat4 model = path.get_model_spheric_matrix();
+				glm::dmat4 deferred_model = tforms.wmodel * model;
+
+				TileDraw draw;
+				draw.tform = (glm::mat4)(tforms.proj_view * tforms.wmodel * t_model * model);
+				draw.m_tform = (glm::mat4)deferred_model;
+				draw.rotm_tform = (glm::mat4)(tforms.rot_tform * model);
+				draw.tile = glm::vec4(path.get_min(), (float)path.get_depth(), 0.0f);
+				draw.pos_min = glm::vec4(tile->water_pos_min, 0.0f);
+				draw.pos_scale = glm::vec4(tile->water_pos_scale, 0.0f);
+				draw.info = glm::ivec4(tile->water_slot * PlanetTile::VERTEX_COUNT, tile->clockwise ? 1 : 0, 0, 0);
+
+				add_draw(draw, tile->clockwise, bulk_index_count, tile->water_slot);
+			}
 		}
 
-		if (config.surface.has_water)
+		upload_draws();
+
+		shader->setInt("tile_size", PlanetTile::TILE_SIZE);
+		glBindVertexArray(vao);
+		glBindVertexBuffer(0, planet_tile_arena->get_buffer(), 0, sizeof(PlanetTileVertex));
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)land_draws, sizeof(DrawCommand));
+		glBindVertexArray(0);
+
+		if (commands.size() > land_draws)
 		{
 			// Draw water, another pass to only switch shaders once
 			water_shader->use();
@@ -182,124 +260,119 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			water_shader->setFloat("atmo_exponent", (float)config.atmo.exponent);
 			water_shader->setFloat("sunset_exponent", (float)config.atmo.sunset_exponent);
 			water_shader->setVec3("light_dir", tforms.light_dir);
+			water_shader->setInt("tile_size", PlanetTile::TILE_SIZE);
 
-			cw_mode = false;
-			glFrontFace(GL_CCW);
-			for (size_t i = 0; i < render_tiles.size(); i++)
-			{
-				auto it = tiles_w->find(render_tiles[i]);
-				if (it == tiles_w->end())
-				{
-					continue;
-				}
-				auto tile = it->second;
-				auto path = it->first;
-
-				glm::dmat4 model = path.get_model_spheric_matrix();
-				glm::dmat4 deferred_model = tforms.wmodel * model;
-
-				if (tile->water_vbo == 0)
-				{
-					continue;
-				}
-
-				if (tile->clockwise && !cw_mode)
-				{
-					glFrontFace(GL_CW);
-					cw_mode = true;
-				}
-
-				if (!tile->clockwise && cw_mode)
-				{
-					glFrontFace(GL_CCW);
-					cw_mode = false;
-				}
-
-				// Can be used for tides, or simple waves as we do here
-				double sfactor = 1.0 + sin(tforms.time * 0.3) * 0.000000025;
-
-				glm::dmat4 t_model = glm::dmat4(1.0f);
-				t_model = glm::scale(t_model, glm::dvec3(sfactor, sfactor, sfactor));
+			glBindVertexArray(water_vao);
+			glBindVertexBuffer(0, planet_water_arena->get_buffer(), 0, sizeof(PlanetTileWaterVertex));
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(land_draws * sizeof(DrawCommand)),
+				(GLsizei)(commands.size() - land_draws), sizeof(DrawCommand));
+			glBindVertexArray(0);
+		}
 
-				water_shader->setMat4("tform", (glm::mat4)(tforms.proj_view * tforms.wmodel * t_model * model));
-				water_shader->setMat4("deferred_tform", (glm::mat4)(deferred_model));
-				water_shader->setMat4("rotm_tform", (glm::mat4)(tforms.rot_tform * model));
-				water_shader->setInt("clockwise", tile->clockwise ? 1 : 0);
-			
-				glm::vec3 tile_i = glm::vec3(path.get_min(), (float)path.get_depth());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
 
-				water_shader->setVec3("tile", tile_i);
+}
 
-				glBindVertexArray(water_vao);
-				glBindVertexBuffer(0, tile->water_vbo, 0, sizeof(PlanetTileWaterVertex));
-				glBindVertexBuffer(1, uv_bo, 0, sizeof(glm::vec2));
-				glDrawElements(GL_TRIANGLES, (GLsizei)bulk_index_count, GL_UNSIGNED_SHORT, (void*)0);
-				glBindVertexArray(0);
+void PlanetRenderer::add_draw(const TileDraw& draw, bool clockwise, size_t index_count, uint32_t slot)
+{
+	DrawCommand command;
+	command.count = (GLuint)index_count;
+	command.instance_count = 1;
+	command.first_index = clockwise ? (GLuint)indices.size() : 0;
+	command.base_vertex = (GLint)(slot * PlanetTile::VERTEX_COUNT);
+	// Used to fetch the draw index (see draw_id_bo)
+	command.base_instance = (GLuint)draws.size();
+
+	draws.push_back(draw);
+	commands.push_back(command);
+}
 
-			}
+void PlanetRenderer::upload_draws()
+{
+	if (draws.size() > draw_id_capacity)
+	{
+		draw_id_capacity = glm::max(draws.size(), draw_id_capacity * 2);
+		std::vector<GLuint> ids;
+		ids.resize(draw_id_capacity);
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			ids[i] = (GLuint)i;
 		}
-		
+
+		glBindBuffer(GL_ARRAY_BUFFER, draw_id_bo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * ids.size(), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	glFrontFace(GL_CCW);
+	// Orphaned every frame
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TileDraw) * draws.size(), draws.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILE_DRAW_BINDING, draw_ssbo);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_bo);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * commands.size(), commands.data(), GL_STREAM_DRAW);
 }
 
+void PlanetRenderer::do_imgui()
+{
+	ImGui::Text("Drawn tiles: %i, culled: %i (frustum), %i (horizon)", (int)drawn_tiles,
+		(int)frustum_culled, (int)horizon_culled);
+}
 
 void PlanetRenderer::generate_and_upload_index_buffer()
 {
 	PlanetTile::generate_index_array_with_skirts(indices, bulk_index_count);
 
-	std::array<glm::vec2, PlanetTile::TILE_SIZE * PlanetTile::TILE_SIZE> uvs;
-
-	// Bulk UVs
-	for (size_t y = 0; y < PlanetTile::TILE_SIZE; y++)
+	// The second half has every triangle reversed, for clockwise tiles
+	std::array<uint16_t, PlanetTile::INDEX_COUNT * 2> all_indices;
+	for (size_t i = 0; i < indices.size(); i += 3)
 	{
-		for (size_t x = 0; x < PlanetTile::TILE_SIZE; x++)
-		{
-			uint16_t vi = (uint16_t)(y * PlanetTile::TILE_SIZE + x);
-
-			uvs[vi] = glm::vec2(
-				((double)x / (double)PlanetTile::TILE_SIZE) * 1000.0,
-				((double)y / (double)PlanetTile::TILE_SIZE) * 1000.0);
-
-		}
+		all_indices[i + 0] = indices[i + 0];
+		all_indices[i + 1] = indices[i + 1];
+		all_indices[i + 2] = indices[i + 2];
+		all_indices[indices.size() + i + 0] = indices[i + 1];
+		all_indices[indices.size() + i + 1] = indices[i + 0];
+		all_indices[indices.size() + i + 2] = indices[i + 2];
 	}
 
 	glGenVertexArrays(1, &vao);
 	glGenVertexArrays(1, &water_vao);
-	glGenBuffers(1, &uv_bo);
 	glGenBuffers(1, &ebo);
+	glGenBuffers(1, &draw_id_bo);
+	glGenBuffers(1, &draw_ssbo);
+	glGenBuffers(1, &indirect_bo);
+	draw_id_capacity = 0;
 
 	glBindVertexArray(vao);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, uv_bo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(uvs[0]) * uvs.size(), uvs.data(), GL_STATIC_DRAW);
-
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(all_indices[0]) * all_indices.size(), all_indices.data(), GL_STATIC_DRAW);
 
-	// position
+	// position (quantized to the tile bounds, see PlanetTileVertex)
 	glEnableVertexAttribArray(0);
-	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, pos));
+	glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PlanetTileVertex, pos));
 	glVertexAttribBinding(0, 0);
-	// normal
+	// normal (octahedral)
 	glEnableVertexAttribArray(1);
-	glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, nrm));
+	glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(PlanetTileVertex, nrm));
 	glVertexAttribBinding(1, 0);
 	// color
 	glEnableVertexAttribArray(2);
-	glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, col));
+	glVertexAttribFormat(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PlanetTileVertex, col));
 	glVertexAttribBinding(2, 0);
-	// Planet's global UV and texture chooser
+	// Planet's global UV
 	glEnableVertexAttribArray(3);
-	glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, planet_uv_tex));
+	glVertexAttribFormat(3, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PlanetTileVertex, planet_uv));
 	glVertexAttribBinding(3, 0);
 
-	// PBR sourced from buffer 1 (PBR pipeline)
+	// Draw index, one per instance (each draw has base_instance = its index)
 	glEnableVertexAttribArray(4);
-	glVertexAttribFormat(4, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribIFormat(4, 1, GL_UNSIGNED_INT, 0);
 	glVertexAttribBinding(4, 1);
+	glVertexBindingDivisor(1, 1);
+	glBindVertexBuffer(1, draw_id_bo, 0, sizeof(GLuint));
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -311,21 +384,23 @@ void PlanetRenderer::generate_and_upload_index_buffer()
 
 	// position
 	glEnableVertexAttribArray(0);
-	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, pos));
+	glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PlanetTileWaterVertex, pos));
 	glVertexAttribBinding(0, 0);
 	// normal
 	glEnableVertexAttribArray(1);
-	glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, nrm));
+	glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(PlanetTileWaterVertex, nrm));
 	glVertexAttribBinding(1, 0);
 	// depth
 	glEnableVertexAttribArray(2);
 	glVertexAttribFormat(2, 1, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, depth));
 	glVertexAttribBinding(2, 0);
 
-	// PBR sourced from buffer 1
-	glEnableVertexAttribArray(3);
-	glVertexAttribFormat(3, 2, GL_FLOAT, GL_FALSE, 0);
-	glVertexAttribBinding(3, 1);
+	// Draw index
+	glEnableVertexAttribArray(4);
+	glVertexAttribIFormat(4, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(4, 1);
+	glVertexBindingDivisor(1, 1);
+	glBindVertexBuffer(1, draw_id_bo, 0, sizeof(GLuint));
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -334,6 +409,10 @@ void PlanetRenderer::generate_and_upload_index_buffer()
 
 PlanetRenderer::PlanetRenderer()
 {
+	drawn_tiles = 0;
+	frustum_culled = 0;
+	horizon_culled = 0;
+
 	generate_and_upload_index_buffer();
 	shader = osp->assets->get<Shader>("core", "shaders/planet/tile.vs");
 	water_shader = osp->assets->get<Shader>("core", "shaders/planet/water.vs");
@@ -347,6 +426,10 @@ PlanetRenderer::PlanetRenderer()
 PlanetRenderer::~PlanetRenderer()
 {
 	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &draw_id_bo);
+	glDeleteBuffers(1, &draw_ssbo);
+	glDeleteBuffers(1, &indirect_bo);
 	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &water_vao);
 }
 
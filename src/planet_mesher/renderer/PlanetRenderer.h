@@ -19,20 +19,63 @@ private:
 	Shader* shader;
 	Shader* water_shader;
 
-	// The index buffer is common to all tiles
-	// The VAO is also shaded
+	// Per-draw data, read by the shaders from an SSBO (std430, keep in sync with tile_draw.vsi)
+	struct TileDraw
+	{
+		glm::mat4 tform;
+		glm::mat4 m_tform;
+		glm::mat4 rotm_tform;
+		// xy: tile min, z: depth
+		glm::vec4 tile;
+		glm::vec4 pos_min;
+		glm::vec4 pos_scale;
+		// x: first vertex in the arena, y: do_detail (land) or clockwise (water)
+		glm::ivec4 info;
+	};
+
+	// As read by glMultiDrawElementsIndirect
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	static const GLuint TILE_DRAW_BINDING = 3;
+
+	// The index buffer is common to all tiles, it holds the indices twice, the
+	// second time with reversed winding. The VAO is also shared
 	std::array<uint16_t, PlanetTile::INDEX_COUNT> indices;
 	size_t bulk_index_count;
-	GLuint ebo, vao, uv_bo;
+	GLuint ebo, vao;
 
 	// Water only uses a different vao, same index buffer
 	GLuint water_vao;
 
+	// Vertices come from the global tile arenas, we only have the draws.
+	// draw_id_bo simply holds 0, 1, 2... so each draw can find its TileDraw
+	GLuint draw_ssbo, indirect_bo, draw_id_bo;
+	size_t draw_id_capacity;
+	// Land draws first, then water. Reused every frame
+	std::vector<TileDraw> draws;
+	std::vector<DrawCommand> commands;
+
 	void generate_and_upload_index_buffer();
 
+	void add_draw(const TileDraw& draw, bool clockwise, size_t index_count, uint32_t slot);
+	void upload_draws();
+
 
 	// Current detail up means which direction is up pointing
 	glm::dvec3 current_detail_up;
+
+	// Reused every frame
+	std::vector<PlanetTilePath> render_tiles;
+
+	// Of the last render
+	size_t drawn_tiles, frustum_culled, horizon_culled;
 public:
 
 	struct PlanetRenderTforms
@@ -45,6 +88,8 @@ public:
 	// Camera position should be given RELATIVE to the planet
 	void render(PlanetTileServer& server, QuadTreePlanet& planet, const PlanetRenderTforms& tforms, ElementConfig& config);
 
+	void do_imgui();
+
 	PlanetRenderer();
 	~PlanetRenderer();
 };
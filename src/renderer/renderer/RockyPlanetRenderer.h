@@ -11,12 +11,9 @@ public:
 	PlanetTileServer* server;
 	PlanetRenderer renderer;
 
-	void load(const std::string& script, const std::string& script_path, ElementConfig& config);
-
-	RockyPlanetRenderer()
-	{
-		server = nullptr;
-	}
+	// Takes ownership of the server, which is usually created
+	// away from the main thread (see BodyLoader)
+	explicit RockyPlanetRenderer(PlanetTileServer* server);
 
 	~RockyPlanetRenderer()
 	{
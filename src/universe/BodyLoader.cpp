@@ -0,0 +1,286 @@
+#include "BodyLoader.h"
+#include "element/SystemElement.h"
+#include <planet_mesher/mesher/PlanetTileWorkerPool.h>
+#include <planet_mesher/mesher/PlanetNoiseGraph.h>
+#include <assets/AssetManager.h>
+#include <util/Logger.h>
+#include <OSP.h>
+#include <algorithm>
+
+void BodyLoader::thread_func(BodyLoader* loader)
+{
+	while (true)
+	{
+		Job* job = nullptr;
+		PlanetTileServer* server = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(loader->mtx);
+			loader->work_var.wait(lock, [loader]()
+			{
+				return !loader->run || !loader->to_create.empty() || !loader->to_stop.empty();
+			});
+
+			if (!loader->run)
+			{
+				break;
+			}
+
+			// Stopping frees threads for the new servers, so it goes first
+			if (!loader->to_stop.empty())
+			{
+				server = loader->to_stop.front();
+				loader->to_stop.erase(loader->to_stop.begin());
+			}
+			else
+			{
+				job = loader->to_create.front();
+				loader->to_create.erase(loader->to_create.begin());
+			}
+		}
+
+		if (server != nullptr)
+		{
+			// Waits for the tiles being generated for it
+			planet_tile_pool->remove_server(server);
+
+			std::lock_guard<std::mutex> lock(loader->mtx);
+			loader->stopped.push_back(server);
+		}
+		else
+		{
+			ElementConfig& config = job->body->config;
+			if (config.has_surface)
+			{
+				std::string script;
+				if (!config.surface.script_path.empty())
+				{
+					script = AssetManager::load_string_raw(config.surface.script_path);
+				}
+
+				job->server = new PlanetTileServer(script, config.surface.script_path_raw, &config,
+					config.surface.has_water, job->pkg, job->graph);
+				job->graph = nullptr;
+			}
+
+			std::lock_guard<std::mutex> lock(loader->mtx);
+			loader->created.push_back(job);
+		}
+	}
+}
+
+bool BodyLoader::do_step(Job* job)
+{
+	SystemElement* body = job->body;
+
+	if (job->cancelled)
+	{
+		if (job->server != nullptr)
+		{
+			stop_server(job->server);
+			job->server = nullptr;
+		}
+		return true;
+	}
+
+	if (job->step == 0)
+	{
+		job->step++;
+
+		if (body->config.has_surface)
+		{
+			body->renderer.rocky = new RockyPlanetRenderer(job->server);
+			job->server = nullptr;
+		}
+		else
+		{
+			body->renderer.gas = new GasPlanetRenderer();
+		}
+
+		return !body->config.has_atmo;
+	}
+	else
+	{
+		body->renderer.atmo = new AtmosphereRenderer();
+		return true;
+	}
+}
+
+void BodyLoader::stop_server(PlanetTileServer* server)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		to_stop.push_back(server);
+	}
+	work_var.notify_one();
+}
+
+void BodyLoader::load(SystemElement* body)
+{
+	bool loaded = body->renderer.rocky != nullptr || body->renderer.gas != nullptr;
+	if (is_loading(body) || loaded)
+	{
+		return;
+	}
+
+	logger->info("Loading body '{}'", body->name);
+
+	// The graph loads images through the asset manager, which is not safe away from
+	// the main thread. Resolving them also needs the current package
+	PlanetNoiseGraph* graph = nullptr;
+	if (body->config.has_surface && !body->config.surface.graph_path.empty())
+	{
+		graph = PlanetNoiseGraph::load(body->config.surface.graph_path);
+	}
+
+	Job* job = new Job();
+	job->body = body;
+	job->pkg = osp->assets->get_current_package();
+	job->server = nullptr;
+	job->graph = graph;
+	job->step = 0;
+	job->cancelled = false;
+	loading[body] = job;
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		to_create.push_back(job);
+	}
+	work_var.notify_one();
+}
+
+void BodyLoader::unload(SystemElement* body)
+{
+	logger->info("Unloading body '{}'", body->name);
+
+	auto it = loading.find(body);
+	if (it != loading.end())
+	{
+		Job* job = it->second;
+		loading.erase(it);
+
+		bool started;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto q_it = std::find(to_create.begin(), to_create.end(), job);
+			started = q_it == to_create.end();
+			if (!started)
+			{
+				to_create.erase(q_it);
+			}
+		}
+
+		if (started)
+		{
+			// Cleaned up once it reaches the main thread
+			job->cancelled = true;
+		}
+		else
+		{
+			delete job->graph;
+			delete job;
+		}
+	}
+
+	if (body->renderer.rocky != nullptr)
+	{
+		PlanetTileServer* server = body->renderer.rocky->server;
+		body->renderer.rocky->server = nullptr;
+		delete body->renderer.rocky;
+		body->renderer.rocky = nullptr;
+
+		if (server != nullptr)
+		{
+			stop_server(server);
+		}
+	}
+
+	if (body->renderer.gas != nullptr)
+	{
+		delete body->renderer.gas;
+		body->renderer.gas = nullptr;
+	}
+
+	if (body->renderer.atmo != nullptr)
+	{
+		delete body->renderer.atmo;
+		body->renderer.atmo = nullptr;
+	}
+}
+
+void BodyLoader::update()
+{
+	std::vector<PlanetTileServer*> n_stopped;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		finishing.insert(finishing.end(), created.begin(), created.end());
+		created.clear();
+		n_stopped.swap(stopped);
+	}
+
+	for (PlanetTileServer* server : n_stopped)
+	{
+		// Quick now, it keeps its tiles for later (see PlanetTileRetainer)
+		delete server;
+	}
+
+	// Cancelled jobs are cheap to clean, so they don't count as a step
+	while (!finishing.empty())
+	{
+		Job* job = finishing.front();
+		bool cancelled = job->cancelled;
+
+		if (do_step(job))
+		{
+			finishing.erase(finishing.begin());
+			if (!cancelled)
+			{
+				loading.erase(job->body);
+				logger->info("Loaded body '{}'", job->body->name);
+			}
+			delete job;
+		}
+
+		if (!cancelled)
+		{
+			break;
+		}
+	}
+}
+
+BodyLoader::BodyLoader()
+{
+	run = true;
+	thread = new std::thread(thread_func, this);
+}
+
+BodyLoader::~BodyLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		run = false;
+	}
+	work_var.notify_all();
+	thread->join();
+	delete thread;
+
+	// Anything left over is simply destroyed here
+	finishing.insert(finishing.end(), to_create.begin(), to_create.end());
+	finishing.insert(finishing.end(), created.begin(), created.end());
+	for (Job* job : finishing)
+	{
+		delete job->server;
+		delete job->graph;
+		delete job;
+	}
+
+	for (PlanetTileServer* server : to_stop)
+	{
+		delete server;
+	}
+
+	for (PlanetTileServer* server : stopped)
+	{
+		delete server;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+class SystemElement;
+class PlanetTileServer;
+class PlanetNoiseGraph;
+
+// Loads and unloads the renderers of bodies away from the render path. The slow
+// parts (reading the script, creating the tile server and its lua state, waiting
+// for the tiles being generated for it) run in a background thread, while whatever
+// needs the OpenGL context is done in the main thread, one step per frame.
+// The body renderers are only set once ready, so they may be missing for a while
+class BodyLoader
+{
+private:
+
+	struct Job
+	{
+		SystemElement* body;
+		// Package the surface script is run from
+		std::string pkg;
+		// Loaded in the main thread as its images are assets, given to the server
+		PlanetNoiseGraph* graph;
+		// Created in the background, nullptr for bodies without surface
+		PlanetTileServer* server;
+		// Next main thread step, see do_step
+		int step;
+		// The body was unloaded meanwhile, whatever we created is thrown away
+		bool cancelled;
+	};
+
+	std::thread* thread;
+	bool run;
+
+	// Guards the queues below
+	std::mutex mtx;
+	std::condition_variable work_var;
+
+	// Background work
+	std::vector<Job*> to_create;
+	std::vector<PlanetTileServer*> to_stop;
+	// Done in the background, waiting for the main thread
+	std::vector<Job*> created;
+	std::vector<PlanetTileServer*> stopped;
+
+	// Main thread only, jobs being finished in order
+	std::vector<Job*> finishing;
+	std::unordered_map<SystemElement*, Job*> loading;
+
+	static void thread_func(BodyLoader* loader);
+
+	// Returns true once the job is done
+	bool do_step(Job* job);
+
+	// The server is removed from the worker pool in the background, and
+	// then destroyed in the main thread as its tiles have GPU resources
+	void stop_server(PlanetTileServer* server);
+
+public:
+
+	// Both may be called again before the previous one is done, the
+	// last one wins
+	void load(SystemElement* body);
+	void unload(SystemElement* body);
+
+	bool is_loading(SystemElement* body) const { return loading.find(body) != loading.end(); }
+
+	// Call once per frame from the main thread
+	void update();
+
+	BodyLoader();
+	~BodyLoader();
+};
@@ -4,6 +4,7 @@
 #include "../physics/glm/BulletGlmCompat.h"
 #include "../physics/ground/GroundShape.h"
 #include <game/GameState.h>
+#include <renderer/Renderer.h>
 
 glm::dvec3 PlanetarySystem::get_gravity_vector(glm::dvec3 p, StateVector* states)
 {
@@ -247,104 +248,43 @@ void PlanetarySystem::init(btDynamicsWorld* world)
 
 }
 
-static void load_body(SystemElement* body)
+void PlanetarySystem::update_render_body_rocky(SystemElement* body, glm::dvec3 body_pos, glm::dvec3 camera_pos,
+	float fov, double t, double t0)
 {
-	logger->info("Loading body '{}'", body->name);
-	if (body->config.has_surface)
-	{
-		body->renderer.rocky = new RockyPlanetRenderer();
-
-		std::string script = AssetManager::load_string_raw(body->config.surface.script_path);
-
-		body->renderer.rocky->load(script, body->config.surface.script_path_raw, body->config);
-	}
-	else
-	{
-		body->renderer.gas = new GasPlanetRenderer();
-	}
+	// Build camera transform matrix, to get the relative camera pos
+	glm::dmat4 rel_matrix = glm::dmat4(1.0);
+	rel_matrix = rel_matrix * glm::inverse(body->build_rotation_matrix(t0, t));
+	rel_matrix = glm::translate(rel_matrix, -body_pos);
 
-	if (body->config.has_atmo)
-	{
-		body->renderer.atmo = new AtmosphereRenderer();
-	}
-}
+	glm::dvec3 rel_camera_pos = rel_matrix * glm::dvec4(camera_pos, 1.0);
 
-static void unload_body(SystemElement* body)
-{
-	logger->info("Unloading body '{}'", body->name);
-	if (body->config.has_surface && body->renderer.rocky != nullptr)
-	{
-		delete body->renderer.rocky;
-		body->renderer.rocky = nullptr;
-	}
+	const SurfaceConfig& surface = body->config.surface;
+	QuadTreePlanet& qtree = body->renderer.rocky->qtree;
 
-	if (body->config.has_atmo && body->renderer.atmo != nullptr)
-	{
-		delete body->renderer.atmo;
-		body->renderer.atmo = nullptr;
-	}
-}
+	qtree.lod.max_error = surface.max_error;
+	qtree.lod.max_depth = (size_t)glm::max(surface.max_depth, 0);
+	qtree.lod.max_nodes = (size_t)glm::max(surface.max_tiles, 6);
+	qtree.lod.max_height = surface.max_height / body->config.radius;
 
-void PlanetarySystem::update_render_body_rocky(SystemElement* body, glm::dvec3 body_pos, glm::dvec3 camera_pos, double t, double t0)
-{
-	bool moved = true;
+	// Pixels per unit of size at unit distance
+	double pixel_scale = (double)osp->renderer->get_height() / (2.0 * glm::tan((double)fov * 0.5));
+	qtree.set_view(rel_camera_pos / body->config.radius, pixel_scale);
 
-	body->renderer.rocky->server->update(body->renderer.rocky->qtree);
-	body->renderer.rocky->qtree.dirty = false;
-	body->renderer.rocky->qtree.update(*body->renderer.rocky->server);
+	// Tiles closer to the camera get generated first
+	body->renderer.rocky->server->set_camera(rel_camera_pos);
+	body->renderer.rocky->server->set_depth_for_unload(surface.depth_for_unload);
+	body->renderer.rocky->server->update(qtree);
+	qtree.update(*body->renderer.rocky->server);
 
-	if (moved)
+	if (debug_drawer->debug_enabled)
 	{
-		// Build camera transform matrix, to get the relative camera pos
-		glm::dmat4 rel_matrix = glm::dmat4(1.0);
-		rel_matrix = rel_matrix * glm::inverse(body->build_rotation_matrix(t0, t));
-		rel_matrix = glm::translate(rel_matrix, -body_pos);
-
-		glm::dvec3 rel_camera_pos = rel_matrix * glm::dvec4(camera_pos, 1.0);
-	
-
-
 		glm::vec3 pos_nrm = (glm::vec3)glm::normalize(rel_camera_pos);
-		PlanetSide side = body->renderer.rocky->qtree.get_planet_side(pos_nrm);
-		glm::dvec2 offset = body->renderer.rocky->qtree.get_planet_side_offset(pos_nrm, side); 
-
 		double altitude = body->renderer.rocky->server->get_height(pos_nrm, 1);
 
-		double height = std::max(glm::length(rel_camera_pos) - body->config.radius - altitude, 1.0);
-
-		height /= body->config.radius;
-
-		// Simple formula that allows a great deal of customization
-		double M = (double)body->config.surface.max_depth;
-		double m = (double)body->config.surface.depth_for_unload;
-		m = 0.0;			// TODO: Think this out
-		double A = body->config.surface.coef_a;
-		double B = body->config.surface.coef_b;
-		double C = body->config.surface.coef_c;
-		double x = height;
-
-		// Formula: https://www.desmos.com/calculator/5xvcucqbrx
-		double depthf = (M-1.0) * glm::exp(- (A * x) / C) + glm::pow(A, -glm::pow(x, B));
-
-		int depthi = (int)std::round(depthf);
-		size_t depth = glm::max(glm::min(depthi, body->config.surface.max_depth), 0);
-
-
-		body->renderer.rocky->server->set_depth_for_unload(body->config.surface.depth_for_unload);
-
-		body->renderer.rocky->qtree.set_wanted_subdivide(offset, side, depth);
-		body->renderer.rocky->qtree.dirty = true;
-
-
-		if (debug_drawer->debug_enabled)
-		{
-			// Add debug point at surface we are over
-			debug_drawer->add_point(
-				glm::inverse(rel_matrix) * glm::dvec4(glm::normalize(rel_camera_pos) * (altitude * 1.1 + body->config.radius * 1.01), 1.0),
-				glm::vec3(1.0, 1.0, 1.0));
-
-			//osp->game_state->universe.bt_world->debugDrawWorld();
-		}
+		// Add debug point at surface we are over
+		debug_drawer->add_point(
+			glm::inverse(rel_matrix) * glm::dvec4(glm::normalize(rel_camera_pos) * (altitude * 1.1 + body->config.radius * 1.01), 1.0),
+			glm::vec3(1.0, 1.0, 1.0));
 	}
 }
 
@@ -352,6 +292,7 @@ void PlanetarySystem::update_render_body_rocky(SystemElement* body, glm::dvec3 b
 
 void PlanetarySystem::update_render(glm::dvec3 camera_pos, float fov)
 {
+	loader.update();
 
 	for (size_t i = 0; i < elements.size(); i++)
 	{
@@ -364,21 +305,82 @@ void PlanetarySystem::update_render(glm::dvec3 camera_pos, float fov)
 
 		if (prev_factor == 1.0f && elements[i]->dot_factor != 1.0f)
 		{
-			load_body(elements[i]);
+			loader.load(elements[i]);
 		}
 
 		if (prev_factor != 1.0f && elements[i]->dot_factor == 1.0f)
 		{
-			unload_body(elements[i]);
+			loader.unload(elements[i]);
 		}
 
 		if (elements[i]->renderer.rocky != nullptr)
 		{
-			update_render_body_rocky(elements[i], states_now[i].pos, camera_pos, t, t0);
+			update_render_body_rocky(elements[i], states_now[i].pos, camera_pos, fov, t, t0);
 		}
 	}
 }
 
+void PlanetarySystem::raycast_terrain(size_t body_index, const std::vector<PlanetTileRaycaster::Ray>& rays,
+	std::vector<PlanetTileRaycaster::Hit>& hits, bool bullet)
+{
+	SystemElement* body = elements[body_index];
+	glm::dvec3 body_pos = bullet ? bullet_states[body_index].pos : states_now[body_index].pos;
+	glm::dmat4 rot_matrix = body->build_rotation_matrix(t0, bullet ? bt : t);
+	glm::dmat4 inverse_rot = glm::inverse(rot_matrix);
+
+	std::vector<PlanetTileRaycaster::Ray> local_rays = rays;
+	for (PlanetTileRaycaster::Ray& ray : local_rays)
+	{
+		ray.origin = inverse_rot * glm::dvec4(ray.origin - body_pos, 1.0);
+		ray.dir = inverse_rot * glm::dvec4(ray.dir, 0.0);
+	}
+
+	if (body->renderer.rocky != nullptr && body->renderer.rocky->server != nullptr)
+	{
+		PlanetTileRaycaster raycaster = PlanetTileRaycaster(body->renderer.rocky->server);
+		raycaster.raycast(local_rays, hits);
+	}
+	else
+	{
+		hits.resize(local_rays.size());
+		for (size_t i = 0; i < local_rays.size(); i++)
+		{
+			PlanetTileRaycaster::raycast_sphere(local_rays[i], body->config.radius, hits[i]);
+		}
+	}
+
+	for (PlanetTileRaycaster::Hit& hit : hits)
+	{
+		hit.pos = glm::dvec3(rot_matrix * glm::dvec4(hit.pos, 1.0)) + body_pos;
+		hit.nrm = rot_matrix * glm::dvec4(hit.nrm, 0.0);
+	}
+}
+
+void PlanetarySystem::get_terrain_heights(size_t body_index, const std::vector<glm::dvec3>& pos,
+	std::vector<double>& heights, bool bullet)
+{
+	SystemElement* body = elements[body_index];
+
+	if (body->renderer.rocky == nullptr || body->renderer.rocky->server == nullptr)
+	{
+		heights.clear();
+		heights.resize(pos.size(), 0.0);
+		return;
+	}
+
+	glm::dvec3 body_pos = bullet ? bullet_states[body_index].pos : states_now[body_index].pos;
+	glm::dmat4 inverse_rot = glm::inverse(body->build_rotation_matrix(t0, bullet ? bt : t));
+
+	std::vector<glm::dvec3> local_pos;
+	local_pos.reserve(pos.size());
+	for (const glm::dvec3& p : pos)
+	{
+		local_pos.push_back(inverse_rot * glm::dvec4(p - body_pos, 1.0));
+	}
+
+	body->renderer.rocky->server->get_heights(local_pos, heights);
+}
+
 #include "propagator/RK4Propagator.h"
 
 PlanetarySystem::PlanetarySystem(Universe* universe)
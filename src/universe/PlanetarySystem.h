@@ -4,8 +4,10 @@
 #include "../util/SerializeUtil.h"
 #include "element/SystemElement.h"
 #include "propagator/SystemPropagator.h"
+#include "BodyLoader.h"
 
 #include <renderer/Drawable.h>
+#include <planet_mesher/mesher/PlanetTileRaycaster.h>
 
 #pragma warning(push, 0)
 #include <btBulletDynamicsCommon.h>
@@ -29,13 +31,16 @@ private:
 	static void render_body_atmosphere(CartesianState state, SystemElement* body, glm::dvec3 camera_pos,
 		glm::dmat4 proj_view, float far_plane);
 
-	static void update_render_body_rocky(SystemElement* body, glm::dvec3 body_pos, glm::dvec3 camera_pos, double t, double t0);
+	static void update_render_body_rocky(SystemElement* body, glm::dvec3 body_pos, glm::dvec3 camera_pos, float fov, double t, double t0);
 
 	void update_physics(double dt, bool bullet);
 	void init_physics(btDynamicsWorld* world);
 
 	std::vector<glm::dvec3> pts;
 
+	// Body renderers are created and destroyed through it
+	BodyLoader loader;
+
 public:
 
 	double bt, t, t0;
@@ -75,6 +80,17 @@ public:
 	// Updates LOD and similar, fov in radians
 	void update_render(glm::dvec3 camera_pos, float fov);
 
+	// Rays are given in world coordinates, and so are the hits. If bullet is true the
+	// bullet states are used for the body position (use it for physics stuff)
+	// Bodies which are not loaded are treated as a sea-level sphere
+	void raycast_terrain(size_t body_index, const std::vector<PlanetTileRaycaster::Ray>& rays,
+		std::vector<PlanetTileRaycaster::Hit>& hits, bool bullet = true);
+
+	// Terrain heights (in meters, over sea level) below the given world positions. Doesn't
+	// run the planet script once tiles are loaded. Unloaded bodies return 0 (sea level)
+	void get_terrain_heights(size_t body_index, const std::vector<glm::dvec3>& pos,
+		std::vector<double>& heights, bool bullet = true);
+
 	// Does the heavy loading of [[element]] objects
 	void load(const cpptoml::table& root);
 
@@ -6,6 +6,7 @@
 #include <util/serializers/glm.h>
 #include <assets/Image.h>
 #include <assets/AssetManager.h>
+#include <planet_mesher/mesher/PlanetTilePath.h>
 
 constexpr bool LOAD_SURFACES_ON_START = false;
 
@@ -13,10 +14,15 @@ struct SurfaceConfig
 {
 	std::string script_path;
 	std::string script_path_raw;
+	// If present, the noise graph (see PlanetNoiseGraph) is used instead of the script,
+	// which becomes optional. Both are empty if not used
+	std::string graph_path;
+	std::string graph_path_raw;
 	int max_depth;
-	double coef_a;
-	double coef_b;
-	double coef_c;
+	// Screen-space error (in pixels) over which tiles are subdivided, and the
+	// maximum number of tiles, see QuadTreePlanet::LODSettings
+	double max_error;
+	int max_tiles;
 	int depth_for_unload;
 
 	bool has_water;
@@ -27,6 +33,19 @@ struct SurfaceConfig
 	// will break
 	double max_height;
 
+	// Physics tile grid sizes (vertices per side), 0 means the default
+	// (the render resolution, it can't go over it). If physics_max_error (in meters) is
+	// over 0, every tile uses the coarsest grid which keeps the error under it,
+	// so flat terrain gets coarse collision and cliffs get fine collision
+	int physics_min_size;
+	int physics_max_size;
+	double physics_max_error;
+
+	// Goes into the tile cache key (see PlanetTileServer::get_generator_key), bump it
+	// to drop the cached tiles when something the key can't see changes, like
+	// the files the script dofiles
+	int version;
+
 };
 
 template<>
@@ -39,15 +58,34 @@ public:
 	static void deserialize(SurfaceConfig& to, const cpptoml::table& from)
 	{
 		SAFE_TOML_GET(to.has_water, "has_water", bool);
-		SAFE_TOML_GET(to.script_path_raw, "script_path", std::string);
+		SAFE_TOML_GET_OR(to.graph_path_raw, "graph_path", std::string, "");
+		if (to.graph_path_raw.empty())
+		{
+			SAFE_TOML_GET(to.script_path_raw, "script_path", std::string);
+		}
+		else
+		{
+			SAFE_TOML_GET_OR(to.script_path_raw, "script_path", std::string, "");
+		}
 		SAFE_TOML_GET(to.max_depth, "lod.max_depth", int);
-		SAFE_TOML_GET(to.coef_a, "lod.coef_a", double);
-		SAFE_TOML_GET(to.coef_b, "lod.coef_b", double);
-		SAFE_TOML_GET(to.coef_c, "lod.coef_c", double);
+		if (to.max_depth > (int)PlanetTilePath::MAX_DEPTH)
+		{
+			// Deeper tiles would not fit in the tile keys
+			logger->warn("lod.max_depth ({}) is over the maximum ({}), clamped", to.max_depth, PlanetTilePath::MAX_DEPTH);
+			to.max_depth = (int)PlanetTilePath::MAX_DEPTH;
+		}
+		SAFE_TOML_GET_OR(to.max_error, "lod.max_error", double, 4.0);
+		SAFE_TOML_GET_OR(to.max_tiles, "lod.max_tiles", int, 1024);
 		SAFE_TOML_GET(to.depth_for_unload, "lod.depth_for_unload", int)
 
 		SAFE_TOML_GET(to.max_height, "max_height", double);
 
-		to.script_path = osp->assets->resolve_path(to.script_path_raw);
+		SAFE_TOML_GET_OR(to.physics_min_size, "physics.min_size", int, 0);
+		SAFE_TOML_GET_OR(to.physics_max_size, "physics.max_size", int, 0);
+		SAFE_TOML_GET_OR(to.physics_max_error, "physics.max_error", double, 0.0);
+		SAFE_TOML_GET_OR(to.version, "version", int, 0);
+
+		to.script_path = to.script_path_raw.empty() ? "" : osp->assets->resolve_path(to.script_path_raw);
+		to.graph_path = to.graph_path_raw.empty() ? "" : osp->assets->resolve_path(to.graph_path_raw);
 	}
 };
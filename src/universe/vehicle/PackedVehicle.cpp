@@ -4,6 +4,10 @@
 PackedVehicle::PackedVehicle(Vehicle* v)
 {
 	this->vehicle = v;
+	com = btVector3(0, 0, 0);
+	mass = 0.0;
+	first_moment = btVector3(0, 0, 0);
+	com_valid = false;
 }
 
 
@@ -27,4 +31,23 @@ void PackedVehicle::calculate_com()
 	}
 
 	com = acc / tot_mass;
+	mass = tot_mass;
+	first_moment = acc;
+	com_valid = true;
+}
+
+void PackedVehicle::apply_mass_delta(Piece* p, double dm)
+{
+	if (!com_valid)
+	{
+		return;
+	}
+
+	first_moment += p->packed_tform.getOrigin() * dm;
+	mass += dm;
+
+	if (mass > 0.0)
+	{
+		com = first_moment / mass;
+	}
 }
@@ -7,6 +7,7 @@
 #include <physics/glm/BulletGlmCompat.h>
 
 class Vehicle;
+class Piece;
 
 class PackedVehicle
 {
@@ -24,6 +25,11 @@ private:
 	btTransform root_transform;
 	// Center of mass relative to the root part
 	btVector3 com;
+	// Kept so mass changes don't need to walk all pieces again
+	double mass;
+	btVector3 first_moment;
+	// Mass changes are ignored until calculate_com runs, it sees them anyway
+	bool com_valid;
 
 	// A packed vehicle can either be landed or in an N-body trajectory
 	bool is_landed;
@@ -41,5 +47,7 @@ public:
 	btVector3 get_com_root_relative(){ return com; }
 
 	void calculate_com();
+	// Called by Piece::set_mass
+	void apply_mass_delta(Piece* p, double dm);
 
 };
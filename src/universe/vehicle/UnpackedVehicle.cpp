@@ -3,9 +3,37 @@
 #include "../../util/DebugDrawer.h"
 #include "../../physics/glm/BulletGlmCompat.h"
 #include "Vehicle.h"
+#include <algorithm>
 
-using WeldedGroupCreation = std::pair<std::unordered_set<Piece*>, bool>;
+using WeldedGroupCreation = std::pair<std::vector<Piece*>, bool>;
 
+// Relative mass change needed before bullet gets the new mass properties of
+// a body, smaller changes (fuel draining every tick) are simply accumulated
+static constexpr double MASS_PUSH_THRESHOLD = 0.005;
+// Distance (in meters) the center of mass of a welded group may drift away from
+// its rigidbody's center before the compound is moved to follow it
+static constexpr double COM_SHIFT_THRESHOLD = 0.01;
+
+
+// Parallel axis theorem, only the diagonal as that's what bullet takes. Inertia
+// is linear on mass so we can later scale it by the mass of the piece
+static btVector3 get_unit_inertia(btCollisionShape* collider, const btTransform& tform)
+{
+	btVector3 local;
+	collider->calculateLocalInertia(1.0, local);
+
+	const btMatrix3x3& rot = tform.getBasis();
+	btVector3 r = tform.getOrigin();
+	btVector3 out;
+
+	for (int i = 0; i < 3; i++)
+	{
+		out[i] = rot[i][0] * rot[i][0] * local.x() + rot[i][1] * rot[i][1] * local.y()
+			+ rot[i][2] * rot[i][2] * local.z() + r.length2() - r[i] * r[i];
+	}
+
+	return out;
+}
 
 static UnpackedVehicle::PieceState obtain_piece_state(Piece* piece)
 {
@@ -31,34 +59,95 @@ static std::unordered_map<Piece*, UnpackedVehicle::PieceState> get_states_at_sta
 	return states_at_start;
 }
 
-static void add_to_welded_groups(std::vector<WeldedGroupCreation>& welded_groups, Piece* piece)
+// Union-find over the pieces, welded pieces end up in the same set. Splitting
+// sets is not possible, but building them is linear so we simply do it again
+struct WeldedSets
 {
-	bool found = false;
-	// Find what welded group to add this to
-	if (piece->welded)
+	std::unordered_map<Piece*, size_t> index;
+	std::vector<size_t> parent;
+	std::vector<size_t> size;
+
+	size_t find(size_t i)
+	{
+		while (parent[i] != i)
+		{
+			// Path halving
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+
+		return i;
+	}
+
+	void unite(size_t a, size_t b)
+	{
+		a = find(a);
+		b = find(b);
+		if (a == b)
+		{
+			return;
+		}
+
+		if (size[a] < size[b])
+		{
+			std::swap(a, b);
+		}
+
+		parent[b] = a;
+		size[a] += size[b];
+	}
+
+	explicit WeldedSets(const std::vector<Piece*>& pieces)
 	{
-		for (size_t i = 0; i < welded_groups.size(); i++)
+		index.reserve(pieces.size());
+		parent.resize(pieces.size());
+		size.resize(pieces.size(), 1);
+
+		for (size_t i = 0; i < pieces.size(); i++)
 		{
-			if (welded_groups[i].first.count(piece->attached_to) != 0)
+			index[pieces[i]] = i;
+			parent[i] = i;
+		}
+	}
+};
+
+// Individual pieces get a lone welded group, pieces are kept in the vehicle order
+static std::vector<WeldedGroupCreation> build_welded_groups(const std::vector<Piece*>& pieces)
+{
+	WeldedSets sets = WeldedSets(pieces);
+
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		Piece* piece = pieces[i];
+		if (piece->welded && piece->attached_to != nullptr)
+		{
+			auto it = sets.index.find(piece->attached_to);
+			if (it != sets.index.end())
 			{
-				welded_groups[i].first.insert(piece);
-				found = true;
-				break;
+				sets.unite(i, it->second);
 			}
 		}
 	}
 
-	if (!found)
+	std::vector<WeldedGroupCreation> welded_groups;
+	// Set root -> index in welded_groups
+	std::unordered_map<size_t, size_t> group_of;
+
+	for (size_t i = 0; i < pieces.size(); i++)
 	{
-		// Create the welded group, add the part, and, if this part is welded, add
-		// whatever it's welded to (Note: individual parts get a lone welded group)
-		welded_groups.push_back(std::make_pair(std::unordered_set<Piece*>(), false));
-		welded_groups[welded_groups.size() - 1].first.insert(piece);
-		if (piece->welded && piece->attached_to != nullptr)
+		size_t root = sets.find(i);
+		auto it = group_of.find(root);
+		if (it == group_of.end())
 		{
-			welded_groups[welded_groups.size() - 1].first.insert(piece->attached_to);
+			it = group_of.emplace(root, welded_groups.size()).first;
+			welded_groups.push_back(std::make_pair(std::vector<Piece*>(), false));
+			welded_groups.back().first.reserve(sets.size[root]);
 		}
+
+		welded_groups[it->second].first.push_back(pieces[i]);
 	}
+
+	return welded_groups;
 }
 
 static std::vector<Piece*> extract_single_pieces(std::vector<WeldedGroupCreation>& welded_groups)
@@ -70,7 +159,7 @@ static std::vector<Piece*> extract_single_pieces(std::vector<WeldedGroupCreation
 	{
 		if (it->first.size() == 1)
 		{
-			Piece* piece = *it->first.begin();
+			Piece* piece = it->first[0];
 
 			single_pieces.push_back(piece);
 			// Remove welded colliders, if it had any
@@ -93,33 +182,45 @@ static std::vector<Piece*> extract_single_pieces(std::vector<WeldedGroupCreation
 	return single_pieces;
 }
 
+// Groups made up of exactly the same pieces as before (and not marked dirty) are kept
+// as they are, any other is removed so it's built again. Linear on the piece count
 static void remove_outdated_welded_groups(
 	std::vector<WeldedGroup*>& welded, std::vector<WeldedGroupCreation>& welded_groups, btDynamicsWorld* world)
 {
-	for (auto it = welded.begin(); it != welded.end();)
-	{
-		WeldedGroup* wgroup = *it;
+	// Pieces may still point to groups long gone (see deactivate), only these are real
+	std::unordered_set<WeldedGroup*> live(welded.begin(), welded.end());
+	std::unordered_set<WeldedGroup*> kept;
 
-		bool found = false;
-		// Find any same group, to be the same, the welded_group
-		// must contain every piece in wgroup, and be the same size
-		for (size_t j = 0; j < welded_groups.size(); j++)
+	for (WeldedGroupCreation& wg : welded_groups)
+	{
+		WeldedGroup* wgroup = wg.first[0]->in_group;
+		if (live.count(wgroup) == 0 || wgroup->dirty || wgroup->pieces.size() != wg.first.size())
 		{
-			int count = 0;
-			for (size_t i = 0; i < wgroup->pieces.size(); i++)
-			{
-				count += (int)welded_groups[j].first.count(wgroup->pieces[i]);
-			}
+			continue;
+		}
 
-			if (count == wgroup->pieces.size() && !wgroup->dirty)
+		bool same = true;
+		for (Piece* p : wg.first)
+		{
+			if (p->in_group != wgroup)
 			{
-				found = true;
-				welded_groups[j].second = true;
+				same = false;
 				break;
 			}
 		}
 
-		if (!found)
+		if (same)
+		{
+			wg.second = true;
+			kept.insert(wgroup);
+		}
+	}
+
+	for (auto it = welded.begin(); it != welded.end();)
+	{
+		WeldedGroup* wgroup = *it;
+
+		if (kept.count(wgroup) == 0)
 		{
 			// We remove the group as it is not present anymore
 			world->removeRigidBody(wgroup->rigid_body);
@@ -130,12 +231,12 @@ static void remove_outdated_welded_groups(
 				p->rigid_body = nullptr;
 			}
 
+			// Only the compound is ours, its children are the pieces' colliders
+			delete wgroup->rigid_body->getCollisionShape();
 			delete wgroup->motion_state;
 			delete wgroup->rigid_body;
 			delete wgroup;
 
-
-
 			it = welded.erase(it);
 		}
 		else
@@ -193,7 +294,17 @@ static void create_new_welded_group(
 		}
 
 
-		collider->calculateLocalInertia(tot_mass, local_inertia);
+		// The same inertia we keep up to date later on (see apply_mass_delta), so
+		// it doesn't jump once the first mass change is pushed
+		local_inertia = btVector3(0, 0, 0);
+		btVector3 first_moment = btVector3(0, 0, 0);
+		for (Piece* p : wg.first)
+		{
+			btTransform tform = principal_inverse * p->welded_tform;
+			p->unit_inertia = get_unit_inertia(p->collider, tform);
+			local_inertia += p->unit_inertia * p->mass;
+			first_moment += tform.getOrigin() * p->mass;
+		}
 
 		btMotionState* motion_state = new btDefaultMotionState(principal);
 		btRigidBody::btRigidBodyConstructionInfo info(tot_mass, motion_state, collider, local_inertia);
@@ -249,6 +360,10 @@ static void create_new_welded_group(
 		n_group->rigid_body = rigid_body;
 		n_group->motion_state = motion_state;
 
+		n_group->mass = tot_mass;
+		n_group->inertia = local_inertia;
+		n_group->first_moment = first_moment;
+
 		welded.push_back(n_group);
 	}
 }
@@ -271,6 +386,7 @@ static void add_piece_physics(Piece* piece, btTransform tform, btDynamicsWorld*
 
 	piece->rigid_body = rigid_body;
 	piece->motion_state = motion_state;
+	piece->unit_inertia = get_unit_inertia(piece->collider, btTransform::getIdentity());
 }
 
 static void create_piece_physics(Piece* piece, 
@@ -298,7 +414,7 @@ static void create_piece_physics(Piece* piece,
 
 	piece->rigid_body = rigid_body;
 	piece->motion_state = motion_state;
-	
+	piece->unit_inertia = get_unit_inertia(piece->collider, btTransform::getIdentity());
 }
 
 void UnpackedVehicle::update()
@@ -349,6 +465,8 @@ void UnpackedVehicle::update()
 
 	}
 
+	push_mass_props();
+
 	// We pass the responsability of spawning sub-vehicles to lua too
 	// (Vehicle entity lua function separate_vehicle(vehicle) so lua can hook)
 	for(Vehicle* n_vehicle : n_vehicles)
@@ -373,13 +491,7 @@ void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& stat
 	// groups, and individual colliders for every other piece
 	// The bool is used later on to check if the group was already present
 	
-	std::vector<WeldedGroupCreation> welded_groups;
-
-
-	for (Piece* piece : vehicle->all_pieces)
-	{
-		add_to_welded_groups(welded_groups, piece);
-	}
+	std::vector<WeldedGroupCreation> welded_groups = build_welded_groups(vehicle->all_pieces);
 
 	std::vector<Piece*> single_pieces = extract_single_pieces(welded_groups);
 	this->single_pieces = single_pieces;
@@ -405,16 +517,7 @@ void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& stat
 		// in the previous loop
 		if (piece->attached_to != nullptr && piece->link != nullptr && !piece->welded)
 		{
-			btTransform from_tform = btTransform::getIdentity();
-			btTransform to_tform = btTransform::getIdentity();
-
-			from_tform.setOrigin(to_btVector3(piece->link_from));
-			from_tform.setRotation(to_btQuaternion(piece->link_rot));
-			to_tform.setOrigin(to_btVector3(piece->link_to));
-
-			btTransform real_from = piece->get_local_transform() * from_tform;
-			btTransform real_to = piece->attached_to->get_local_transform() * to_tform;
-			piece->link->activate(piece->rigid_body, real_from, piece->attached_to->rigid_body, real_to, world);
+			activate_link(piece);
 		}
 	}
 
@@ -422,10 +525,78 @@ void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& stat
 
 }
 
+void UnpackedVehicle::activate_link(Piece* piece)
+{
+	btTransform from_tform = btTransform::getIdentity();
+	btTransform to_tform = btTransform::getIdentity();
+
+	from_tform.setOrigin(to_btVector3(piece->link_from));
+	from_tform.setRotation(to_btQuaternion(piece->link_rot));
+	to_tform.setOrigin(to_btVector3(piece->link_to));
+
+	btTransform real_from = piece->get_local_transform() * from_tform;
+	btTransform real_to = piece->attached_to->get_local_transform() * to_tform;
+	piece->link->activate(piece->rigid_body, real_from, piece->attached_to->rigid_body, real_to, world);
+}
+
+void UnpackedVehicle::shift_group_center(WeldedGroup* g)
+{
+	btVector3 shift = g->first_moment / g->mass;
+
+	// Children are moved all at once, the compound is not rebuilt
+	btCompoundShape* compound = (btCompoundShape*)g->rigid_body->getCollisionShape();
+	for (int i = 0; i < compound->getNumChildShapes(); i++)
+	{
+		btTransform child = compound->getChildTransform(i);
+		child.setOrigin(child.getOrigin() - shift);
+		compound->updateChildTransform(i, child, false);
+	}
+	compound->recalculateLocalAabb();
+
+	g->first_moment = btVector3(0, 0, 0);
+	g->inertia = btVector3(0, 0, 0);
+	for (Piece* p : g->pieces)
+	{
+		p->welded_tform.setOrigin(p->welded_tform.getOrigin() - shift);
+		p->unit_inertia = get_unit_inertia(p->collider, p->welded_tform);
+		g->first_moment += p->welded_tform.getOrigin() * p->mass;
+		g->inertia += p->unit_inertia * p->mass;
+	}
+
+	// The body moves so the pieces stay where they were, and takes the velocity
+	// of its new center
+	btTransform tform = g->rigid_body->getCenterOfMassTransform();
+	btVector3 world_shift = tform.getBasis() * shift;
+	tform.setOrigin(tform.getOrigin() + world_shift);
+	btVector3 vel = g->rigid_body->getLinearVelocity() + g->rigid_body->getAngularVelocity().cross(world_shift);
+
+	g->rigid_body->setCenterOfMassTransform(tform);
+	g->rigid_body->setLinearVelocity(vel);
+	g->motion_state->setWorldTransform(tform);
+	world->updateSingleAabb(g->rigid_body);
+
+	// Links hold frames relative to the old center
+	for (Piece* p : vehicle->all_pieces)
+	{
+		if (p->attached_to == nullptr || p->link == nullptr || p->welded)
+		{
+			continue;
+		}
+
+		if (p->in_group == g || p->attached_to->in_group == g)
+		{
+			p->link->deactivate();
+			activate_link(p);
+			p->link->set_breaking_enabled(breaking_enabled);
+		}
+	}
+}
+
 void UnpackedVehicle::add_piece(Piece* piece, btTransform pos)
 {
 
 	vehicle->all_pieces.push_back(piece);
+	invalidate_tree();
 	
 	add_piece_physics(piece, pos, world);
 
@@ -433,17 +604,38 @@ void UnpackedVehicle::add_piece(Piece* piece, btTransform pos)
 
 }
 
+void UnpackedVehicle::build_tree()
+{
+	children.clear();
+	parent_of.clear();
+	for (Piece* p : vehicle->all_pieces)
+	{
+		if (p->attached_to != nullptr)
+		{
+			children[p->attached_to].push_back(p);
+			parent_of[p] = p->attached_to;
+		}
+	}
+
+	tree_built = true;
+}
+
 std::vector<Vehicle*> UnpackedVehicle::handle_separation()
 {
 	std::vector<Vehicle*> n_vehicles;
 
-	std::unordered_set<WeldedGroup*> wgroups;
-
-	// First pass to remove any broken links
-	for (auto it = vehicle->all_pieces.begin(); it != vehicle->all_pieces.end(); it++)
+	if (!tree_built)
 	{
-		Piece* p = *it;
+		build_tree();
+	}
 
+	// Pieces left without parent, each one takes its subtree to a new vehicle
+	std::vector<Piece*> cut;
+
+	// First pass to remove any broken links. Lua may also cut pieces by itself
+	// (see decoupler.lua), so every piece is looked at, but that's cheap
+	for (Piece* p : vehicle->all_pieces)
+	{
 		if (p == vehicle->root)
 		{
 			continue;
@@ -465,130 +657,124 @@ std::vector<Vehicle*> UnpackedVehicle::handle_separation()
 				}
 			}
 		}
+
+		if (p->attached_to == nullptr)
+		{
+			cut.push_back(p);
+		}
 	}
 
-	// Find all pieces that can't reach root, and create a new vehicle from them
-	// Assumes the vehicle was sorted before the part separated!
-	// (Don't sort with a part separated)
+	if (cut.empty())
+	{
+		return n_vehicles;
+	}
 
-	std::vector<std::vector<Piece*>> n_pieces;
+	std::unordered_set<WeldedGroup*> live(welded.begin(), welded.end());
+	std::unordered_set<WeldedGroup*> moved;
+	std::unordered_set<Piece*> detached;
 
-	for (auto it = vehicle->all_pieces.begin(); it != vehicle->all_pieces.end(); )
+	// Cut pieces must not stay in their old parent's children, as they may be gone
+	// (and deleted) with their new vehicle. Done first, as the parent may itself be
+	// in a cut subtree and take its children with it
+	for (Piece* sub_root : cut)
 	{
-		Piece* p = *it;
-
-		if (p == vehicle->root)
+		auto parent_it = parent_of.find(sub_root);
+		if (parent_it != parent_of.end())
 		{
-			it++;
-			continue;
+			auto ch_it = children.find(parent_it->second);
+			if (ch_it != children.end())
+			{
+				std::vector<Piece*>& siblings = ch_it->second;
+				siblings.erase(std::remove(siblings.begin(), siblings.end(), sub_root), siblings.end());
+			}
+			parent_of.erase(parent_it);
 		}
+	}
 
+	for (Piece* sub_root : cut)
+	{
+		Vehicle* n_vehicle = new Vehicle();
+		n_vehicle->unpacked_veh.set_world(world);
+		n_vehicle->root = sub_root;
 
-		if (p->attached_to == nullptr)
-		{
-			n_pieces.push_back(std::vector<Piece*>());
-			n_pieces[n_pieces.size() - 1].push_back(p);
-
-			it = vehicle->all_pieces.erase(it);
-		}
-		else
+		// Breadth first, so the new vehicle is already sorted. Pieces cut from
+		// this subtree are not followed, they get their own vehicle
+		std::vector<Piece*>& n_pieces = n_vehicle->all_pieces;
+		n_pieces.push_back(sub_root);
+		for (size_t i = 0; i < n_pieces.size(); i++)
 		{
-			bool removed = false;
+			Piece* p = n_pieces[i];
+			detached.insert(p);
 
-			for (auto& list : n_pieces)
+			auto it = children.find(p);
+			if (it != children.end())
 			{
-				for (auto sub_p : list)
+				for (Piece* child : it->second)
 				{
-					if (p->attached_to == sub_p)
+					if (child->attached_to == p)
 					{
-						list.push_back(p);
-						it = vehicle->all_pieces.erase(it);
-						removed = true;
-
-						// Lord, I'm sorry, but this is the cleanest option
-						goto out;
+						n_pieces.push_back(child);
 					}
 				}
+
+				n_vehicle->unpacked_veh.children[p] = std::move(it->second);
+				children.erase(it);
 			}
 
-			out:
+			auto parent_it = parent_of.find(p);
+			if (parent_it != parent_of.end())
+			{
+				n_vehicle->unpacked_veh.parent_of[p] = parent_it->second;
+				parent_of.erase(parent_it);
+			}
 
-			if (!removed)
+			auto id_it = vehicle->id_to_piece.find(p->id);
+			if (id_it != vehicle->id_to_piece.end() && id_it->second == p)
 			{
-				it++;
+				vehicle->id_to_piece.erase(id_it);
+				n_vehicle->id_to_piece[p->id] = p;
 			}
-		}
-	}
-	
-	// Find welded groups to transfer
 
-	for (auto& n_vessel_pieces : n_pieces)
-	{
-		for (WeldedGroup* w : welded)
-		{
-			for (size_t i = 0; i < n_vessel_pieces.size(); i++)
+			// Transfer the welded group
+			if (live.count(p->in_group) != 0 && moved.insert(p->in_group).second)
 			{
-				if (w->rigid_body == n_vessel_pieces[i]->rigid_body)
-				{
-					wgroups.insert(w);
-				}
+				n_vehicle->unpacked_veh.welded.push_back(p->in_group);
 			}
 		}
-	}
 
+		n_vehicle->unpacked_veh.tree_built = true;
+		n_vehicles.push_back(n_vehicle);
+	}
 
-	// Here we remove the welded groups from original vessel
-	for (WeldedGroup* w : wgroups)
+	// Groups torn apart (lua may cut welded pieces) are built again by both sides,
+	// the new vehicle removes it first as its physics are built first
+	for (WeldedGroup* w : moved)
 	{
-		for (size_t i = 0; i < welded.size(); i++)
+		for (Piece* p : w->pieces)
 		{
-			if (welded[i] == w)
+			if (detached.count(p) == 0)
 			{
-				welded.erase(welded.begin() + i);
+				w->dirty = true;
 				break;
 			}
 		}
 	}
 
-	for (auto& n_vessel_pieces : n_pieces)
-	{
-
-		Vehicle* n_vehicle = new Vehicle();
-		n_vehicle->unpacked_veh.set_world(world);
-	
-		n_vehicle->all_pieces = n_vessel_pieces;
-		n_vehicle->root = n_vessel_pieces[0];
-
-		for (WeldedGroup* w : wgroups)
-		{
-			for (size_t i = 0; i < w->pieces.size(); i++)
-			{
-				for (size_t j = 0; j < n_vessel_pieces.size(); j++)
-				{
-					if (n_vessel_pieces[j] == w->pieces[i])
-					{
-						// Transfer the welded group
-						n_vehicle->unpacked_veh.welded.push_back(w);
-						i = w->pieces.size() + 1;
-						break;
-					}
-				}
-
-			}
-
-		}
+	// The rest keeps its order, so it stays sorted
+	vehicle->all_pieces.erase(std::remove_if(vehicle->all_pieces.begin(), vehicle->all_pieces.end(),
+		[&detached](Piece* p) { return detached.count(p) != 0; }), vehicle->all_pieces.end());
+	welded.erase(std::remove_if(welded.begin(), welded.end(),
+		[&moved](WeldedGroup* w) { return moved.count(w) != 0; }), welded.end());
 
+	for (Vehicle* n_vehicle : n_vehicles)
+	{
 		n_vehicle->packed = false;
-		n_vehicle->sort();
 		auto st_at_start = get_states_at_start(n_vehicle);
 		n_vehicle->unpacked_veh.build_physics(st_at_start);
-		
+
 		logger->info("Separated new vehicle");
-		n_vehicles.push_back(n_vehicle);
 	}
 
-
-
 	return n_vehicles;
 }
 
@@ -677,6 +863,7 @@ void UnpackedVehicle::deactivate()
 	for(WeldedGroup* group : welded)
 	{
 		world->removeRigidBody(group->rigid_body);
+		delete group->rigid_body->getCollisionShape();
 		delete group->rigid_body;
 		delete group->motion_state;
 		delete group;
@@ -695,9 +882,31 @@ void UnpackedVehicle::deactivate()
 
 glm::dvec3 UnpackedVehicle::get_center_of_mass(bool renderer)
 {
+	if (vehicle->is_packed())
+	{
+		return to_dvec3(vehicle->packed_veh.get_root_transform() * vehicle->packed_veh.get_com_root_relative());
+	}
+
+	// Welded groups already know their center of mass, so only the bodies are walked
 	double tot_mass = 0.0;
 	glm::dvec3 out = glm::dvec3(0.0, 0.0, 0.0);
-	for(Piece* p : vehicle->all_pieces)
+	for (WeldedGroup* g : welded)
+	{
+		btTransform tform = g->rigid_body->getWorldTransform();
+		if (renderer)
+		{
+			g->motion_state->getWorldTransform(tform);
+		}
+
+		// Massless groups don't move the center of mass
+		if (g->mass > 0.0)
+		{
+			tot_mass += g->mass;
+			out += to_dvec3(tform * (g->first_moment / g->mass)) * g->mass;
+		}
+	}
+
+	for (Piece* p : single_pieces)
 	{
 		tot_mass += p->mass;
 		if (renderer)
@@ -708,7 +917,11 @@ glm::dvec3 UnpackedVehicle::get_center_of_mass(bool renderer)
 		{
 			out += to_dvec3(p->get_global_transform().getOrigin()) * p->mass;
 		}
-		
+	}
+
+	if (tot_mass <= 0.0)
+	{
+		return to_dvec3(vehicle->root->get_global_transform().getOrigin());
 	}
 
 	out /= tot_mass;
@@ -716,9 +929,69 @@ glm::dvec3 UnpackedVehicle::get_center_of_mass(bool renderer)
 	return out;
 }
 
+void UnpackedVehicle::apply_mass_delta(Piece* p, double dm)
+{
+	// Single pieces have nothing to accumulate, their mass is all there is
+	WeldedGroup* g = p->in_group;
+	if (g == nullptr)
+	{
+		return;
+	}
+
+	g->mass += dm;
+	g->first_moment += p->welded_tform.getOrigin() * dm;
+	g->inertia += p->unit_inertia * dm;
+}
+
+static void push_body_mass_props(btRigidBody* body, double mass, const btVector3& inertia, bool force = false)
+{
+	// Bullet takes a massless body as static, we never want that for a vehicle
+	if (mass <= 0.0)
+	{
+		return;
+	}
+
+	// Bodies that were built massless have no old mass to compare against
+	double inv_mass = body->getInvMass();
+	if (!force && inv_mass > 0.0)
+	{
+		double old_mass = 1.0 / inv_mass;
+		if (std::abs(mass - old_mass) <= old_mass * MASS_PUSH_THRESHOLD)
+		{
+			return;
+		}
+	}
+
+	body->setMassProps(mass, inertia);
+	body->updateInertiaTensor();
+}
+
+void UnpackedVehicle::push_mass_props()
+{
+	for (WeldedGroup* g : welded)
+	{
+		// Gravity and thrust act on the center of the body, so it follows the
+		// center of mass once it drifts far enough
+		bool shifted = false;
+		if (g->mass > 0.0 && (g->first_moment / g->mass).length() > COM_SHIFT_THRESHOLD)
+		{
+			shift_group_center(g);
+			shifted = true;
+		}
+
+		push_body_mass_props(g->rigid_body, g->mass, g->inertia, shifted);
+	}
+
+	for (Piece* p : single_pieces)
+	{
+		push_body_mass_props(p->rigid_body, p->mass, p->unit_inertia * p->mass);
+	}
+}
+
 void UnpackedVehicle::activate()
 {
 	dirty = true;
+	tree_built = false;
 	vehicle->packed = true;
 	// sort() 				// TODO: Sorting may not be neccesary here as pieces won't change while packed
 	auto st0 = get_states_at_start(vehicle);
@@ -729,6 +1002,7 @@ void UnpackedVehicle::activate()
 UnpackedVehicle::UnpackedVehicle(Vehicle* v)
 {
 	this->vehicle = v;
+	tree_built = false;
 }
 
 void UnpackedVehicle::apply_gravity(btVector3 dir)
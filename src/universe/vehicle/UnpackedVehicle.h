@@ -8,6 +8,7 @@
 #pragma warning(pop)
 
 #include <unordered_set>
+#include <unordered_map>
 #include <vector>
 class Vehicle;
 
@@ -18,6 +19,27 @@ public:
 private:
 
 	bool breaking_enabled;
+
+	// The attachment tree, so separating only walks what separates. Built on the
+	// first separation and then kept by handle_separation. Children whose
+	// attached_to changed since are simply skipped
+	std::unordered_map<Piece*, std::vector<Piece*>> children;
+	// Parent of each piece in the tree, as attached_to may be cleared (lua cuts)
+	// before we get to remove the piece from its parent's children
+	std::unordered_map<Piece*, Piece*> parent_of;
+	bool tree_built;
+
+	void build_tree();
+
+	// Gives bullet the new mass properties of bodies whose mass changed enough
+	void push_mass_props();
+
+	// Moves the compound children, the body and the links so the center of the
+	// body is again the center of mass of the group
+	void shift_group_center(WeldedGroup* g);
+
+	// Piece must have a link and be attached to something
+	void activate_link(Piece* piece);
 public:
 	struct PieceState
 	{
@@ -51,8 +73,16 @@ public:
 	// Creates new vehicles from any separated pieces
 	// (that cannot reach the root piece)
 	// It automatically assigns Parts, pieces, ids...
+	// Only the separated subtrees are walked
 	std::vector<Vehicle*> handle_separation();
 
+	// Called by Piece::set_mass, only accumulates into the welded group,
+	// bullet gets it on the next update
+	void apply_mass_delta(Piece* p, double dm);
+
+	// Call if pieces are added or removed outside of handle_separation
+	void invalidate_tree() { tree_built = false; }
+
 	void draw_debug();
 
 	// The root part ends up in the given position, other parts
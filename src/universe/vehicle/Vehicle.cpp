@@ -31,6 +31,7 @@ Piece* Vehicle::remove_piece(Piece* p)
 {
 	// TODO: Check links, attachments, etc... So we don't leak memory and create "orphan" stuff
 	all_pieces.erase(std::remove(all_pieces.begin(), all_pieces.end(), p));
+	unpacked_veh.invalidate_tree();
 	if(p == root)
 	{
 		root = nullptr;
@@ -219,32 +220,27 @@ void Vehicle::update_attachments()
 
 void Vehicle::sort()
 {
-	std::unordered_set<Piece*> open;
-
-	open.insert(root);
+	std::unordered_map<Piece*, std::vector<Piece*>> children;
+	for (Piece* p : all_pieces)
+	{
+		if (p->attached_to != nullptr)
+		{
+			children[p->attached_to].push_back(p);
+		}
+	}
 
 	std::vector<Piece*> sorted;
+	sorted.reserve(all_pieces.size());
 	sorted.push_back(root);
 
-	while (!open.empty())
+	// Breadth first, so every piece goes after what it's attached to
+	for (size_t i = 0; i < sorted.size(); i++)
 	{
-		std::unordered_set<Piece*> new_open;
-
-		for (Piece* o : open)
+		auto it = children.find(sorted[i]);
+		if (it != children.end())
 		{
-
-			for (Piece* p : all_pieces)
-			{
-				if (p->attached_to == o)
-				{
-					new_open.insert(p);
-					sorted.push_back(p);
-				}
-			}
+			sorted.insert(sorted.end(), it->second.begin(), it->second.end());
 		}
-
-		open = new_open;
-		
 	}
 
 	logger->check(sorted.size() == all_pieces.size(), "Vehicle was sorted while some pieces were not attached!");
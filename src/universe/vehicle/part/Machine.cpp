@@ -19,10 +19,12 @@ Machine::Machine(std::shared_ptr<cpptoml::table> init_toml, std::string cur_pkg)
 	this->in_pkg = cur_pkg;
 	this->editor_location_marker = init_toml->get_as<std::string>("__editor_marker").value_or("");
 	this->editor_hidden = init_toml->get_as<bool>("__editor_hidden").value_or(false);
+	this->assigned_piece = init_toml->get_as<std::string>("piece").value_or("p_root");
 
 	default_icon = AssetHandle<Image>("core:machines/icons/default_icon.png");
 
 	piece_missing = false;
+	in_part = nullptr;
 	runtime_uid = osp->get_runtime_uid();
 }
 
@@ -195,6 +197,18 @@ std::vector<Machine*> Machine::get_connected_if(std::function<bool(Machine*)> fn
 	return out;
 }
 
+Piece* Machine::get_piece() const
+{
+	if (in_part == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Missing pieces may still be there as nullptr (see Vehicle::remove_outdated)
+	auto it = in_part->pieces.find(assigned_piece);
+	return it == in_part->pieces.end() ? nullptr : it->second;
+}
+
 bool Machine::is_enabled()
 {
 	return !piece_missing;
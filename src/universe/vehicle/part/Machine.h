@@ -43,6 +43,7 @@ public:
 	sol::state* lua_state;
 
 	Part* in_part;
+	// The piece the machine lives in, "piece" in its toml (p_root by default)
 	std::string assigned_piece;
 
 	std::shared_ptr<cpptoml::table> init_toml;
@@ -74,6 +75,9 @@ public:
 
 	sol::table get_interface(const std::string& name);
 
+	// nullptr if the assigned piece is missing
+	Piece* get_piece() const;
+
 	AssetHandle<Image> get_icon();
 
 	std::string get_pkg();
@@ -166,6 +166,26 @@ void Piece::set_dirty(bool update_now)
 	}
 }
 
+void Piece::set_mass(double n_mass)
+{
+	double dm = n_mass - mass;
+	mass = n_mass;
+
+	if (in_vehicle == nullptr || dm == 0.0)
+	{
+		return;
+	}
+
+	if (in_vehicle->is_packed())
+	{
+		in_vehicle->packed_veh.apply_mass_delta(this, dm);
+	}
+	else
+	{
+		in_vehicle->unpacked_veh.apply_mass_delta(this, dm);
+	}
+}
+
 
 std::pair<PieceAttachment, bool>* Piece::find_attachment(std::string marker_name) 
 {
@@ -247,6 +267,7 @@ Piece::Piece(Part* in_part, std::string piece_name)
 	rigid_body = nullptr;
 	motion_state = nullptr;
 	in_group = nullptr;
+	in_vehicle = nullptr;
 	welded = false;
 
 	part = in_part;
@@ -254,6 +275,7 @@ Piece::Piece(Part* in_part, std::string piece_name)
 	piece_prototype = &in_part->part_proto.get_noconst()->pieces[piece_name];
 
 	mass = piece_prototype->mass;
+	unit_inertia = btVector3(0, 0, 0);
 	friction = piece_prototype->friction;
 	restitution = piece_prototype->restitution;
 
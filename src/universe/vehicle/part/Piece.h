@@ -25,6 +25,15 @@ struct WeldedGroup
 
 	// Should the rigidbody be rebuilt?
 	bool dirty;
+
+	// Mass properties, kept up to date as the pieces change mass (see Piece::set_mass)
+	// without rebuilding the compound. Relative to the rigidbody, whose center
+	// is moved once the center of mass drifts away (see UnpackedVehicle::push_mass_props)
+	double mass;
+	// Sum of mass * position, divided by mass gives the actual center of mass
+	btVector3 first_moment;
+	// Diagonal of the inertia tensor, the same we give to bullet
+	btVector3 inertia;
 };
 
 
@@ -64,7 +73,11 @@ public:
 	// root subparts
 	Part* part;
 
+	// Change it through set_mass so the vehicle finds out
 	double mass;
+	// Diagonal of the inertia tensor per kg of this piece, about the center of its
+	// rigidbody. Mass changes simply scale it
+	btVector3 unit_inertia;
 
 	double friction;
 	double restitution;
@@ -140,6 +153,10 @@ public:
 	double get_environment_pressure();
 
 	void set_dirty(bool update_now);
+
+	// Applied incrementally to the welded group (or the packed COM), the new
+	// mass properties reach bullet once they change enough (see UnpackedVehicle::update)
+	void set_mass(double n_mass);
 	// The piece OWNS the link, which can be null
 	std::unique_ptr<Link> link;
 	// The point in our collider where the link originates
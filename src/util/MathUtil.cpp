@@ -242,3 +242,29 @@ std::pair<glm::dvec2, bool> MathUtil::world_to_clip(glm::dmat4 proj_view, glm::d
 	return std::make_pair(glm::dvec2(clip_pos.x, clip_pos.y), clip_pos.z < 1.0);
 }
 
+bool MathUtil::is_below_horizon(glm::dvec3 camera, double occluder_radius, glm::dvec3 center, double radius)
+{
+	double cam_dist = glm::length(camera);
+	if (cam_dist <= occluder_radius)
+	{
+		return false;
+	}
+
+	glm::dvec3 cam_dir = camera / cam_dist;
+	if (glm::dot(center, cam_dir) + radius >= occluder_radius * occluder_radius / cam_dist)
+	{
+		return false;
+	}
+
+	glm::dvec3 to_center = center - camera;
+	double center_dist = glm::length(to_center);
+	if (center_dist <= radius)
+	{
+		return false;
+	}
+
+	double cone_angle = glm::asin(occluder_radius / cam_dist);
+	double angle = glm::acos(glm::clamp(glm::dot(to_center / center_dist, -cam_dir), -1.0, 1.0));
+
+	return angle + glm::asin(radius / center_dist) <= cone_angle;
+}
@@ -56,6 +56,10 @@ public:
 	// Viewport is (x0, y0, w, h), as used everywhere
 	// Returns the coordinates to be fed into NanoVG
 	static glm::vec2 clip_to_screen(glm::dvec2 clip_pos, glm::vec4 viewport);
+
+	// True if the sphere is completely hidden behind an occluder sphere at the origin,
+	// that is, behind the plane of its horizon and inside the cone it shadows
+	static bool is_below_horizon(glm::dvec3 camera, double occluder_radius, glm::dvec3 center, double radius);
 };
 
 class ProjectionUtil